@@ -0,0 +1,61 @@
+/*
+ * arch/arm/include/asm/neon.h
+ *
+ * Kernel mode NEON support.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+#ifndef __ASSEMBLY__
+
+#include <linux/types.h>
+
+/*
+ * Code between kernel_neon_begin() and kernel_neon_end() may use the
+ * NEON/VFP register file.  Any user state held in it is saved first and
+ * reloaded lazily on its next use.  Not allowed from interrupt context;
+ * preemption is disabled in between.
+ */
+extern void kernel_neon_begin(void);
+extern void kernel_neon_end(void);
+
+#ifdef CONFIG_NEON_COPY
+extern unsigned long neon_copy_threshold;
+extern void neon_copy_enable(void);
+
+/* integer versions, bypassing the NEON dispatch */
+extern void *__memcpy_arm(void *dest, const void *src, size_t n);
+extern void *__memset_arm(void *s, int c, size_t n);
+extern void __copy_page_arm(void *to, const void *from);
+
+/* NEON versions, to be called with kernel mode NEON enabled */
+extern void __memcpy_neon(void *dest, const void *src, size_t n);
+extern void __memset_neon(void *s, int c, size_t n);
+extern void __copy_page_neon(void *to, const void *from);
+
+/* NEON versions with the kernel mode NEON handling and fallback */
+extern void *neon_memcpy(void *dest, const void *src, size_t n);
+extern void *neon_memset(void *s, int c, size_t n);
+extern void neon_copy_page(void *to, const void *from);
+#endif
+
+#else
+
+/*
+ * Tail call \target, which has the same arguments as the caller, if
+ * \len is at least neon_copy_threshold.  Clobbers ip and the flags.
+ */
+	.macro	neon_copy_dispatch, len, target
+	ldr	ip, =neon_copy_threshold
+	ldr	ip, [ip]
+	cmp	ip, \len
+	bls	\target
+	.endm
+
+#endif
+
+#endif /* __ASM_ARM_NEON_H */
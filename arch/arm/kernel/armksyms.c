@@ -20,6 +20,7 @@
 #include <asm/checksum.h>
 #include <asm/system.h>
 #include <asm/ftrace.h>
+#include <asm/neon.h>
 
 /*
  * libgcc functions - functions that are used internally by the
@@ -90,6 +91,12 @@ EXPORT_SYMBOL(memcpy);
 EXPORT_SYMBOL(memmove);
 EXPORT_SYMBOL(memchr);
 EXPORT_SYMBOL(__memzero);
+#ifdef CONFIG_NEON_COPY
+EXPORT_SYMBOL(__memset_arm);
+EXPORT_SYMBOL(__memcpy_arm);
+EXPORT_SYMBOL(neon_memset);
+EXPORT_SYMBOL(neon_memcpy);
+#endif
 
 	/* user mem (segment) */
 EXPORT_SYMBOL(__strnlen_user);
@@ -97,6 +104,10 @@ EXPORT_SYMBOL(__strncpy_from_user);
 
 #ifdef CONFIG_MMU
 EXPORT_SYMBOL(copy_page);
+#ifdef CONFIG_NEON_COPY
+EXPORT_SYMBOL(__copy_page_arm);
+EXPORT_SYMBOL(neon_copy_page);
+#endif
 
 EXPORT_SYMBOL(__copy_from_user);
 EXPORT_SYMBOL(__copy_to_user);
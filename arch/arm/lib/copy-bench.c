@@ -0,0 +1,160 @@
+/*
+ *  linux/arch/arm/lib/copy-bench.c
+ *
+ *  Timing of the integer and NEON memcpy, memset and copy_page
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  Loading the module prints the throughput of both variants for each
+ *  size and alignment, including the kernel_neon_begin/end cost of every
+ *  NEON call, then fails with -EAGAIN so that it does not stay loaded.
+ *  The crossover it shows is what the "neon_copy=" parameter should be
+ *  set to.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+
+#include <asm/neon.h>
+
+#define BENCH_MAX_SIZE	(256 * 1024)
+
+static unsigned int bytes = 16 << 20;
+
+static const unsigned int bench_sizes[] = {
+	64, 128, 256, 512, 1024, 2048, 4096, 16384, 65536, BENCH_MAX_SIZE,
+};
+
+static const struct {
+	unsigned int dst;
+	unsigned int src;
+} bench_aligns[] = {
+	{ 0, 0 }, { 0, 1 }, { 1, 0 }, { 4, 0 }, { 3, 7 },
+};
+
+enum bench_op {
+	BENCH_MEMCPY,
+	BENCH_MEMSET,
+	BENCH_COPY_PAGE,
+};
+
+static const char *bench_names[] = {
+	[BENCH_MEMCPY]		= "memcpy",
+	[BENCH_MEMSET]		= "memset",
+	[BENCH_COPY_PAGE]	= "copy_page",
+};
+
+/* Returns the throughput of "loops" calls in MB/s. */
+static unsigned long bench_run(enum bench_op op, int neon, void *dst,
+			       const void *src, size_t len,
+			       unsigned int loops)
+{
+	unsigned int i;
+	ktime_t start;
+	s64 ns;
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		switch (op) {
+		case BENCH_MEMCPY:
+			if (neon)
+				neon_memcpy(dst, src, len);
+			else
+				__memcpy_arm(dst, src, len);
+			break;
+		case BENCH_MEMSET:
+			if (neon)
+				neon_memset(dst, 0x5a, len);
+			else
+				__memset_arm(dst, 0x5a, len);
+			break;
+		case BENCH_COPY_PAGE:
+			if (neon)
+				neon_copy_page(dst, src);
+			else
+				__copy_page_arm(dst, src);
+			break;
+		}
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	return div64_u64((u64)len * loops * 1000, max_t(s64, ns, 1));
+}
+
+static void bench_one(enum bench_op op, void *dst_buf, const void *src_buf,
+		      size_t len, unsigned int dst_off, unsigned int src_off)
+{
+	void *dst = dst_buf + dst_off;
+	const void *src = src_buf + src_off;
+	unsigned int loops = max_t(unsigned int, bytes / len, 1);
+	unsigned long arm, neon;
+
+	/* one untimed pass of each to fault in and warm up the buffers */
+	bench_run(op, 0, dst, src, len, 1);
+	bench_run(op, 1, dst, src, len, 1);
+
+	arm = bench_run(op, 0, dst, src, len, loops);
+	neon = bench_run(op, 1, dst, src, len, loops);
+
+	printk(KERN_INFO "copy-bench: %-9s %6zu bytes dst+%u src+%u: "
+	       "arm %5lu MB/s, neon %5lu MB/s\n", bench_names[op], len,
+	       dst_off, src_off, arm, neon);
+	cond_resched();
+}
+
+static int __init copy_bench_init(void)
+{
+	void *dst_buf, *src_buf;
+	int i, j;
+
+	dst_buf = vmalloc(BENCH_MAX_SIZE + PAGE_SIZE);
+	src_buf = vmalloc(BENCH_MAX_SIZE + PAGE_SIZE);
+	if (!dst_buf || !src_buf) {
+		vfree(dst_buf);
+		vfree(src_buf);
+		return -ENOMEM;
+	}
+	__memset_arm(src_buf, 0xa5, BENCH_MAX_SIZE + PAGE_SIZE);
+
+	for (i = 0; i < ARRAY_SIZE(bench_sizes); i++)
+		for (j = 0; j < ARRAY_SIZE(bench_aligns); j++)
+			bench_one(BENCH_MEMCPY, dst_buf, src_buf,
+				  bench_sizes[i], bench_aligns[j].dst,
+				  bench_aligns[j].src);
+
+	for (i = 0; i < ARRAY_SIZE(bench_sizes); i++)
+		for (j = 0; j < ARRAY_SIZE(bench_aligns); j++)
+			if (!bench_aligns[j].src)
+				bench_one(BENCH_MEMSET, dst_buf, src_buf,
+					  bench_sizes[i], bench_aligns[j].dst,
+					  0);
+
+	bench_one(BENCH_COPY_PAGE, dst_buf, src_buf, PAGE_SIZE, 0, 0);
+
+	vfree(dst_buf);
+	vfree(src_buf);
+
+	/* all the work is done from init, there is nothing to keep */
+	return -EAGAIN;
+}
+
+/*
+ * If an init function is provided, an exit function must also be provided
+ * to allow module unload.
+ */
+static void __exit copy_bench_exit(void) { }
+
+module_init(copy_bench_init);
+module_exit(copy_bench_exit);
+
+module_param(bytes, uint, 0);
+MODULE_PARM_DESC(bytes, "Bytes moved per measurement (default 16M)");
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Integer and NEON memcpy, memset and copy_page benchmark");
@@ -0,0 +1,85 @@
+/*
+ *  linux/arch/arm/lib/neon-copy.c
+ *
+ *  Runtime selection of the NEON memcpy, memset and copy_page
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  memcpy, memset and copy_page tail call the functions below when the
+ *  length is at least neon_copy_threshold.  That stays at ~0, which no
+ *  length reaches, until vfp_init() has found a NEON unit.  Saving the
+ *  user VFP state costs about as much as copying a few hundred bytes, so
+ *  smaller copies are left to the integer code.
+ */
+#include <linux/hardirq.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+#include <asm/neon.h>
+
+#define NEON_COPY_DEFAULT	1024
+#define NEON_COPY_MIN		64
+
+unsigned long neon_copy_threshold __read_mostly = ~0UL;
+
+static unsigned long neon_copy_min __initdata = NEON_COPY_DEFAULT;
+
+static int __init neon_copy_setup(char *str)
+{
+	if (!strcmp(str, "off"))
+		neon_copy_min = ~0UL;
+	else
+		neon_copy_min = max_t(unsigned long, memparse(str, &str),
+				      NEON_COPY_MIN);
+	return 1;
+}
+__setup("neon_copy=", neon_copy_setup);
+
+void __init neon_copy_enable(void)
+{
+	neon_copy_threshold = neon_copy_min;
+	if (neon_copy_threshold != ~0UL)
+		printk(KERN_INFO "NEON: memcpy/memset from %lu bytes\n",
+		       neon_copy_threshold);
+}
+
+/*
+ * The NEON register file can only be borrowed outside interrupt
+ * context, so interrupt handlers keep to the integer routines.
+ */
+void *neon_memcpy(void *dest, const void *src, size_t n)
+{
+	if (in_interrupt())
+		return __memcpy_arm(dest, src, n);
+
+	kernel_neon_begin();
+	__memcpy_neon(dest, src, n);
+	kernel_neon_end();
+	return dest;
+}
+
+void *neon_memset(void *s, int c, size_t n)
+{
+	if (in_interrupt())
+		return __memset_arm(s, c, n);
+
+	kernel_neon_begin();
+	__memset_neon(s, c, n);
+	kernel_neon_end();
+	return s;
+}
+
+void neon_copy_page(void *to, const void *from)
+{
+	if (in_interrupt()) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	__copy_page_neon(to, from);
+	kernel_neon_end();
+}
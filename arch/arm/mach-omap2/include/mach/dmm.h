@@ -19,6 +19,9 @@
 #ifndef DMM_H
 #define DMM_H
 
+#include <linux/types.h>
+#include <linux/mutex.h>
+
 #define DMM_BASE 0x4E000000
 #define DMM_SIZE 0x800
 
@@ -100,6 +103,9 @@ struct pat {
  */
 struct dmm {
 	void __iomem *base;
+	struct mutex mtx;		/* serializes refills */
+	struct dmm_pat_desc *descs;	/* AUTO refill descriptors */
+	dma_addr_t descs_pa;
 };
 
 /**
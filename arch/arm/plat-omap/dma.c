@@ -1892,7 +1892,8 @@ static int omap2_dma_handle_ch(int ch)
 		if (!OMAP_DMA_CHAIN_QEMPTY(chain_id))
 			OMAP_DMA_CHAIN_INCQHEAD(chain_id);
 
-		status = p->dma_read(CSR, ch);
+		/* keep the bits already cleared for the callback */
+		status |= p->dma_read(CSR, ch);
 	}
 
 	p->dma_write(status, CSR, ch);
@@ -584,6 +584,23 @@ extern int omap_modify_dma_chain_params(int chain_id,
 extern int omap_dma_chain_status(int chain_id);
 #endif
 
+#ifdef CONFIG_ARCH_TI81XX
+/* EDMA backed linking of scatter-gather transfers */
+struct scatterlist;
+extern int omap_dma_link_sg(int lch, struct scatterlist *sgl, int nents);
+#endif
+
+/* dmaengine provider */
+struct dma_chan;
+#ifdef CONFIG_DMA_OMAP
+extern bool omap_dma_filter_fn(struct dma_chan *chan, void *param);
+#else
+static inline bool omap_dma_filter_fn(struct dma_chan *chan, void *param)
+{
+	return false;
+}
+#endif
+
 #if defined(CONFIG_ARCH_OMAP1) && defined(CONFIG_FB_OMAP)
 #include <mach/lcd_dma.h>
 #else
@@ -41,13 +41,33 @@ struct omap_mbox_ops {
 	void		(*restore_ctx)(struct omap_mbox *mbox);
 };
 
+/*
+ * Latency of a queue: from a message arriving in an empty queue until
+ * the queue has been emptied again, in log2 buckets of microseconds.
+ */
+#define MBOX_HIST_BUCKETS	16
+
+struct omap_mbox_stats {
+	unsigned long		msgs;
+	unsigned long		batches;
+	u32			stamp;
+	unsigned long		hist[MBOX_HIST_BUCKETS];
+};
+
+/* omap_mbox_queue flags */
+#define MBOX_TX_BUSY		0
+
 struct omap_mbox_queue {
 	spinlock_t		lock;
 	struct kfifo		fifo;
 	struct work_struct	work;
 	struct tasklet_struct	tasklet;
 	struct omap_mbox	*mbox;
+	unsigned long		flags;
 	bool full;
+#ifdef CONFIG_OMAP_MBOX_STATS
+	struct omap_mbox_stats	stats;
+#endif
 };
 
 struct omap_mbox {
@@ -59,14 +79,25 @@ struct omap_mbox {
 	void			*priv;
 	int			use_count;
 	struct blocking_notifier_head   notifier;
+	struct blocking_notifier_head	batch_notifier;
+#ifdef CONFIG_OMAP_MBOX_STATS
+	struct dentry		*debug;
+#endif
 };
 
 int omap_mbox_msg_send(struct omap_mbox *, mbox_msg_t msg);
+int omap_mbox_msg_send_vec(struct omap_mbox *, const mbox_msg_t *msgs,
+			   unsigned int count);
 void omap_mbox_init_seq(struct omap_mbox *);
 
 struct omap_mbox *omap_mbox_get(const char *, struct notifier_block *nb);
 void omap_mbox_put(struct omap_mbox *mbox, struct notifier_block *nb);
 
+int omap_mbox_register_batch_notifier(struct omap_mbox *mbox,
+				      struct notifier_block *nb);
+int omap_mbox_unregister_batch_notifier(struct omap_mbox *mbox,
+					struct notifier_block *nb);
+
 int omap_mbox_register(struct device *parent, struct omap_mbox **);
 int omap_mbox_unregister(void);
 
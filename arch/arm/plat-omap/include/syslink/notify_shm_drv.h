@@ -51,6 +51,24 @@ struct notify_shm_drv_params {
 	/* Local interrupt ID for interrupt line for incoming interrupts */
 	u32 remote_int_id;
 	/* Remote interrupt ID for interrupt line for outgoing interrupts */
+	bool coalesce;
+	/* Raise one interrupt for all events posted before it is sent */
+	u32 poll_usecs;
+	/* Time to keep polling for events after an interrupt, 0 to disable */
+};
+
+/* Event and interrupt counters of one notify_shm_drv instance. */
+struct notify_shm_drv_stats {
+	u32 events_sent;
+	/* Events posted to the remote processor */
+	u32 ints_sent;
+	/* Interrupts raised on the remote processor */
+	u32 events_recv;
+	/* Events received from the remote processor */
+	u32 ints_recv;
+	/* Interrupts received, including those finding no event */
+	u32 events_polled;
+	/* Events received by polling after an interrupt */
 };
 
 /* Defines the structure of event entry within the event chart.
@@ -134,5 +152,9 @@ void notify_shm_drv_disable_event(struct notify_driver_object *handle,
 void notify_shm_drv_enable_event(struct notify_driver_object *handle,
 					u32 event_id);
 
+/* Get the event and interrupt counters of the Notify driver. */
+void notify_shm_drv_get_stats(struct notify_shm_drv_object *handle,
+				struct notify_shm_drv_stats *stats);
+
 
 #endif  /* !defined  NOTIFY_SHMDRIVER_H_ */
@@ -29,6 +29,9 @@
 #include <linux/kfifo.h>
 #include <linux/err.h>
 #include <linux/notifier.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <plat/mailbox.h>
 
@@ -60,6 +63,40 @@ static inline int mbox_fifo_full(struct omap_mbox *mbox)
 	return mbox->ops->fifo_full(mbox);
 }
 
+/*
+ * Queue statistics.  A stamp is taken when a message lands in an empty
+ * queue, and the time until the queue is next found empty goes into the
+ * histogram.  The producer writes the stamp before kfifo_in() publishes
+ * the message, so the consumer always sees it.
+ */
+#ifdef CONFIG_OMAP_MBOX_STATS
+static struct dentry *mbox_debug_root;
+
+static inline void mbox_stats_stamp(struct omap_mbox_queue *mq)
+{
+	if (kfifo_is_empty(&mq->fifo))
+		mq->stats.stamp = (u32)ktime_to_ns(ktime_get());
+}
+
+static void mbox_stats_batch(struct omap_mbox_queue *mq, unsigned int count)
+{
+	struct omap_mbox_stats *st = &mq->stats;
+	u32 us;
+
+	st->msgs += count;
+	st->batches++;
+	if (!kfifo_is_empty(&mq->fifo))
+		return;
+
+	us = ((u32)ktime_to_ns(ktime_get()) - st->stamp) / NSEC_PER_USEC;
+	st->hist[min_t(int, fls(us), MBOX_HIST_BUCKETS - 1)]++;
+}
+#else
+static inline void mbox_stats_stamp(struct omap_mbox_queue *mq) { }
+static inline void mbox_stats_batch(struct omap_mbox_queue *mq,
+				    unsigned int count) { }
+#endif
+
 /* Mailbox IRQ handle functions */
 static inline void ack_mbox_irq(struct omap_mbox *mbox, omap_mbox_irq_t irq)
 {
@@ -88,77 +125,164 @@ static int __mbox_poll_for_space(struct omap_mbox *mbox)
 	return ret;
 }
 
+/*
+ * Move queued messages into the hardware FIFO.  Whoever owns
+ * MBOX_TX_BUSY is the only consumer of the kfifo; a producer that finds
+ * it taken just leaves its messages behind, and the owner looks at the
+ * queue again after letting go of the bit.  Once the hardware FIFO is
+ * full the TX interrupt takes over.
+ *
+ * Returns false if the queue was busy on entry.
+ */
+static bool mbox_tx_drain(struct omap_mbox *mbox)
+{
+	struct omap_mbox_queue *mq = mbox->txq;
+	unsigned int count;
+	bool stalled;
+	mbox_msg_t msg;
+	int ret;
+
+	if (test_and_set_bit_lock(MBOX_TX_BUSY, &mq->flags))
+		return false;
+
+	for (;;) {
+		stalled = false;
+		for (count = 0; !kfifo_is_empty(&mq->fifo); count++) {
+			if (__mbox_poll_for_space(mbox)) {
+				omap_mbox_enable_irq(mbox, IRQ_TX);
+				stalled = true;
+				break;
+			}
+
+			ret = kfifo_out(&mq->fifo, (unsigned char *)&msg,
+								sizeof(msg));
+			WARN_ON(ret != sizeof(msg));
+
+			mbox_fifo_write(mbox, msg);
+		}
+		if (count)
+			mbox_stats_batch(mq, count);
+
+		clear_bit_unlock(MBOX_TX_BUSY, &mq->flags);
+		smp_mb__after_clear_bit();
+
+		if (stalled || kfifo_is_empty(&mq->fifo) ||
+		    test_and_set_bit_lock(MBOX_TX_BUSY, &mq->flags))
+			return true;
+	}
+}
+
+static void mbox_tx_kick(struct omap_mbox *mbox)
+{
+	local_bh_disable();
+	mbox_tx_drain(mbox);
+	local_bh_enable();
+}
+
+/*
+ * Any number of contexts may call omap_mbox_msg_send(); they are
+ * serialized against each other, but not against the hardware writes.
+ */
 int omap_mbox_msg_send(struct omap_mbox *mbox, mbox_msg_t msg)
 {
 	struct omap_mbox_queue *mq = mbox->txq;
-	int ret = 0, len;
+	int len;
 
 	spin_lock_bh(&mq->lock);
 
 	if (kfifo_avail(&mq->fifo) < sizeof(msg)) {
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	if (kfifo_is_empty(&mq->fifo) && !__mbox_poll_for_space(mbox)) {
-		mbox_fifo_write(mbox, msg);
-		goto out;
+		spin_unlock_bh(&mq->lock);
+		return -ENOMEM;
 	}
 
+	mbox_stats_stamp(mq);
 	len = kfifo_in(&mq->fifo, (unsigned char *)&msg, sizeof(msg));
 	WARN_ON(len != sizeof(msg));
 
-	tasklet_schedule(&mbox->txq->tasklet);
-
-out:
 	spin_unlock_bh(&mq->lock);
-	return ret;
+
+	mbox_tx_kick(mbox);
+	return 0;
 }
 EXPORT_SYMBOL(omap_mbox_msg_send);
 
-static void mbox_tx_tasklet(unsigned long tx_data)
+/**
+ * omap_mbox_msg_send_vec - queue several messages in one go
+ * @mbox: mailbox returned by omap_mbox_get()
+ * @msgs: messages, sent in order
+ * @count: number of messages
+ *
+ * Lockless variant of omap_mbox_msg_send() for a mailbox that has a
+ * single sending context: it must not race with any other sender on
+ * @mbox.  Either all messages are queued or, if the queue has no room
+ * for them, none and -ENOMEM is returned.
+ */
+int omap_mbox_msg_send_vec(struct omap_mbox *mbox, const mbox_msg_t *msgs,
+			   unsigned int count)
 {
-	struct omap_mbox *mbox = (struct omap_mbox *)tx_data;
 	struct omap_mbox_queue *mq = mbox->txq;
-	mbox_msg_t msg;
-	int ret;
+	unsigned int len = count * sizeof(*msgs);
+	unsigned int ret;
 
-	while (kfifo_len(&mq->fifo)) {
-		if (__mbox_poll_for_space(mbox)) {
-			omap_mbox_enable_irq(mbox, IRQ_TX);
-			break;
-		}
+	if (kfifo_avail(&mq->fifo) < len)
+		return -ENOMEM;
 
-		ret = kfifo_out(&mq->fifo, (unsigned char *)&msg,
-								sizeof(msg));
-		WARN_ON(ret != sizeof(msg));
+	mbox_stats_stamp(mq);
+	ret = kfifo_in(&mq->fifo, (unsigned char *)msgs, len);
+	WARN_ON(ret != len);
 
-		mbox_fifo_write(mbox, msg);
-	}
+	mbox_tx_kick(mbox);
+	return 0;
+}
+EXPORT_SYMBOL(omap_mbox_msg_send_vec);
+
+static void mbox_tx_tasklet(unsigned long tx_data)
+{
+	struct omap_mbox *mbox = (struct omap_mbox *)tx_data;
+
+	/*
+	 * The owner of MBOX_TX_BUSY may have seen the FIFO full just
+	 * before this interrupt and already be on its way out.
+	 */
+	if (!mbox_tx_drain(mbox))
+		tasklet_schedule(&mbox->txq->tasklet);
 }
 
 /*
  * Message receiver(workqueue)
+ *
+ * Everything the interrupt handler has queued is handed out in batches
+ * of up to MBOX_RX_BATCH messages: once to the batch notifier chain, with
+ * the number of messages and the array, and then to the per-message
+ * notifier chain one message at a time.
  */
+#define MBOX_RX_BATCH	16
+
 static void mbox_rx_work(struct work_struct *work)
 {
 	struct omap_mbox_queue *mq =
 			container_of(work, struct omap_mbox_queue, work);
-	mbox_msg_t msg;
+	struct omap_mbox *mbox = mq->mbox;
+	mbox_msg_t msgs[MBOX_RX_BATCH], msg;
+	unsigned int i, count;
 	int len;
 
-	while (kfifo_len(&mq->fifo) >= sizeof(msg)) {
-		len = kfifo_out(&mq->fifo, (unsigned char *)&msg, sizeof(msg));
-		WARN_ON(len != sizeof(msg));
+	while ((len = kfifo_out(&mq->fifo, (unsigned char *)msgs,
+							sizeof(msgs)))) {
+		count = len / sizeof(msg);
+
+		blocking_notifier_call_chain(&mbox->batch_notifier, count,
+									msgs);
+		for (i = 0; i < count; i++)
+			blocking_notifier_call_chain(&mbox->notifier,
+					sizeof(msg), (void *)msgs[i]);
 
-		blocking_notifier_call_chain(&mq->mbox->notifier, len,
-								(void *)msg);
 		spin_lock_irq(&mq->lock);
 		if (mq->full) {
 			mq->full = false;
 
-			if (!mbox_fifo_empty(mq->mbox)) {
-				msg = mbox_fifo_read(mq->mbox);
+			if (!mbox_fifo_empty(mbox)) {
+				msg = mbox_fifo_read(mbox);
 
 				len = kfifo_in(&mq->fifo, (unsigned char *)&msg,
 								sizeof(msg));
@@ -166,8 +290,9 @@ static void mbox_rx_work(struct work_struct *work)
 			}
 
 
-			omap_mbox_enable_irq(mq->mbox, IRQ_RX);
+			omap_mbox_enable_irq(mbox, IRQ_RX);
 		}
+		mbox_stats_batch(mq, count);
 		spin_unlock_irq(&mq->lock);
 	}
 }
@@ -197,6 +322,7 @@ static void __mbox_rx_interrupt(struct omap_mbox *mbox)
 
 		msg = mbox_fifo_read(mbox);
 
+		mbox_stats_stamp(mq);
 		len = kfifo_in(&mq->fifo, (unsigned char *)&msg, sizeof(msg));
 		WARN_ON(len != sizeof(msg));
 
@@ -288,6 +414,7 @@ static int omap_mbox_startup(struct omap_mbox *mbox)
 			goto fail_alloc_txq;
 		}
 		mbox->txq = mq;
+		mq->mbox = mbox;
 
 		mq = mbox_queue_alloc(mbox, mbox_rx_work, NULL);
 		if (!mq) {
@@ -367,6 +494,82 @@ void omap_mbox_put(struct omap_mbox *mbox, struct notifier_block *nb)
 }
 EXPORT_SYMBOL(omap_mbox_put);
 
+/*
+ * Batch notifiers are called from the receive work with the number of
+ * messages as the action and a mbox_msg_t array as the data.
+ */
+int omap_mbox_register_batch_notifier(struct omap_mbox *mbox,
+				      struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&mbox->batch_notifier, nb);
+}
+EXPORT_SYMBOL(omap_mbox_register_batch_notifier);
+
+int omap_mbox_unregister_batch_notifier(struct omap_mbox *mbox,
+					struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&mbox->batch_notifier, nb);
+}
+EXPORT_SYMBOL(omap_mbox_unregister_batch_notifier);
+
+#ifdef CONFIG_OMAP_MBOX_STATS
+static void mbox_stats_show_queue(struct seq_file *s, const char *name,
+				  struct omap_mbox_queue *mq)
+{
+	struct omap_mbox_stats *st = &mq->stats;
+	int i;
+
+	seq_printf(s, "%s: %lu messages in %lu batches\n", name,
+		   st->msgs, st->batches);
+	for (i = 0; i < MBOX_HIST_BUCKETS; i++)
+		seq_printf(s, "  %s%8u us: %lu\n",
+			   i == MBOX_HIST_BUCKETS - 1 ? ">=" : "< ",
+			   1U << (i == MBOX_HIST_BUCKETS - 1 ? i - 1 : i),
+			   st->hist[i]);
+}
+
+static int mbox_stats_show(struct seq_file *s, void *unused)
+{
+	struct omap_mbox *mbox = s->private;
+
+	mutex_lock(&mbox_configured_lock);
+	if (mbox->use_count) {
+		mbox_stats_show_queue(s, "tx", mbox->txq);
+		mbox_stats_show_queue(s, "rx", mbox->rxq);
+	}
+	mutex_unlock(&mbox_configured_lock);
+	return 0;
+}
+
+static int mbox_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mbox_stats_show, inode->i_private);
+}
+
+static const struct file_operations mbox_stats_fops = {
+	.open		= mbox_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void mbox_debugfs_add(struct omap_mbox *mbox)
+{
+	if (mbox_debug_root)
+		mbox->debug = debugfs_create_file(mbox->name, S_IRUGO,
+				mbox_debug_root, mbox, &mbox_stats_fops);
+}
+
+static void mbox_debugfs_remove(struct omap_mbox *mbox)
+{
+	debugfs_remove(mbox->debug);
+	mbox->debug = NULL;
+}
+#else
+static inline void mbox_debugfs_add(struct omap_mbox *mbox) { }
+static inline void mbox_debugfs_remove(struct omap_mbox *mbox) { }
+#endif
+
 static struct class omap_mbox_class = { .name = "mbox", };
 
 int omap_mbox_register(struct device *parent, struct omap_mbox **list)
@@ -388,12 +591,16 @@ int omap_mbox_register(struct device *parent, struct omap_mbox **list)
 		}
 
 		BLOCKING_INIT_NOTIFIER_HEAD(&mbox->notifier);
+		BLOCKING_INIT_NOTIFIER_HEAD(&mbox->batch_notifier);
+		mbox_debugfs_add(mbox);
 	}
 	return 0;
 
 err_out:
-	while (i--)
+	while (i--) {
+		mbox_debugfs_remove(mboxes[i]);
 		device_unregister(mboxes[i]->dev);
+	}
 	return ret;
 }
 EXPORT_SYMBOL(omap_mbox_register);
@@ -405,8 +612,10 @@ int omap_mbox_unregister(void)
 	if (!mboxes)
 		return -EINVAL;
 
-	for (i = 0; mboxes[i]; i++)
+	for (i = 0; mboxes[i]; i++) {
+		mbox_debugfs_remove(mboxes[i]);
 		device_unregister(mboxes[i]->dev);
+	}
 	mboxes = NULL;
 	return 0;
 }
@@ -429,12 +638,18 @@ static int __init omap_mbox_init(void)
 	mbox_kfifo_size = max_t(unsigned int, mbox_kfifo_size,
 							sizeof(mbox_msg_t));
 
+#ifdef CONFIG_OMAP_MBOX_STATS
+	mbox_debug_root = debugfs_create_dir("mailbox", NULL);
+#endif
 	return 0;
 }
 subsys_initcall(omap_mbox_init);
 
 static void __exit omap_mbox_exit(void)
 {
+#ifdef CONFIG_OMAP_MBOX_STATS
+	debugfs_remove(mbox_debug_root);
+#endif
 	destroy_workqueue(mboxd);
 	class_unregister(&omap_mbox_class);
 }
@@ -32,6 +32,9 @@
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 #include <linux/io.h>
+#include <linux/scatterlist.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/system.h>
 #include <mach/hardware.h>
@@ -41,6 +44,91 @@
 /* some edma specific hacks which might change */
 #include <asm/hardware/edma.h>
 
+/*
+ * PaRAM slots used for linking are recycled through a small pool, so that
+ * building a chain does not go through edma_alloc_slot()/edma_free_slot()
+ * and their PaRAM reinitialization every time.
+ */
+#define S2E_POOL_SLOTS		32
+#define S2E_MAX_LINKS		16	/* slots linked after one channel */
+
+struct s2e_pool {
+	int slots[S2E_POOL_SLOTS];
+	int count;
+};
+
+struct s2e_chan {
+	int link[S2E_MAX_LINKS];	/* slots linked after the channel */
+	int nlinks;
+	bool linked;			/* set by omap_dma_link_lch() */
+	int next_lch;
+	unsigned long starts;
+	unsigned long blocks;
+};
+
+static DEFINE_SPINLOCK(s2e_lock);
+static struct s2e_pool s2e_pool[EDMA_MAX_CC];
+static struct s2e_chan s2e_chan[EDMA_MAX_CC][EDMA_MAX_DMACH];
+
+static inline struct s2e_chan *s2e_to_chan(int lch)
+{
+	return &s2e_chan[EDMA_CTLR(lch)][EDMA_CHAN_SLOT(lch)];
+}
+
+static int s2e_get_slot(unsigned ctlr)
+{
+	struct s2e_pool *pool = &s2e_pool[ctlr];
+	unsigned long flags;
+	int slot = -1;
+
+	spin_lock_irqsave(&s2e_lock, flags);
+	if (pool->count)
+		slot = pool->slots[--pool->count];
+	spin_unlock_irqrestore(&s2e_lock, flags);
+
+	if (slot < 0)
+		slot = edma_alloc_slot(ctlr, EDMA_SLOT_ANY);
+
+	return slot;
+}
+
+static void s2e_put_slot(int slot)
+{
+	struct s2e_pool *pool = &s2e_pool[EDMA_CTLR(slot)];
+	unsigned long flags;
+
+	spin_lock_irqsave(&s2e_lock, flags);
+	if (pool->count < S2E_POOL_SLOTS) {
+		pool->slots[pool->count++] = slot;
+		slot = -1;
+	}
+	spin_unlock_irqrestore(&s2e_lock, flags);
+
+	if (slot >= 0)
+		edma_free_slot(slot);
+}
+
+/*
+ * Give back the slots linked after a channel and make its own PaRAM set
+ * a stand-alone transfer again.  The channel must not be running.
+ */
+static void s2e_release_links(int lch)
+{
+	struct s2e_chan *c = s2e_to_chan(lch);
+	struct edmacc_param p_ram;
+
+	if (!c->nlinks)
+		return;
+
+	while (c->nlinks)
+		s2e_put_slot(c->link[--c->nlinks]);
+
+	edma_read_slot(lch, &p_ram);
+	p_ram.opt |= TCINTEN;
+	p_ram.link_bcntrld |= 0xffff;
+	edma_write_slot(lch, &p_ram);
+}
+
 /**
  * omap_request_dma - allocate DMA channel and paired parameter RAM
  * @dev_id: specific channel to allocate; negative for "any unmapped channel"
@@ -106,6 +194,8 @@ EXPORT_SYMBOL(omap_request_dma);
  */
 void omap_free_dma(int lch)
 {
+	s2e_release_links(lch);
+	s2e_to_chan(lch)->linked = false;
 	edma_free_channel((unsigned)lch);
 }
 EXPORT_SYMBOL(omap_free_dma);
@@ -122,6 +212,31 @@ EXPORT_SYMBOL(omap_free_dma);
  */
 void omap_start_dma(int lch)
 {
+	struct s2e_chan *c = s2e_to_chan(lch);
+	struct edmacc_param p_ram;
+	int slot;
+
+	/* load the reload set of an omap_dma_link_lch() link */
+	if (c->linked) {
+		s2e_release_links(lch);
+
+		slot = s2e_get_slot(EDMA_CTLR(lch));
+		if (slot >= 0) {
+			edma_read_slot(c->next_lch, &p_ram);
+			p_ram.opt &= ~STATIC;
+			p_ram.link_bcntrld |= 0xffff;
+			edma_write_slot(slot, &p_ram);
+			if (c->next_lch == lch)
+				edma_link(slot, slot);
+
+			c->link[c->nlinks++] = slot;
+			edma_link(lch, slot);
+		}
+	}
+
+	c->starts++;
+	c->blocks += 1 + c->nlinks;
+
 	edma_start((unsigned)lch);
 }
 EXPORT_SYMBOL(omap_start_dma);
@@ -138,6 +253,7 @@ EXPORT_SYMBOL(omap_start_dma);
 void omap_stop_dma(int lch)
 {
 	edma_stop((unsigned)lch);
+	s2e_release_links(lch);
 }
 EXPORT_SYMBOL(omap_stop_dma);
 
@@ -206,6 +322,9 @@ void omap_set_dma_transfer_params(int lch, int data_type, int elem_count,
 	/* translate data_type */
 	data_type = d_type[data_type];
 
+	/* a reprogrammed channel starts out unlinked */
+	s2e_release_links(lch);
+
 	edma_set_transfer_params(lch, (u16)data_type, (u16)elem_count,
 				(u16)frame_count, (u16)elem_count,
 				(enum sync_dimension)sync_mode);
@@ -307,3 +426,148 @@ int omap_get_dma_active_status(int lch)
 	return 0;
 }
 EXPORT_SYMBOL(omap_get_dma_active_status);
+
+/**
+ * omap_dma_link_lch - link a channel to another one
+ * @lch_head: channel whose transfer is followed by the other one
+ * @lch_queue: channel whose PaRAM set is reloaded; may be @lch_head
+ *
+ * The PaRAM set of @lch_queue is copied to a linked slot each time
+ * @lch_head is started, so parameters set after this call are honoured.
+ * Linking a channel to itself repeats its transfer until it is stopped.
+ */
+void omap_dma_link_lch(int lch_head, int lch_queue)
+{
+	struct s2e_chan *c = s2e_to_chan(lch_head);
+
+	c->linked = true;
+	c->next_lch = lch_queue;
+}
+EXPORT_SYMBOL(omap_dma_link_lch);
+
+void omap_dma_unlink_lch(int lch_head, int lch_queue)
+{
+	s2e_to_chan(lch_head)->linked = false;
+	s2e_release_links(lch_head);
+}
+EXPORT_SYMBOL(omap_dma_unlink_lch);
+
+/**
+ * omap_dma_link_sg - spread a transfer over a scatterlist
+ * @lch: channel already set up for the transfer
+ * @sgl: DMA mapped scatterlist
+ * @nents: number of entries in @sgl
+ *
+ * The channel must have been configured with omap_set_dma_transfer_params()
+ * and the address of the device side.  The memory side address and the
+ * frame count of each segment are taken from @sgl, one PaRAM set per
+ * segment, linked after the channel's own set.  Only the last segment
+ * raises a completion interrupt.
+ */
+int omap_dma_link_sg(int lch, struct scatterlist *sgl, int nents)
+{
+	struct s2e_chan *c = s2e_to_chan(lch);
+	struct edmacc_param p_ram, seg;
+	struct scatterlist *sg;
+	unsigned frame;
+	bool mem_dst;
+	int i, slot, prev;
+
+	if (nents < 1 || nents > S2E_MAX_LINKS + 1)
+		return -EINVAL;
+
+	s2e_release_links(lch);
+	edma_read_slot(lch, &p_ram);
+
+	/* exactly one side has to be the device FIFO */
+	if (!(p_ram.opt & SAM) == !(p_ram.opt & DAM))
+		return -EINVAL;
+	mem_dst = p_ram.opt & SAM;
+
+	frame = (p_ram.a_b_cnt & 0xffff) * (p_ram.a_b_cnt >> 16);
+	if (!frame)
+		return -EINVAL;
+
+	for_each_sg(sgl, sg, nents, i)
+		if (sg_dma_len(sg) % frame || !sg_dma_len(sg) ||
+		    sg_dma_len(sg) / frame > 0xffff)
+			return -EINVAL;
+
+	for (i = 1; i < nents; i++) {
+		slot = s2e_get_slot(EDMA_CTLR(lch));
+		if (slot < 0) {
+			s2e_release_links(lch);
+			return -ENOMEM;
+		}
+		c->link[c->nlinks++] = slot;
+	}
+
+	prev = lch;
+	for_each_sg(sgl, sg, nents, i) {
+		seg = p_ram;
+		if (mem_dst)
+			seg.dst = sg_dma_address(sg);
+		else
+			seg.src = sg_dma_address(sg);
+		seg.ccnt = sg_dma_len(sg) / frame;
+		seg.link_bcntrld |= 0xffff;
+		seg.opt &= ~STATIC;
+		if (i < nents - 1)
+			seg.opt &= ~TCINTEN;
+		else
+			seg.opt |= TCINTEN;
+
+		slot = i ? c->link[i - 1] : lch;
+		edma_write_slot(slot, &seg);
+		if (i)
+			edma_link(prev, slot);
+		prev = slot;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(omap_dma_link_sg);
+
+#ifdef CONFIG_DEBUG_FS
+static int s2e_debug_show(struct seq_file *s, void *unused)
+{
+	struct s2e_chan *c;
+	int ctlr, ch;
+
+	for (ctlr = 0; ctlr < EDMA_MAX_CC; ctlr++) {
+		seq_printf(s, "cc%d: %d pooled slots\n", ctlr,
+				s2e_pool[ctlr].count);
+
+		for (ch = 0; ch < EDMA_MAX_DMACH; ch++) {
+			c = &s2e_chan[ctlr][ch];
+			if (!c->starts)
+				continue;
+			seq_printf(s, "  ch%-2d starts %lu blocks %lu "
+					"linked %d\n", ch, c->starts,
+					c->blocks, c->nlinks);
+		}
+	}
+
+	return 0;
+}
+
+static int s2e_debug_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, s2e_debug_show, inode->i_private);
+}
+
+static const struct file_operations s2e_debug_fops = {
+	.open		= s2e_debug_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init s2e_debug_init(void)
+{
+	debugfs_create_file("sdma2edma", S_IRUGO, NULL, NULL,
+			&s2e_debug_fops);
+	return 0;
+}
+late_initcall(s2e_debug_init);
+#endif
@@ -10,12 +10,14 @@
  */
 #include <linux/module.h>
 #include <linux/types.h>
+#include <linux/hardirq.h>
 #include <linux/kernel.h>
 #include <linux/signal.h>
 #include <linux/sched.h>
 #include <linux/init.h>
 
 #include <asm/cputype.h>
+#include <asm/neon.h>
 #include <asm/thread_notify.h>
 #include <asm/vfp.h>
 
@@ -484,6 +486,49 @@ void vfp_flush_hwstate(struct thread_info *thread)
 	put_cpu();
 }
 
+#ifdef CONFIG_NEON
+/*
+ * Kernel mode NEON is only allowed outside of interrupt context with
+ * preemption disabled, so its register contents never need preserving:
+ * only the user state that may be live in the hardware is saved, and
+ * last_VFP_context[] is cleared so that it gets reloaded on next use.
+ */
+void kernel_neon_begin(void)
+{
+	struct thread_info *thread = current_thread_info();
+	unsigned int cpu;
+	u32 fpexc;
+
+	BUG_ON(in_interrupt());
+	cpu = get_cpu();
+
+	fpexc = fmrx(FPEXC) | FPEXC_EN;
+	fmxr(FPEXC, fpexc);
+
+	/*
+	 * Under UP the lazily switched owner of the hardware state may be
+	 * a task other than current.  Under SMP it is always saved on a
+	 * context switch, so only current can have live state.
+	 */
+	if (last_VFP_context[cpu] == &thread->vfpstate)
+		vfp_save_state(&thread->vfpstate, fpexc);
+#ifndef CONFIG_SMP
+	else if (last_VFP_context[cpu])
+		vfp_save_state(last_VFP_context[cpu], fpexc);
+#endif
+	last_VFP_context[cpu] = NULL;
+}
+EXPORT_SYMBOL(kernel_neon_begin);
+
+void kernel_neon_end(void)
+{
+	/* Disable the unit so that the next user access reloads its state. */
+	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
+	put_cpu();
+}
+EXPORT_SYMBOL(kernel_neon_end);
+#endif
+
 #include <linux/smp.h>
 
 /*
@@ -557,6 +602,10 @@ static int __init vfp_init(void)
 			if ((fmrx(MVFR1) & 0x000fff00) == 0x00011100)
 				elf_hwcap |= HWCAP_NEON;
 		}
+#ifdef CONFIG_NEON_COPY
+		if (elf_hwcap & HWCAP_NEON)
+			neon_copy_enable();
+#endif
 #endif
 	}
 	return 0;
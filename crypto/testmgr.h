@@ -443,7 +443,7 @@ static struct hash_testvec rmd320_tv_template[] = {
 /*
  * SHA1 test vectors  from from FIPS PUB 180-1
  */
-#define SHA1_TEST_VECTORS	2
+#define SHA1_TEST_VECTORS	3
 
 static struct hash_testvec sha1_tv_template[] = {
 	{
@@ -458,6 +458,15 @@ static struct hash_testvec sha1_tv_template[] = {
 			  "\x4a\xa1\xf9\x51\x29\xe5\xe5\x46\x70\xf1",
 		.np	= 2,
 		.tap	= { 28, 28 }
+	}, {
+		.plaintext =
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+		"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+		"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+		.psize	= 224,
+		.digest	= "\x0c\x35\xf0\x42\xb1\x3b\xa2\xaa\xb1\xf6"
+			  "\xf0\x1c\x63\x80\x54\x09\x01\x7f\x41\x1a",
 	}
 };
 
@@ -465,7 +474,7 @@ static struct hash_testvec sha1_tv_template[] = {
 /*
  * SHA224 test vectors from from FIPS PUB 180-2
  */
-#define SHA224_TEST_VECTORS     2
+#define SHA224_TEST_VECTORS     3
 
 static struct hash_testvec sha224_tv_template[] = {
 	{
@@ -485,13 +494,24 @@ static struct hash_testvec sha224_tv_template[] = {
 			  "\x52\x52\x25\x25",
 		.np     = 2,
 		.tap    = { 28, 28 }
+	}, {
+		.plaintext =
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+		"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+		"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+		.psize	= 224,
+		.digest	= "\x8B\x18\xF9\x5E\xC5\x3E\x99\x3F"
+			  "\xF6\x37\xC8\xC4\xE0\x68\x75\xEA"
+			  "\x7B\xED\x04\x2F\x84\x17\x41\xEA"
+			  "\xCB\x26\x7C\x9F",
 	}
 };
 
 /*
  * SHA256 test vectors from from NIST
  */
-#define SHA256_TEST_VECTORS	2
+#define SHA256_TEST_VECTORS	3
 
 static struct hash_testvec sha256_tv_template[] = {
 	{
@@ -510,6 +530,17 @@ static struct hash_testvec sha256_tv_template[] = {
 			  "\xf6\xec\xed\xd4\x19\xdb\x06\xc1",
 		.np	= 2,
 		.tap	= { 28, 28 }
+	}, {
+		.plaintext =
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+		"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+		"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+		.psize	= 224,
+		.digest	= "\xcd\xbf\x86\x7f\x78\x4a\x69\xc7"
+			  "\xd2\xe2\x52\xba\xa9\x07\x5c\x37"
+			  "\x62\x84\x3b\x1b\xeb\x52\xc0\x4d"
+			  "\x4b\xe3\x9e\x77\x77\xd9\x57\x17",
 	},
 };
 
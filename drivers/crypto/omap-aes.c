@@ -28,6 +28,8 @@
 #include <linux/interrupt.h>
 #include <crypto/scatterwalk.h>
 #include <crypto/aes.h>
+#include <crypto/b128ops.h>
+#include <asm/unaligned.h>
 
 #include <plat/cpu.h>
 #include <plat/dma.h>
@@ -69,16 +71,18 @@
 
 #define DEFAULT_TIMEOUT		(5*HZ)
 
-#define FLAGS_MODE_MASK		0x000f
+#define FLAGS_MODE_MASK		0x001f
 #define FLAGS_ENCRYPT		BIT(0)
 #define FLAGS_CBC		BIT(1)
 #define FLAGS_GIV		BIT(2)
+#define FLAGS_CTR		BIT(3)
+#define FLAGS_XTS		BIT(4)
 
-#define FLAGS_NEW_KEY		BIT(4)
-#define FLAGS_NEW_IV		BIT(5)
-#define FLAGS_INIT		BIT(6)
-#define FLAGS_FAST		BIT(7)
-#define FLAGS_BUSY		8
+#define FLAGS_NEW_KEY		BIT(5)
+#define FLAGS_NEW_IV		BIT(6)
+#define FLAGS_INIT		BIT(7)
+#define FLAGS_FAST		BIT(8)
+#define FLAGS_BUSY		9
 
 struct omap_aes_ctx {
 	struct omap_aes_dev *dd;
@@ -86,15 +90,27 @@ struct omap_aes_ctx {
 	int		keylen;
 	u32		key[AES_KEYSIZE_256 / sizeof(u32)];
 	unsigned long	flags;
+
+	struct crypto_blkcipher	*fallback;
+	struct crypto_cipher	*tweak;		/* xts: second key */
 };
 
 struct omap_aes_reqctx {
 	unsigned long mode;
 };
 
-#define OMAP_AES_QUEUE_LENGTH	1
+#define OMAP_AES_QUEUE_LENGTH	32
 #define OMAP_AES_CACHE_SIZE	0
 
+/*
+ * Requests shorter than this are done on the CPU: below it the DMA and
+ * interrupt round trip costs more than aes-generic takes for the data.
+ */
+static unsigned int fallback_size = 256;
+module_param(fallback_size, uint, 0644);
+MODULE_PARM_DESC(fallback_size,
+		 "requests below this many bytes use the software cipher");
+
 struct omap_aes_dev {
 	struct list_head	list;
 	unsigned long		phys_base;
@@ -106,6 +122,7 @@ struct omap_aes_dev {
 
 	u32			*iv;
 	u32			ctrl;
+	be128			tweak;
 
 	spinlock_t			lock;
 	struct crypto_queue		queue;
@@ -216,6 +233,12 @@ static void omap_aes_write_ctrl(struct omap_aes_dev *dd)
 	val = FLD_VAL(((dd->ctx->keylen >> 3) - 1), 4, 3);
 	if (dd->flags & FLAGS_CBC)
 		val |= AES_REG_CTRL_CBC;
+	/*
+	 * The counter is left at its narrowest width; requests that would
+	 * carry out of the low word are handed to the fallback instead.
+	 */
+	if (dd->flags & FLAGS_CTR)
+		val |= AES_REG_CTRL_CTR;
 	if (dd->flags & FLAGS_ENCRYPT)
 		val |= AES_REG_CTRL_DIRECTION;
 
@@ -252,8 +275,8 @@ static void omap_aes_write_ctrl(struct omap_aes_dev *dd)
 		dd->flags &= ~FLAGS_NEW_IV;
 	}
 
-	mask = AES_REG_CTRL_CBC | AES_REG_CTRL_DIRECTION |
-			AES_REG_CTRL_KEY_SIZE;
+	mask = AES_REG_CTRL_CBC | AES_REG_CTRL_CTR | AES_REG_CTRL_CTR_WIDTH |
+			AES_REG_CTRL_DIRECTION | AES_REG_CTRL_KEY_SIZE;
 
 	omap_aes_write_mask(dd, AES_REG_CTRL, dd->ctrl, mask);
 
@@ -425,6 +448,36 @@ static int sg_copy(struct scatterlist **sg, size_t *offset, void *buf,
 	return off;
 }
 
+/* multiplies the tweak by alpha, as gf128mul_x_ble() does */
+static inline void omap_aes_xts_next(be128 *t)
+{
+	u64 a = le64_to_cpu(t->a);
+	u64 b = le64_to_cpu(t->b);
+
+	t->a = cpu_to_le64((a << 1) ^ ((b >> 63) ? 0x87 : 0));
+	t->b = cpu_to_le64((b << 1) | (a >> 63));
+}
+
+/*
+ * XTS runs the engine in ECB mode on data whitened with the tweak on
+ * both sides; each block's tweak is the previous one times alpha.
+ * The output pass moves the tweak on to the next chunk.
+ */
+static void omap_aes_xts_xor(struct omap_aes_dev *dd, void *buf,
+			     size_t length, int out)
+{
+	be128 t = dd->tweak, *b = buf;
+	size_t n;
+
+	for (n = length / AES_BLOCK_SIZE; n; n--, b++) {
+		be128_xor(b, b, &t);
+		omap_aes_xts_next(&t);
+	}
+
+	if (out)
+		dd->tweak = t;
+}
+
 static int omap_aes_crypt_dma(struct crypto_tfm *tfm, dma_addr_t dma_addr_in,
 			       dma_addr_t dma_addr_out, int length)
 {
@@ -436,6 +489,9 @@ static int omap_aes_crypt_dma(struct crypto_tfm *tfm, dma_addr_t dma_addr_in,
 
 	dd->dma_size = length;
 
+	/* a partial last CTR block is padded out in the buffer */
+	length = ALIGN(length, AES_BLOCK_SIZE);
+
 	if (!(dd->flags & FLAGS_FAST))
 		dma_sync_single_for_device(dd->dev, dma_addr_in, length,
 					   DMA_TO_DEVICE);
@@ -476,7 +532,9 @@ static int omap_aes_crypt_dma_start(struct omap_aes_dev *dd)
 
 	pr_debug("total: %d\n", dd->total);
 
-	if (sg_is_last(dd->in_sg) && sg_is_last(dd->out_sg)) {
+	if (sg_is_last(dd->in_sg) && sg_is_last(dd->out_sg) &&
+	    IS_ALIGNED(dd->total, AES_BLOCK_SIZE) &&
+	    !(dd->flags & FLAGS_XTS)) {
 		/* check for alignment */
 		in = IS_ALIGNED((u32)dd->in_sg->offset, sizeof(u32));
 		out = IS_ALIGNED((u32)dd->out_sg->offset, sizeof(u32));
@@ -515,6 +573,8 @@ static int omap_aes_crypt_dma_start(struct omap_aes_dev *dd)
 		/* use cache buffers */
 		count = sg_copy(&dd->in_sg, &dd->in_offset, dd->buf_in,
 				 dd->buflen, dd->total, 0);
+		if (dd->flags & FLAGS_XTS)
+			omap_aes_xts_xor(dd, dd->buf_in, count, 0);
 
 		addr_in = dd->dma_addr_in;
 		addr_out = dd->dma_addr_out;
@@ -525,13 +585,24 @@ static int omap_aes_crypt_dma_start(struct omap_aes_dev *dd)
 
 	dd->total -= count;
 
-	err = omap_aes_hw_init(dd);
-
 	err = omap_aes_crypt_dma(tfm, addr_in, addr_out, count);
 
 	return err;
 }
 
+/* moves the counter block on past the blocks of a request */
+static void omap_aes_ctr_add(u8 *iv, unsigned int n)
+{
+	int i;
+	u32 c;
+
+	for (i = AES_BLOCK_SIZE - sizeof(u32); i >= 0 && n; i -= sizeof(u32)) {
+		c = get_unaligned_be32(iv + i);
+		put_unaligned_be32(c + n, iv + i);
+		n = c + n < c;
+	}
+}
+
 static void omap_aes_finish_req(struct omap_aes_dev *dd, int err)
 {
 	struct omap_aes_ctx *ctx;
@@ -540,6 +611,10 @@ static void omap_aes_finish_req(struct omap_aes_dev *dd, int err)
 
 	ctx = crypto_ablkcipher_ctx(crypto_ablkcipher_reqtfm(dd->req));
 
+	if (!err && (dd->flags & FLAGS_CTR))
+		omap_aes_ctr_add(dd->req->info,
+				 DIV_ROUND_UP(dd->req->nbytes, AES_BLOCK_SIZE));
+
 	if (!dd->total)
 		dd->req->base.complete(&dd->req->base, err);
 }
@@ -553,8 +628,6 @@ static int omap_aes_crypt_dma_stop(struct omap_aes_dev *dd)
 
 	omap_aes_write_mask(dd, AES_REG_MASK, 0, AES_REG_MASK_START);
 
-	omap_aes_hw_cleanup(dd);
-
 	omap_stop_dma(dd->dma_lch_in);
 	omap_stop_dma(dd->dma_lch_out);
 
@@ -564,6 +637,8 @@ static int omap_aes_crypt_dma_stop(struct omap_aes_dev *dd)
 	} else {
 		dma_sync_single_for_device(dd->dev, dd->dma_addr_out,
 					   dd->dma_size, DMA_FROM_DEVICE);
+		if (dd->flags & FLAGS_XTS)
+			omap_aes_xts_xor(dd, dd->buf_out, dd->dma_size, 1);
 
 		/* copy data */
 		count = sg_copy(&dd->out_sg, &dd->out_offset, dd->buf_out,
@@ -598,8 +673,11 @@ static int omap_aes_handle_req(struct omap_aes_dev *dd)
 		clear_bit(FLAGS_BUSY, &dd->flags);
 	spin_unlock_irqrestore(&dd->lock, flags);
 
-	if (!async_req)
+	if (!async_req) {
+		/* queue drained: let the engine idle */
+		omap_aes_hw_cleanup(dd);
 		return 0;
+	}
 
 	if (backlog)
 		backlog->complete(backlog, -EINPROGRESS);
@@ -622,11 +700,15 @@ static int omap_aes_handle_req(struct omap_aes_dev *dd)
 	dd->flags = (dd->flags & ~FLAGS_MODE_MASK) | rctx->mode;
 
 	dd->iv = req->info;
-	if ((dd->flags & FLAGS_CBC) && dd->iv)
+	if ((dd->flags & (FLAGS_CBC | FLAGS_CTR)) && dd->iv)
 		dd->flags |= FLAGS_NEW_IV;
 	else
 		dd->flags &= ~FLAGS_NEW_IV;
 
+	if (dd->flags & FLAGS_XTS)
+		crypto_cipher_encrypt_one(ctx->tweak, (u8 *)&dd->tweak,
+					  req->info);
+
 	ctx->dd = dd;
 	if (dd->ctx != ctx) {
 		/* assign new context to device */
@@ -634,7 +716,8 @@ static int omap_aes_handle_req(struct omap_aes_dev *dd)
 		ctx->flags |= FLAGS_NEW_KEY;
 	}
 
-	if (!IS_ALIGNED(req->nbytes, AES_BLOCK_SIZE))
+	if (!(dd->flags & FLAGS_CTR) &&
+	    !IS_ALIGNED(req->nbytes, AES_BLOCK_SIZE))
 		pr_err("request size is not exact amount of AES blocks\n");
 
 start:
@@ -655,6 +738,34 @@ static void omap_aes_task(unsigned long data)
 	pr_debug("exit\n");
 }
 
+static int omap_aes_crypt_fallback(struct ablkcipher_request *req,
+				   unsigned long mode)
+{
+	struct omap_aes_ctx *ctx = crypto_ablkcipher_ctx(
+			crypto_ablkcipher_reqtfm(req));
+	struct blkcipher_desc desc;
+
+	desc.tfm = ctx->fallback;
+	desc.info = req->info;
+	desc.flags = req->base.flags;
+
+	if (mode & FLAGS_ENCRYPT)
+		return crypto_blkcipher_encrypt_iv(&desc, req->dst, req->src,
+						   req->nbytes);
+
+	return crypto_blkcipher_decrypt_iv(&desc, req->dst, req->src,
+					   req->nbytes);
+}
+
+/* would the low 32 bits of the counter wrap within the request? */
+static int omap_aes_ctr_wraps(struct ablkcipher_request *req)
+{
+	u32 ctr = get_unaligned_be32((u8 *)req->info + AES_BLOCK_SIZE - 4);
+
+	return (u64)ctr + DIV_ROUND_UP(req->nbytes, AES_BLOCK_SIZE) - 1 >
+		0xffffffffULL;
+}
+
 static int omap_aes_crypt(struct ablkcipher_request *req, unsigned long mode)
 {
 	struct omap_aes_ctx *ctx = crypto_ablkcipher_ctx(
@@ -668,6 +779,10 @@ static int omap_aes_crypt(struct ablkcipher_request *req, unsigned long mode)
 		  !!(mode & FLAGS_ENCRYPT),
 		  !!(mode & FLAGS_CBC));
 
+	if (req->nbytes < fallback_size ||
+	    ((mode & FLAGS_CTR) && omap_aes_ctr_wraps(req)))
+		return omap_aes_crypt_fallback(req, mode);
+
 	dd = omap_aes_find_dev(ctx);
 	if (!dd)
 		return -ENODEV;
@@ -678,8 +793,14 @@ static int omap_aes_crypt(struct ablkcipher_request *req, unsigned long mode)
 	err = ablkcipher_enqueue_request(&dd->queue, req);
 	spin_unlock_irqrestore(&dd->lock, flags);
 
-	if (!test_and_set_bit(FLAGS_BUSY, &dd->flags))
+	if (!test_and_set_bit(FLAGS_BUSY, &dd->flags)) {
+		/*
+		 * The engine stays clocked, and the tasklet feeds it queued
+		 * requests back to back, until the queue drains.
+		 */
+		omap_aes_hw_init(dd);
 		omap_aes_handle_req(dd);
+	}
 
 	pr_debug("exit\n");
 
@@ -688,11 +809,9 @@ static int omap_aes_crypt(struct ablkcipher_request *req, unsigned long mode)
 
 /* ********************** ALG API ************************************ */
 
-static int omap_aes_setkey(struct crypto_ablkcipher *tfm, const u8 *key,
-			   unsigned int keylen)
+static int omap_aes_set_hw_key(struct omap_aes_ctx *ctx, const u8 *key,
+			       unsigned int keylen)
 {
-	struct omap_aes_ctx *ctx = crypto_ablkcipher_ctx(tfm);
-
 	if (keylen != AES_KEYSIZE_128 && keylen != AES_KEYSIZE_192 &&
 		   keylen != AES_KEYSIZE_256)
 		return -EINVAL;
@@ -706,6 +825,48 @@ static int omap_aes_setkey(struct crypto_ablkcipher *tfm, const u8 *key,
 	return 0;
 }
 
+static int omap_aes_set_fallback_key(struct crypto_ablkcipher *tfm,
+				     const u8 *key, unsigned int keylen)
+{
+	struct omap_aes_ctx *ctx = crypto_ablkcipher_ctx(tfm);
+	int err;
+
+	crypto_blkcipher_clear_flags(ctx->fallback, CRYPTO_TFM_REQ_MASK);
+	crypto_blkcipher_set_flags(ctx->fallback,
+			crypto_ablkcipher_get_flags(tfm) & CRYPTO_TFM_REQ_MASK);
+
+	err = crypto_blkcipher_setkey(ctx->fallback, key, keylen);
+
+	crypto_ablkcipher_set_flags(tfm, CRYPTO_TFM_RES_MASK &
+			crypto_blkcipher_get_flags(ctx->fallback));
+
+	return err;
+}
+
+static int omap_aes_setkey(struct crypto_ablkcipher *tfm, const u8 *key,
+			   unsigned int keylen)
+{
+	struct omap_aes_ctx *ctx = crypto_ablkcipher_ctx(tfm);
+
+	return omap_aes_set_hw_key(ctx, key, keylen) ?:
+	       omap_aes_set_fallback_key(tfm, key, keylen);
+}
+
+/* the first half of the key is the data key, the second the tweak key */
+static int omap_aes_xts_setkey(struct crypto_ablkcipher *tfm, const u8 *key,
+			       unsigned int keylen)
+{
+	struct omap_aes_ctx *ctx = crypto_ablkcipher_ctx(tfm);
+	unsigned int half = keylen / 2;
+
+	if (keylen % 2)
+		return -EINVAL;
+
+	return omap_aes_set_hw_key(ctx, key, half) ?:
+	       crypto_cipher_setkey(ctx->tweak, key + half, half) ?:
+	       omap_aes_set_fallback_key(tfm, key, keylen);
+}
+
 static int omap_aes_ecb_encrypt(struct ablkcipher_request *req)
 {
 	return omap_aes_crypt(req, FLAGS_ENCRYPT);
@@ -726,18 +887,70 @@ static int omap_aes_cbc_decrypt(struct ablkcipher_request *req)
 	return omap_aes_crypt(req, FLAGS_CBC);
 }
 
+/* CTR decryption is the same keystream XOR as encryption */
+static int omap_aes_ctr_crypt(struct ablkcipher_request *req)
+{
+	return omap_aes_crypt(req, FLAGS_ENCRYPT | FLAGS_CTR);
+}
+
+static int omap_aes_xts_encrypt(struct ablkcipher_request *req)
+{
+	return omap_aes_crypt(req, FLAGS_ENCRYPT | FLAGS_XTS);
+}
+
+static int omap_aes_xts_decrypt(struct ablkcipher_request *req)
+{
+	return omap_aes_crypt(req, FLAGS_XTS);
+}
+
 static int omap_aes_cra_init(struct crypto_tfm *tfm)
 {
+	struct omap_aes_ctx *ctx = crypto_tfm_ctx(tfm);
+	const char *name = crypto_tfm_alg_name(tfm);
+
 	pr_debug("enter\n");
 
+	ctx->fallback = crypto_alloc_blkcipher(name, 0,
+				CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK);
+	if (IS_ERR(ctx->fallback)) {
+		pr_err("unable to allocate fallback %s\n", name);
+		return PTR_ERR(ctx->fallback);
+	}
+
 	tfm->crt_ablkcipher.reqsize = sizeof(struct omap_aes_reqctx);
 
 	return 0;
 }
 
+static int omap_aes_xts_cra_init(struct crypto_tfm *tfm)
+{
+	struct omap_aes_ctx *ctx = crypto_tfm_ctx(tfm);
+	int err;
+
+	err = omap_aes_cra_init(tfm);
+	if (err)
+		return err;
+
+	ctx->tweak = crypto_alloc_cipher("aes", 0,
+				CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK);
+	if (IS_ERR(ctx->tweak)) {
+		pr_err("unable to allocate tweak cipher\n");
+		crypto_free_blkcipher(ctx->fallback);
+		return PTR_ERR(ctx->tweak);
+	}
+
+	return 0;
+}
+
 static void omap_aes_cra_exit(struct crypto_tfm *tfm)
 {
+	struct omap_aes_ctx *ctx = crypto_tfm_ctx(tfm);
+
 	pr_debug("enter\n");
+
+	if (ctx->tweak)
+		crypto_free_cipher(ctx->tweak);
+	crypto_free_blkcipher(ctx->fallback);
 }
 
 /* ********************** ALGS ************************************ */
@@ -747,7 +960,8 @@ static struct crypto_alg algs[] = {
 	.cra_name		= "ecb(aes)",
 	.cra_driver_name	= "ecb-aes-omap",
 	.cra_priority		= 100,
-	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER | CRYPTO_ALG_ASYNC,
+	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER |
+				  CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK,
 	.cra_blocksize		= AES_BLOCK_SIZE,
 	.cra_ctxsize		= sizeof(struct omap_aes_ctx),
 	.cra_alignmask	 	= 0,
@@ -767,7 +981,8 @@ static struct crypto_alg algs[] = {
 	.cra_name		= "cbc(aes)",
 	.cra_driver_name	= "cbc-aes-omap",
 	.cra_priority		= 100,
-	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER | CRYPTO_ALG_ASYNC,
+	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER |
+				  CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK,
 	.cra_blocksize		= AES_BLOCK_SIZE,
 	.cra_ctxsize		= sizeof(struct omap_aes_ctx),
 	.cra_alignmask	 	= 0,
@@ -783,6 +998,50 @@ static struct crypto_alg algs[] = {
 		.encrypt	= omap_aes_cbc_encrypt,
 		.decrypt	= omap_aes_cbc_decrypt,
 	}
+},
+{
+	.cra_name		= "ctr(aes)",
+	.cra_driver_name	= "ctr-aes-omap",
+	.cra_priority		= 100,
+	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER |
+				  CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct omap_aes_ctx),
+	.cra_alignmask	 	= 0,
+	.cra_type		= &crypto_ablkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= omap_aes_cra_init,
+	.cra_exit		= omap_aes_cra_exit,
+	.cra_u.ablkcipher = {
+		.min_keysize	= AES_MIN_KEY_SIZE,
+		.max_keysize	= AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.setkey		= omap_aes_setkey,
+		.encrypt	= omap_aes_ctr_crypt,
+		.decrypt	= omap_aes_ctr_crypt,
+	}
+},
+{
+	.cra_name		= "xts(aes)",
+	.cra_driver_name	= "xts-aes-omap",
+	.cra_priority		= 100,
+	.cra_flags		= CRYPTO_ALG_TYPE_ABLKCIPHER |
+				  CRYPTO_ALG_ASYNC | CRYPTO_ALG_NEED_FALLBACK,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct omap_aes_ctx),
+	.cra_alignmask	 	= 0,
+	.cra_type		= &crypto_ablkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_init		= omap_aes_xts_cra_init,
+	.cra_exit		= omap_aes_cra_exit,
+	.cra_u.ablkcipher = {
+		.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+		.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+		.ivsize		= AES_BLOCK_SIZE,
+		.setkey		= omap_aes_xts_setkey,
+		.encrypt	= omap_aes_xts_encrypt,
+		.decrypt	= omap_aes_xts_decrypt,
+	}
 }
 };
 
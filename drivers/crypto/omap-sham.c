@@ -72,10 +72,9 @@
 
 #define DEFAULT_TIMEOUT_INTERVAL	HZ
 
-#define FLAGS_FIRST		0x0001
 #define FLAGS_FINUP		0x0002
 #define FLAGS_FINAL		0x0004
-#define FLAGS_FAST		0x0008
+#define FLAGS_SG		0x0008
 #define FLAGS_SHA1		0x0010
 #define FLAGS_DMA_ACTIVE	0x0020
 #define FLAGS_OUTPUT_READY	0x0040
@@ -86,6 +85,7 @@
 
 /* 3rd byte */
 #define FLAGS_BUSY		16
+#define FLAGS_DMA_READY		17
 
 #define OP_UPDATE	1
 #define OP_FINAL	2
@@ -107,6 +107,7 @@ struct omap_sham_reqctx {
 	struct scatterlist	*sg;
 	unsigned int		offset;	/* offset in current sg */
 	unsigned int		total;	/* total request */
+	int			nents;	/* mapped entries of req->src */
 };
 
 struct omap_sham_hmac_ctx {
@@ -126,7 +127,7 @@ struct omap_sham_ctx {
 	struct omap_sham_hmac_ctx base[0];
 };
 
-#define OMAP_SHAM_QUEUE_LENGTH	1
+#define OMAP_SHAM_QUEUE_LENGTH	10
 
 struct omap_sham_dev {
 	struct list_head	list;
@@ -144,6 +145,7 @@ struct omap_sham_dev {
 	unsigned long		flags;
 	struct crypto_queue	queue;
 	struct ahash_request	*req;
+	struct ahash_request	*next_req;
 };
 
 struct omap_sham_drv {
@@ -327,6 +329,7 @@ static int omap_sham_xmit_dma(struct omap_sham_dev *dd, dma_addr_t dma_addr,
 		ctx->flags |= FLAGS_FINAL; /* catch last interrupt */
 
 	dd->flags |= FLAGS_DMA_ACTIVE;
+	clear_bit(FLAGS_DMA_READY, &dd->flags);
 
 	omap_start_dma(dd->dma_lch);
 
@@ -334,9 +337,9 @@ static int omap_sham_xmit_dma(struct omap_sham_dev *dd, dma_addr_t dma_addr,
 }
 
 static size_t omap_sham_append_buffer(struct omap_sham_reqctx *ctx,
-				const u8 *data, size_t length)
+				const u8 *data, size_t length, size_t limit)
 {
-	size_t count = min(length, ctx->buflen - ctx->bufcnt);
+	size_t count = min(length, limit - ctx->bufcnt);
 
 	count = min(count, ctx->total);
 	if (count <= 0)
@@ -347,14 +350,14 @@ static size_t omap_sham_append_buffer(struct omap_sham_reqctx *ctx,
 	return count;
 }
 
-static size_t omap_sham_append_sg(struct omap_sham_reqctx *ctx)
+static size_t omap_sham_append_sg(struct omap_sham_reqctx *ctx, size_t limit)
 {
 	size_t count;
 
 	while (ctx->sg) {
 		count = omap_sham_append_buffer(ctx,
 				sg_virt(ctx->sg) + ctx->offset,
-				ctx->sg->length - ctx->offset);
+				ctx->sg->length - ctx->offset, limit);
 		if (!count)
 			break;
 		ctx->offset += count;
@@ -371,23 +374,106 @@ static size_t omap_sham_append_sg(struct omap_sham_reqctx *ctx)
 	return 0;
 }
 
-static int omap_sham_update_dma_slow(struct omap_sham_dev *dd)
+/*
+ * Number of bytes which can be DMA'd straight from the scatterlist,
+ * starting @skip bytes past the walk position, or 0 if the data there
+ * has to go through the buffer. Only the last chunk of a finup() may
+ * be a partial block.
+ */
+static size_t omap_sham_sg_len(struct omap_sham_reqctx *ctx, size_t skip)
+{
+	struct scatterlist *sg = ctx->sg;
+	size_t offset = ctx->offset + skip;
+	size_t total, length;
+
+	if (!(ctx->flags & FLAGS_SG) || skip >= ctx->total)
+		return 0;
+
+	total = ctx->total - skip;
+	while (offset >= sg->length) {
+		offset -= sg->length;
+		sg = sg_next(sg);
+	}
+
+	if (!IS_ALIGNED(sg_dma_address(sg) + offset, sizeof(u32)))
+		return 0;
+
+	length = min_t(size_t, sg->length - offset, total);
+	if (length < total || !(ctx->flags & FLAGS_FINUP))
+		length = round_down(length, SHA1_MD5_BLOCK_SIZE);
+
+	return length;
+}
+
+/*
+ * How far to fill the buffer: just up to the block boundary after
+ * which the list can be DMA'd in place again, either right away or
+ * past the current entry, or a whole buffer if there is none.
+ */
+static size_t omap_sham_bounce_limit(struct omap_sham_reqctx *ctx)
+{
+	size_t rest = min_t(size_t, ctx->sg->length - ctx->offset, ctx->total);
+	size_t fill[2];
+	int i;
+
+	fill[0] = ALIGN(ctx->bufcnt, SHA1_MD5_BLOCK_SIZE);
+	fill[1] = ALIGN(ctx->bufcnt + rest, SHA1_MD5_BLOCK_SIZE);
+
+	for (i = 0; i < ARRAY_SIZE(fill); i++)
+		if (fill[i] && fill[i] <= ctx->buflen &&
+		    omap_sham_sg_len(ctx, fill[i] - ctx->bufcnt))
+			return fill[i];
+
+	return ctx->buflen;
+}
+
+static int omap_sham_xmit_sg(struct omap_sham_dev *dd, size_t length)
 {
 	struct omap_sham_reqctx *ctx = ahash_request_ctx(dd->req);
+	dma_addr_t dma_addr = sg_dma_address(ctx->sg) + ctx->offset;
 	unsigned int final;
-	size_t count;
+
+	final = (ctx->flags & FLAGS_FINUP) && length == ctx->total;
+
+	ctx->offset += length;
+	ctx->total -= length;
+	if (ctx->offset == ctx->sg->length) {
+		ctx->sg = sg_next(ctx->sg);
+		ctx->offset = 0;
+	}
+
+	return omap_sham_xmit_dma(dd, dma_addr, length, final);
+}
+
+/*
+ * Sends the next chunk of the request. Whatever is aligned goes out
+ * in place from the mapped scatterlist; only the odd bytes around
+ * unaligned or short entries are copied into the buffer.
+ */
+static int omap_sham_update_dma(struct omap_sham_dev *dd)
+{
+	struct omap_sham_reqctx *ctx = ahash_request_ctx(dd->req);
+	unsigned int final;
+	size_t count, limit;
 
 	if (!ctx->total)
 		return 0;
 
-	omap_sham_append_sg(ctx);
+	if (!ctx->bufcnt) {
+		count = omap_sham_sg_len(ctx, 0);
+		if (count)
+			return omap_sham_xmit_sg(dd, count);
+	}
+
+	limit = omap_sham_bounce_limit(ctx);
+	omap_sham_append_sg(ctx, limit);
 
 	final = (ctx->flags & FLAGS_FINUP) && !ctx->total;
 
 	dev_dbg(dd->dev, "slow: bufcnt: %u, digcnt: %d, final: %d\n",
 					 ctx->bufcnt, ctx->digcnt, final);
 
-	if (final || (ctx->bufcnt == ctx->buflen && ctx->total)) {
+	if (final || (ctx->bufcnt == limit && ctx->total)) {
 		count = ctx->bufcnt;
 		ctx->bufcnt = 0;
 		return omap_sham_xmit_dma(dd, ctx->dma_addr, count, final);
@@ -396,49 +482,18 @@ static int omap_sham_update_dma_slow(struct omap_sham_dev *dd)
 	return 0;
 }
 
-static int omap_sham_update_dma_fast(struct omap_sham_dev *dd)
-{
-	struct omap_sham_reqctx *ctx = ahash_request_ctx(dd->req);
-	unsigned int length;
-
-	ctx->flags |= FLAGS_FAST;
-
-	length = min(ctx->total, sg_dma_len(ctx->sg));
-	ctx->total = length;
-
-	if (!dma_map_sg(dd->dev, ctx->sg, 1, DMA_TO_DEVICE)) {
-		dev_err(dd->dev, "dma_map_sg  error\n");
-		return -EINVAL;
-	}
-
-	ctx->total -= length;
-
-	return omap_sham_xmit_dma(dd, sg_dma_address(ctx->sg), length, 1);
-}
-
 static int omap_sham_update_cpu(struct omap_sham_dev *dd)
 {
 	struct omap_sham_reqctx *ctx = ahash_request_ctx(dd->req);
 	int bufcnt;
 
-	omap_sham_append_sg(ctx);
+	omap_sham_append_sg(ctx, ctx->buflen);
 	bufcnt = ctx->bufcnt;
 	ctx->bufcnt = 0;
 
 	return omap_sham_xmit_cpu(dd, ctx->buffer, bufcnt, 1);
 }
 
-static int omap_sham_update_dma_stop(struct omap_sham_dev *dd)
-{
-	struct omap_sham_reqctx *ctx = ahash_request_ctx(dd->req);
-
-	omap_stop_dma(dd->dma_lch);
-	if (ctx->flags & FLAGS_FAST)
-		dma_unmap_sg(dd->dev, ctx->sg, 1, DMA_TO_DEVICE);
-
-	return 0;
-}
-
 static void omap_sham_cleanup(struct ahash_request *req)
 {
 	struct omap_sham_reqctx *ctx = ahash_request_ctx(req);
@@ -489,8 +544,6 @@ static int omap_sham_init(struct ahash_request *req)
 
 	ctx->flags = 0;
 
-	ctx->flags |= FLAGS_FIRST;
-
 	dev_dbg(dd->dev, "init: digest size: %d\n",
 		crypto_ahash_digestsize(tfm));
 
@@ -538,10 +591,8 @@ static int omap_sham_update_req(struct omap_sham_dev *dd)
 
 	if (ctx->flags & FLAGS_CPU)
 		err = omap_sham_update_cpu(dd);
-	else if (ctx->flags & FLAGS_FAST)
-		err = omap_sham_update_dma_fast(dd);
 	else
-		err = omap_sham_update_dma_slow(dd);
+		err = omap_sham_update_dma(dd);
 
 	/* wait for dma completion before can take more data */
 	dev_dbg(dd->dev, "update: err: %d, digcnt: %d\n", err, ctx->digcnt);
@@ -603,40 +654,107 @@ static void omap_sham_finish_req(struct ahash_request *req, int err)
 			err = omap_sham_finish_req_hmac(req);
 	}
 
+	if (ctx->flags & FLAGS_SG) {
+		ctx->flags &= ~FLAGS_SG;
+		dma_unmap_sg(ctx->dd->dev, req->src, ctx->nents,
+			     DMA_TO_DEVICE);
+	}
+
 	if (ctx->flags & FLAGS_FINAL)
 		omap_sham_cleanup(req);
 
+	smp_mb__before_clear_bit();
 	clear_bit(FLAGS_BUSY, &ctx->dd->flags);
 
 	if (req->base.complete)
 		req->base.complete(&req->base, err);
 }
 
-static int omap_sham_handle_queue(struct omap_sham_dev *dd)
+/*
+ * Maps the source list of a queued update for DMA, so that the cache
+ * maintenance for it is already done when the request gets the engine.
+ */
+static void omap_sham_prepare_req(struct omap_sham_dev *dd,
+				  struct ahash_request *req)
+{
+	struct omap_sham_reqctx *ctx = ahash_request_ctx(req);
+	struct scatterlist *sg;
+	unsigned int total;
+	int nents = 0, aligned = 0;
+
+	if (ctx->op != OP_UPDATE || (ctx->flags & FLAGS_CPU))
+		return;
+
+	for (sg = ctx->sg, total = ctx->total; sg && total;
+	     sg = sg_next(sg), nents++) {
+		aligned |= IS_ALIGNED(sg->offset, sizeof(u32));
+		total -= min(sg->length, total);
+	}
+
+	/* nothing to gain if all of it has to be bounced anyway */
+	if (!aligned)
+		return;
+
+	if (!dma_map_sg(dd->dev, ctx->sg, nents, DMA_TO_DEVICE)) {
+		dev_dbg(dd->dev, "dma_map_sg error, using buffer\n");
+		return;
+	}
+
+	ctx->nents = nents;
+	ctx->flags |= FLAGS_SG;
+}
+
+static struct ahash_request *omap_sham_dequeue(struct omap_sham_dev *dd,
+					       int idle)
 {
 	struct crypto_async_request *async_req, *backlog;
-	struct omap_sham_reqctx *ctx;
-	struct ahash_request *req, *prev_req;
+	struct ahash_request *req;
 	unsigned long flags;
-	int err = 0;
-
-	if (test_and_set_bit(FLAGS_BUSY, &dd->flags))
-		return 0;
 
 	spin_lock_irqsave(&dd->lock, flags);
 	backlog = crypto_get_backlog(&dd->queue);
 	async_req = crypto_dequeue_request(&dd->queue);
-	if (!async_req)
+	if (!async_req && idle)
 		clear_bit(FLAGS_BUSY, &dd->flags);
 	spin_unlock_irqrestore(&dd->lock, flags);
 
 	if (!async_req)
-		return 0;
+		return NULL;
 
 	if (backlog)
 		backlog->complete(backlog, -EINPROGRESS);
 
 	req = ahash_request_cast(async_req);
+	omap_sham_prepare_req(dd, req);
+
+	return req;
+}
+
+/*
+ * Called with the current request's DMA running: pull the next one
+ * off the queue and set it up meanwhile.
+ */
+static void omap_sham_prepare_next(struct omap_sham_dev *dd)
+{
+	if (!dd->next_req)
+		dd->next_req = omap_sham_dequeue(dd, 0);
+}
+
+static int omap_sham_handle_queue(struct omap_sham_dev *dd)
+{
+	struct omap_sham_reqctx *ctx;
+	struct ahash_request *req, *prev_req;
+	int err = 0;
+
+	if (test_and_set_bit(FLAGS_BUSY, &dd->flags))
+		return 0;
+
+	req = dd->next_req;
+	dd->next_req = NULL;
+	if (!req)
+		req = omap_sham_dequeue(dd, 1);
+	if (!req)
+		return 0;
 
 	prev_req = dd->req;
 	dd->req = req;
@@ -663,6 +781,8 @@ static int omap_sham_handle_queue(struct omap_sham_dev *dd)
 		/* done_task will not finish it, so do it here */
 		omap_sham_finish_req(req, err);
 		tasklet_schedule(&dd->queue_task);
+	} else {
+		omap_sham_prepare_next(dd);
 	}
 
 	dev_dbg(dd->dev, "exit, err: %d\n", err);
@@ -707,24 +827,14 @@ static int omap_sham_update(struct ahash_request *req)
 			* will switch to bypass in final()
 			* final has the same request and data
 			*/
-			omap_sham_append_sg(ctx);
+			omap_sham_append_sg(ctx, ctx->buflen);
 			return 0;
 		} else if (ctx->bufcnt + ctx->total <= 64) {
 			ctx->flags |= FLAGS_CPU;
-		} else if (!ctx->bufcnt && sg_is_last(ctx->sg)) {
-			/* may be can use faster functions */
-			int aligned = IS_ALIGNED((u32)ctx->sg->offset,
-								sizeof(u32));
-
-			if (aligned && (ctx->flags & FLAGS_FIRST))
-				/* digest: first and final */
-				ctx->flags |= FLAGS_FAST;
-
-			ctx->flags &= ~FLAGS_FIRST;
 		}
 	} else if (ctx->bufcnt + ctx->total <= ctx->buflen) {
 		/* if not finaup -> not fast */
-		omap_sham_append_sg(ctx);
+		omap_sham_append_sg(ctx, ctx->buflen);
 		return 0;
 	}
 
@@ -993,26 +1103,33 @@ static void omap_sham_done_task(unsigned long data)
 	struct omap_sham_dev *dd = (struct omap_sham_dev *)data;
 	struct ahash_request *req = dd->req;
 	struct omap_sham_reqctx *ctx = ahash_request_ctx(req);
-	int ready = 1;
-
-	if (ctx->flags & FLAGS_OUTPUT_READY) {
-		ctx->flags &= ~FLAGS_OUTPUT_READY;
-		ready = 1;
-	}
+	int err = 0;
 
+	/* both the DMA and the hash of the chunk have to be done */
 	if (dd->flags & FLAGS_DMA_ACTIVE) {
+		if (!test_and_clear_bit(FLAGS_DMA_READY, &dd->flags))
+			return;
 		dd->flags &= ~FLAGS_DMA_ACTIVE;
-		omap_sham_update_dma_stop(dd);
-		omap_sham_update_dma_slow(dd);
+		omap_stop_dma(dd->dma_lch);
 	}
 
-	if (ready && !(dd->flags & FLAGS_DMA_ACTIVE)) {
-		dev_dbg(dd->dev, "update done\n");
-		/* finish curent request */
-		omap_sham_finish_req(req, 0);
-		/* start new request */
-		omap_sham_handle_queue(dd);
+	if (!(ctx->flags & FLAGS_OUTPUT_READY))
+		return;
+	ctx->flags &= ~FLAGS_OUTPUT_READY;
+
+	if (ctx->op == OP_UPDATE && !(ctx->flags & (FLAGS_CPU | FLAGS_FINAL))) {
+		err = omap_sham_update_dma(dd);
+		if (err == -EINPROGRESS) {
+			omap_sham_prepare_next(dd);
+			return;
+		}
 	}
+
+	dev_dbg(dd->dev, "update done, err: %d\n", err);
+	/* finish curent request */
+	omap_sham_finish_req(req, err);
+	/* start new request */
+	omap_sham_handle_queue(dd);
 }
 
 static void omap_sham_queue_task(unsigned long data)
@@ -1050,8 +1167,10 @@ static void omap_sham_dma_callback(int lch, u16 ch_status, void *data)
 {
 	struct omap_sham_dev *dd = data;
 
-	if (likely(lch == dd->dma_lch))
+	if (likely(lch == dd->dma_lch)) {
+		set_bit(FLAGS_DMA_READY, &dd->flags);
 		tasklet_schedule(&dd->done_task);
+	}
 }
 
 static int omap_sham_dma_init(struct omap_sham_dev *dd)
@@ -0,0 +1,677 @@
+/*
+ * drivers/dma/omap-dma.c
+ *
+ * dmaengine driver for the OMAP system DMA controller (SDMA)
+ *
+ * Each dmaengine channel owns a small dynamic chain of SDMA logical
+ * channels.  Segments of the issued descriptors are loaded into the
+ * idle logical channels of the chain while the others run, and the
+ * hardware link starts each one as soon as its predecessor completes,
+ * so scatter-gather and cyclic transfers do not stall on a CPU restart
+ * between segments.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/interrupt.h>
+#include <linux/spinlock.h>
+#include <linux/device.h>
+#include <linux/dma-mapping.h>
+#include <linux/slab.h>
+#include <linux/platform_device.h>
+#include <linux/dmaengine.h>
+
+#include <plat/dma.h>
+
+#define OMAP_DMA_ENGINE_CHANNELS	8	/* dmaengine channels */
+#define OMAP_DMA_CHAIN_LCHS		2	/* logical channels per chain */
+#define OMAP_DMA_MAX_ELEMS		0xffffff
+#define OMAP_DMA_MAX_FRAMES		0xffff
+
+#define OMAP_DMA_ERR_IRQS	(OMAP2_DMA_TRANS_ERR_IRQ | \
+				 OMAP2_DMA_SECURE_ERR_IRQ | \
+				 OMAP2_DMA_MISALIGNED_ERR_IRQ)
+
+struct omap_dma_seg {
+	dma_addr_t src;
+	dma_addr_t dst;
+	u32 elem_count;
+	u32 frame_count;
+};
+
+struct omap_dma_desc {
+	struct dma_async_tx_descriptor txd;
+	struct list_head node;
+
+	/* chain parameters, addresses and counts live in the segments */
+	struct omap_dma_channel_params params;
+
+	bool cyclic;
+	bool error;
+	unsigned periods;	/* completed cyclic periods not reported yet */
+	unsigned queued;	/* segments handed to the chain */
+	unsigned done;		/* segments completed */
+	unsigned nsegs;
+	struct omap_dma_seg segs[0];
+};
+
+struct omap_dma_chan {
+	struct dma_chan chan;
+	spinlock_t lock;
+
+	int chain_id;
+	bool started;
+	bool params_valid;
+	struct omap_dma_channel_params params;	/* programmed in the chain */
+
+	int dma_request;
+	struct dma_slave_config cfg;
+
+	/* descriptors of the segments in the chain, oldest first */
+	struct omap_dma_desc *inflight[OMAP_DMA_CHAIN_LCHS];
+	unsigned inflight_head;
+	unsigned inflight_count;
+
+	struct list_head pending;	/* submitted */
+	struct list_head active;	/* issued, in order */
+	struct list_head complete;	/* callbacks not yet run */
+	dma_cookie_t completed_cookie;
+
+	struct tasklet_struct tasklet;
+};
+
+struct omap_dma_engine {
+	struct dma_device dma_device;
+	struct omap_dma_chan chan[OMAP_DMA_ENGINE_CHANNELS];
+};
+
+static struct platform_driver omap_dma_driver;
+
+static inline struct omap_dma_chan *to_omap_dma_chan(struct dma_chan *chan)
+{
+	return container_of(chan, struct omap_dma_chan, chan);
+}
+
+static inline struct omap_dma_desc *to_omap_dma_desc(
+		struct dma_async_tx_descriptor *txd)
+{
+	return container_of(txd, struct omap_dma_desc, txd);
+}
+
+/* Load segments into the free logical channels of the chain */
+static void omap_dma_feed(struct omap_dma_chan *c)
+{
+	struct omap_dma_desc *d;
+	struct omap_dma_seg *s;
+	unsigned slot;
+
+	while (c->inflight_count < OMAP_DMA_CHAIN_LCHS) {
+		list_for_each_entry(d, &c->active, node)
+			if (d->cyclic || d->queued < d->nsegs)
+				break;
+		if (&d->node == &c->active)
+			return;
+
+		/* the chain can only be reprogrammed once it has drained */
+		if (!c->params_valid ||
+		    memcmp(&c->params, &d->params, sizeof(c->params))) {
+			if (c->inflight_count)
+				return;
+
+			if (c->started) {
+				omap_stop_dma_chain_transfers(c->chain_id);
+				c->started = false;
+			}
+			omap_modify_dma_chain_params(c->chain_id, d->params);
+			c->params = d->params;
+			c->params_valid = true;
+		}
+
+		s = &d->segs[d->queued % d->nsegs];
+		if (omap_dma_chain_a_transfer(c->chain_id, s->src, s->dst,
+				s->elem_count, s->frame_count, c))
+			return;
+
+		slot = (c->inflight_head + c->inflight_count) %
+			OMAP_DMA_CHAIN_LCHS;
+		c->inflight[slot] = d;
+		c->inflight_count++;
+		d->queued++;
+
+		if (!c->started) {
+			omap_start_dma_chain_transfers(c->chain_id);
+			c->started = true;
+		}
+	}
+}
+
+/* Block completion of the oldest logical channel in the chain */
+static void omap_dma_callback(int lch, u16 ch_status, void *data)
+{
+	struct omap_dma_chan *c = data;
+	struct omap_dma_desc *d;
+	unsigned long flags;
+
+	spin_lock_irqsave(&c->lock, flags);
+
+	/* the chain was stopped under us */
+	if (!c->inflight_count)
+		goto out;
+
+	d = c->inflight[c->inflight_head];
+	c->inflight_head = (c->inflight_head + 1) % OMAP_DMA_CHAIN_LCHS;
+	c->inflight_count--;
+
+	if (ch_status & OMAP_DMA_ERR_IRQS)
+		d->error = true;
+
+	d->done++;
+	if (d->cyclic) {
+		d->periods++;
+		tasklet_schedule(&c->tasklet);
+	} else if (d->done == d->nsegs) {
+		c->completed_cookie = d->txd.cookie;
+		list_move_tail(&d->node, &c->complete);
+		tasklet_schedule(&c->tasklet);
+	}
+
+	omap_dma_feed(c);
+out:
+	spin_unlock_irqrestore(&c->lock, flags);
+}
+
+static void omap_dma_tasklet(unsigned long data)
+{
+	struct omap_dma_chan *c = (struct omap_dma_chan *)data;
+	struct omap_dma_desc *d, *_d;
+	dma_async_tx_callback callback = NULL;
+	void *param = NULL;
+	unsigned periods = 0;
+	LIST_HEAD(list);
+
+	spin_lock_irq(&c->lock);
+	list_splice_tail_init(&c->complete, &list);
+	d = list_first_entry(&c->active, struct omap_dma_desc, node);
+	if (!list_empty(&c->active) && d->cyclic) {
+		periods = d->periods;
+		d->periods = 0;
+		callback = d->txd.callback;
+		param = d->txd.callback_param;
+	}
+	spin_unlock_irq(&c->lock);
+
+	/* one callback per completed period */
+	while (periods--)
+		if (callback)
+			callback(param);
+
+	list_for_each_entry_safe(d, _d, &list, node) {
+		if (d->error)
+			dev_err(c->chan.device->dev,
+				"transfer error on channel %d\n",
+				c->chan.chan_id);
+		if (d->txd.callback)
+			d->txd.callback(d->txd.callback_param);
+		kfree(d);
+	}
+}
+
+static dma_cookie_t omap_dma_tx_submit(struct dma_async_tx_descriptor *txd)
+{
+	struct omap_dma_chan *c = to_omap_dma_chan(txd->chan);
+	struct omap_dma_desc *d = to_omap_dma_desc(txd);
+	dma_cookie_t cookie;
+	unsigned long flags;
+
+	spin_lock_irqsave(&c->lock, flags);
+
+	cookie = c->chan.cookie;
+	if (++cookie < 0)
+		cookie = 1;
+	c->chan.cookie = cookie;
+	txd->cookie = cookie;
+
+	list_add_tail(&d->node, &c->pending);
+
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	return cookie;
+}
+
+static struct omap_dma_desc *omap_dma_alloc_desc(struct omap_dma_chan *c,
+		unsigned nsegs, unsigned long flags)
+{
+	struct omap_dma_desc *d;
+
+	d = kzalloc(sizeof(*d) + nsegs * sizeof(d->segs[0]), GFP_ATOMIC);
+	if (!d)
+		return NULL;
+
+	dma_async_tx_descriptor_init(&d->txd, &c->chan);
+	d->txd.tx_submit = omap_dma_tx_submit;
+	d->txd.flags = flags;
+	d->nsegs = nsegs;
+
+	return d;
+}
+
+static int omap_dma_data_type(enum dma_slave_buswidth width)
+{
+	switch (width) {
+	case DMA_SLAVE_BUSWIDTH_1_BYTE:
+		return OMAP_DMA_DATA_TYPE_S8;
+	case DMA_SLAVE_BUSWIDTH_2_BYTES:
+		return OMAP_DMA_DATA_TYPE_S16;
+	case DMA_SLAVE_BUSWIDTH_4_BYTES:
+		return OMAP_DMA_DATA_TYPE_S32;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Fill in the chain parameters of a slave transfer.  Bursts of more than
+ * one element are frame synchronized, one frame per burst.
+ */
+static int omap_dma_slave_params(struct omap_dma_chan *c,
+		struct omap_dma_desc *d, enum dma_data_direction direction,
+		dma_addr_t *dev_addr, unsigned *frame_bytes)
+{
+	struct omap_dma_channel_params *p = &d->params;
+	enum dma_slave_buswidth width;
+	u32 burst;
+
+	if (direction == DMA_FROM_DEVICE) {
+		*dev_addr = c->cfg.src_addr;
+		width = c->cfg.src_addr_width;
+		burst = c->cfg.src_maxburst;
+		p->src_amode = OMAP_DMA_AMODE_CONSTANT;
+		p->dst_amode = OMAP_DMA_AMODE_POST_INC;
+		p->src_or_dst_synch = OMAP_DMA_SRC_SYNC;
+	} else if (direction == DMA_TO_DEVICE) {
+		*dev_addr = c->cfg.dst_addr;
+		width = c->cfg.dst_addr_width;
+		burst = c->cfg.dst_maxburst;
+		p->src_amode = OMAP_DMA_AMODE_POST_INC;
+		p->dst_amode = OMAP_DMA_AMODE_CONSTANT;
+		p->src_or_dst_synch = OMAP_DMA_DST_SYNC;
+	} else {
+		return -EINVAL;
+	}
+
+	p->data_type = omap_dma_data_type(width);
+	if (p->data_type < 0)
+		return -EINVAL;
+
+	p->trigger = c->dma_request;
+	p->sync_mode = burst > 1 ? OMAP_DMA_SYNC_FRAME : OMAP_DMA_SYNC_ELEMENT;
+	*frame_bytes = width * max_t(u32, burst, 1);
+
+	return 0;
+}
+
+static int omap_dma_slave_seg(struct omap_dma_seg *s,
+		enum dma_data_direction direction, dma_addr_t dev_addr,
+		dma_addr_t buf, size_t len, unsigned frame_bytes,
+		enum dma_slave_buswidth width)
+{
+	if (!len || len % frame_bytes)
+		return -EINVAL;
+
+	s->src = direction == DMA_FROM_DEVICE ? dev_addr : buf;
+	s->dst = direction == DMA_FROM_DEVICE ? buf : dev_addr;
+	s->elem_count = frame_bytes / width;
+	s->frame_count = len / frame_bytes;
+
+	/* element synchronized transfers have no frame structure */
+	if (s->elem_count == 1) {
+		s->elem_count = s->frame_count;
+		s->frame_count = 1;
+	}
+
+	if (s->elem_count > OMAP_DMA_MAX_ELEMS ||
+	    s->frame_count > OMAP_DMA_MAX_FRAMES)
+		return -EINVAL;
+
+	return 0;
+}
+
+static struct dma_async_tx_descriptor *omap_dma_prep_slave_sg(
+		struct dma_chan *chan, struct scatterlist *sgl,
+		unsigned int sg_len, enum dma_data_direction direction,
+		unsigned long flags)
+{
+	struct omap_dma_chan *c = to_omap_dma_chan(chan);
+	struct omap_dma_desc *d;
+	struct scatterlist *sg;
+	unsigned frame_bytes;
+	dma_addr_t dev_addr;
+	int i;
+
+	d = omap_dma_alloc_desc(c, sg_len, flags);
+	if (!d)
+		return NULL;
+
+	if (omap_dma_slave_params(c, d, direction, &dev_addr, &frame_bytes))
+		goto err;
+
+	for_each_sg(sgl, sg, sg_len, i)
+		if (omap_dma_slave_seg(&d->segs[i], direction, dev_addr,
+				sg_dma_address(sg), sg_dma_len(sg),
+				frame_bytes, 1 << d->params.data_type))
+			goto err;
+
+	return &d->txd;
+err:
+	kfree(d);
+	return NULL;
+}
+
+static struct dma_async_tx_descriptor *omap_dma_prep_dma_cyclic(
+		struct dma_chan *chan, dma_addr_t buf_addr, size_t buf_len,
+		size_t period_len, enum dma_data_direction direction)
+{
+	struct omap_dma_chan *c = to_omap_dma_chan(chan);
+	struct omap_dma_desc *d;
+	unsigned frame_bytes;
+	dma_addr_t dev_addr;
+	unsigned i, periods;
+
+	if (!period_len || buf_len % period_len)
+		return NULL;
+	periods = buf_len / period_len;
+
+	d = omap_dma_alloc_desc(c, periods, DMA_CTRL_ACK);
+	if (!d)
+		return NULL;
+
+	d->cyclic = true;
+
+	if (omap_dma_slave_params(c, d, direction, &dev_addr, &frame_bytes))
+		goto err;
+
+	for (i = 0; i < periods; i++)
+		if (omap_dma_slave_seg(&d->segs[i], direction, dev_addr,
+				buf_addr + i * period_len, period_len,
+				frame_bytes, 1 << d->params.data_type))
+			goto err;
+
+	return &d->txd;
+err:
+	kfree(d);
+	return NULL;
+}
+
+static struct dma_async_tx_descriptor *omap_dma_prep_dma_memcpy(
+		struct dma_chan *chan, dma_addr_t dest, dma_addr_t src,
+		size_t len, unsigned long flags)
+{
+	struct omap_dma_chan *c = to_omap_dma_chan(chan);
+	struct omap_dma_desc *d;
+	struct omap_dma_seg *s;
+	unsigned width, elems, nsegs, i;
+	size_t chunk;
+
+	if (!len)
+		return NULL;
+
+	/* widest element size the addresses and length allow */
+	if (!((dest | src | len) & 3))
+		width = 4;
+	else if (!((dest | src | len) & 1))
+		width = 2;
+	else
+		width = 1;
+
+	elems = len / width;
+	nsegs = DIV_ROUND_UP(elems, OMAP_DMA_MAX_ELEMS);
+
+	d = omap_dma_alloc_desc(c, nsegs, flags);
+	if (!d)
+		return NULL;
+
+	d->params.data_type = width == 4 ? OMAP_DMA_DATA_TYPE_S32 :
+		width == 2 ? OMAP_DMA_DATA_TYPE_S16 : OMAP_DMA_DATA_TYPE_S8;
+	d->params.src_amode = OMAP_DMA_AMODE_POST_INC;
+	d->params.dst_amode = OMAP_DMA_AMODE_POST_INC;
+	d->params.sync_mode = OMAP_DMA_SYNC_ELEMENT;
+
+	for (i = 0; i < nsegs; i++) {
+		s = &d->segs[i];
+		s->elem_count = min_t(unsigned, elems, OMAP_DMA_MAX_ELEMS);
+		s->frame_count = 1;
+		s->src = src;
+		s->dst = dest;
+
+		chunk = s->elem_count * width;
+		src += chunk;
+		dest += chunk;
+		elems -= s->elem_count;
+	}
+
+	return &d->txd;
+}
+
+static void omap_dma_issue_pending(struct dma_chan *chan)
+{
+	struct omap_dma_chan *c = to_omap_dma_chan(chan);
+	unsigned long flags;
+
+	spin_lock_irqsave(&c->lock, flags);
+	list_splice_tail_init(&c->pending, &c->active);
+	omap_dma_feed(c);
+	spin_unlock_irqrestore(&c->lock, flags);
+}
+
+static enum dma_status omap_dma_tx_status(struct dma_chan *chan,
+		dma_cookie_t cookie, struct dma_tx_state *txstate)
+{
+	struct omap_dma_chan *c = to_omap_dma_chan(chan);
+	dma_cookie_t last_used = chan->cookie;
+	dma_cookie_t last_complete = c->completed_cookie;
+
+	dma_set_tx_state(txstate, last_complete, last_used, 0);
+
+	return dma_async_is_complete(cookie, last_complete, last_used);
+}
+
+static void omap_dma_terminate_all(struct omap_dma_chan *c)
+{
+	struct omap_dma_desc *d, *_d;
+	unsigned long flags;
+	LIST_HEAD(list);
+
+	spin_lock_irqsave(&c->lock, flags);
+
+	if (c->started) {
+		omap_stop_dma_chain_transfers(c->chain_id);
+		c->started = false;
+	}
+	c->inflight_head = 0;
+	c->inflight_count = 0;
+
+	list_splice_tail_init(&c->active, &list);
+	list_splice_tail_init(&c->pending, &list);
+
+	/* what was aborted is not in progress any more */
+	c->completed_cookie = c->chan.cookie;
+
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	list_for_each_entry_safe(d, _d, &list, node)
+		kfree(d);
+}
+
+static int omap_dma_control(struct dma_chan *chan, enum dma_ctrl_cmd cmd,
+		unsigned long arg)
+{
+	struct omap_dma_chan *c = to_omap_dma_chan(chan);
+
+	switch (cmd) {
+	case DMA_TERMINATE_ALL:
+		omap_dma_terminate_all(c);
+		return 0;
+	case DMA_SLAVE_CONFIG:
+		c->cfg = *(struct dma_slave_config *)arg;
+		return 0;
+	default:
+		return -ENXIO;
+	}
+}
+
+static int omap_dma_alloc_chan_resources(struct dma_chan *chan)
+{
+	struct omap_dma_chan *c = to_omap_dma_chan(chan);
+	struct omap_dma_channel_params params;
+	int r;
+
+	memset(&params, 0, sizeof(params));
+
+	r = omap_request_dma_chain(OMAP_DMA_NO_DEVICE, "dmaengine",
+			omap_dma_callback, &c->chain_id, OMAP_DMA_CHAIN_LCHS,
+			OMAP_DMA_DYNAMIC_CHAIN, params);
+	if (r)
+		return r;
+
+	c->started = false;
+	c->params_valid = false;
+	c->completed_cookie = c->chan.cookie = 1;
+
+	return 1;
+}
+
+static void omap_dma_free_chan_resources(struct dma_chan *chan)
+{
+	struct omap_dma_chan *c = to_omap_dma_chan(chan);
+
+	omap_dma_terminate_all(c);
+	tasklet_kill(&c->tasklet);
+	omap_free_dma_chain(c->chain_id);
+	c->dma_request = OMAP_DMA_NO_DEVICE;
+}
+
+/**
+ * omap_dma_filter_fn - dma_request_channel() filter for slave channels
+ * @chan: candidate channel
+ * @param: pointer to the SDMA request line of the peripheral
+ */
+bool omap_dma_filter_fn(struct dma_chan *chan, void *param)
+{
+	if (chan->device->dev->driver != &omap_dma_driver.driver)
+		return false;
+
+	to_omap_dma_chan(chan)->dma_request = *(int *)param;
+	return true;
+}
+EXPORT_SYMBOL_GPL(omap_dma_filter_fn);
+
+static int __devinit omap_dma_probe(struct platform_device *pdev)
+{
+	struct omap_dma_engine *od;
+	struct omap_dma_chan *c;
+	int i, r;
+
+	od = kzalloc(sizeof(*od), GFP_KERNEL);
+	if (!od)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&od->dma_device.channels);
+
+	for (i = 0; i < OMAP_DMA_ENGINE_CHANNELS; i++) {
+		c = &od->chan[i];
+
+		spin_lock_init(&c->lock);
+		INIT_LIST_HEAD(&c->pending);
+		INIT_LIST_HEAD(&c->active);
+		INIT_LIST_HEAD(&c->complete);
+		tasklet_init(&c->tasklet, omap_dma_tasklet, (unsigned long)c);
+
+		c->chan.device = &od->dma_device;
+		c->chan.chan_id = i;
+		list_add_tail(&c->chan.device_node, &od->dma_device.channels);
+	}
+
+	dma_cap_set(DMA_SLAVE, od->dma_device.cap_mask);
+	dma_cap_set(DMA_CYCLIC, od->dma_device.cap_mask);
+	dma_cap_set(DMA_MEMCPY, od->dma_device.cap_mask);
+
+	od->dma_device.dev = &pdev->dev;
+	od->dma_device.device_alloc_chan_resources =
+		omap_dma_alloc_chan_resources;
+	od->dma_device.device_free_chan_resources =
+		omap_dma_free_chan_resources;
+	od->dma_device.device_prep_slave_sg = omap_dma_prep_slave_sg;
+	od->dma_device.device_prep_dma_cyclic = omap_dma_prep_dma_cyclic;
+	od->dma_device.device_prep_dma_memcpy = omap_dma_prep_dma_memcpy;
+	od->dma_device.device_issue_pending = omap_dma_issue_pending;
+	od->dma_device.device_tx_status = omap_dma_tx_status;
+	od->dma_device.device_control = omap_dma_control;
+
+	platform_set_drvdata(pdev, od);
+
+	r = dma_async_device_register(&od->dma_device);
+	if (r) {
+		dev_err(&pdev->dev, "unable to register\n");
+		kfree(od);
+		return r;
+	}
+
+	dev_info(&pdev->dev, "%d channels, %d linked lchs each\n",
+			OMAP_DMA_ENGINE_CHANNELS, OMAP_DMA_CHAIN_LCHS);
+
+	return 0;
+}
+
+static int __devexit omap_dma_remove(struct platform_device *pdev)
+{
+	struct omap_dma_engine *od = platform_get_drvdata(pdev);
+
+	dma_async_device_unregister(&od->dma_device);
+	kfree(od);
+
+	return 0;
+}
+
+static struct platform_driver omap_dma_driver = {
+	.probe	= omap_dma_probe,
+	.remove	= __devexit_p(omap_dma_remove),
+	.driver = {
+		.name	= "omap-dma-engine",
+		.owner	= THIS_MODULE,
+	},
+};
+
+static struct platform_device *omap_dma_pdev;
+
+static int __init omap_dma_init(void)
+{
+	int r;
+
+	r = platform_driver_register(&omap_dma_driver);
+	if (r)
+		return r;
+
+	omap_dma_pdev = platform_device_register_simple("omap-dma-engine",
+			-1, NULL, 0);
+	if (IS_ERR(omap_dma_pdev)) {
+		platform_driver_unregister(&omap_dma_driver);
+		return PTR_ERR(omap_dma_pdev);
+	}
+
+	return 0;
+}
+subsys_initcall(omap_dma_init);
+
+static void __exit omap_dma_exit(void)
+{
+	platform_device_unregister(omap_dma_pdev);
+	platform_driver_unregister(&omap_dma_driver);
+}
+module_exit(omap_dma_exit);
+
+MODULE_DESCRIPTION("OMAP system DMA dmaengine driver");
+MODULE_LICENSE("GPL");
@@ -24,6 +24,9 @@
 #include <linux/io.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <plat/mailbox.h>
 
 #include <syslink/multiproc.h>
@@ -79,6 +82,7 @@ static int notify_shmdrv_video_isr(struct notifier_block *,
 static int notify_shmdrv_vpss_isr(struct notifier_block *,
 					unsigned long, void *);
 static bool notify_shmdrv_isr_callback(void *ref_data, void* ntfy_msg);
+static void notify_shmdrv_kick(unsigned long data);
 
 
 /* Defines the notify_shm_drv state object, which contains all
@@ -101,6 +105,18 @@ struct notify_shm_drv_module {
 	/* To get the mailbox handles dynamically */
 	atomic_t mbox_ref_count[MULTIPROC_MAXPROCESSORS];
 	/* Reference count for enabling/disabling mailbox interrupt */
+	struct dentry *debug;
+	/* debugfs file with the event and interrupt counters */
+};
+
+/* Counters behind struct notify_shm_drv_stats.  Senders, the kick tasklet
+ * and the mailbox interrupt update them without holding a common lock. */
+struct notify_shm_drv_counters {
+	atomic_t events_sent;
+	atomic_t ints_sent;
+	atomic_t events_recv;
+	atomic_t ints_recv;
+	atomic_t events_polled;
 };
 
 /* Notify ducati driver instance object. */
@@ -134,8 +150,18 @@ struct notify_shm_drv_object {
 	/* Number of events configured */
 	struct notify_shm_drv_params params;
 	/* Instance parameters (configuration values) */
+	struct tasklet_struct kick_tasklet;
+	/* Raises the interrupt for coalesced events */
+	unsigned long kick_pending;
+	/* Bit 0 is set while kick_tasklet is scheduled */
+	u32 kick_msg;
+	/* Mailbox message sent by kick_tasklet */
+	struct notify_shm_drv_counters stats;
+	/* Event and interrupt counters */
 };
 
+static void notify_shmdrv_flush_kick(struct notify_shm_drv_object *obj);
+
 
 static struct notify_shm_drv_module notify_shm_drv_state = {
 	.gate_handle = NULL,
@@ -145,7 +171,9 @@ static struct notify_shm_drv_module notify_shm_drv_state = {
 	.def_inst_params.remote_proc_id = MULTIPROC_INVALIDID,
 	.def_inst_params.line_id = 0,
 	.def_inst_params.local_int_id = (u32) -1,
-	.def_inst_params.remote_int_id = (u32) -1
+	.def_inst_params.remote_int_id = (u32) -1,
+	.def_inst_params.coalesce = false,
+	.def_inst_params.poll_usecs = 0
 };
 
 static struct notifier_block omap_notify_nb = {
@@ -164,6 +192,46 @@ static struct notifier_block ti81xx_vpss_notify_nb = {
 	.notifier_call = notify_shmdrv_vpss_isr,
 };
 
+#ifdef CONFIG_DEBUG_FS
+static int notify_shm_drv_stats_show(struct seq_file *s, void *unused)
+{
+	struct notify_shm_drv_object *obj;
+	struct notify_shm_drv_stats stats;
+	u16 i;
+
+	if (mutex_lock_interruptible(notify_shm_drv_state.gate_handle))
+		return -ERESTARTSYS;
+
+	for (i = 0; i < MULTIPROC_MAXPROCESSORS; i++) {
+		obj = notify_shm_drv_state.driver_handles[i][0];
+		if (obj == NULL)
+			continue;
+
+		notify_shm_drv_get_stats(obj, &stats);
+		seq_printf(s, "proc %u: sent %u events in %u interrupts, "
+			"received %u events in %u interrupts (%u polled)\n",
+			i, stats.events_sent, stats.ints_sent,
+			stats.events_recv, stats.ints_recv,
+			stats.events_polled);
+	}
+
+	mutex_unlock(notify_shm_drv_state.gate_handle);
+	return 0;
+}
+
+static int notify_shm_drv_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, notify_shm_drv_stats_show, NULL);
+}
+
+static const struct file_operations notify_shm_drv_stats_fops = {
+	.open		= notify_shm_drv_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
 /* Get the default configuration for the notify_shm_drv module. */
 void notify_shm_drv_get_config(struct notify_shm_drv_config *cfg)
 {
@@ -238,6 +306,12 @@ int notify_shm_drv_setup(struct notify_shm_drv_config *cfg)
 	memcpy(&notify_shm_drv_state.cfg, cfg,
 			sizeof(struct notify_shm_drv_config));
 
+#ifdef CONFIG_DEBUG_FS
+	notify_shm_drv_state.debug = debugfs_create_file("notify_shm_drv",
+					S_IRUGO, NULL, NULL,
+					&notify_shm_drv_stats_fops);
+#endif
+
 	if (cpu_is_omap343x()) {
 		/* Initialize the maibox module for DSP */
 		rproc_id = multiproc_get_id("DSP");
@@ -387,6 +461,8 @@ int notify_shm_drv_setup(struct notify_shm_drv_config *cfg)
 	return 0;
 
 error_mailbox_get_failed:
+	debugfs_remove(notify_shm_drv_state.debug);
+	notify_shm_drv_state.debug = NULL;
 	kfree(notify_shm_drv_state.gate_handle);
 error_exit:
 	atomic_set(&(notify_shm_drv_state.ref_count),
@@ -430,6 +506,9 @@ int notify_shm_drv_destroy(void)
 		}
 	}
 
+	debugfs_remove(notify_shm_drv_state.debug);
+	notify_shm_drv_state.debug = NULL;
+
 	if (notify_shm_drv_state.gate_handle != NULL)
 		kfree(notify_shm_drv_state.gate_handle);
 
@@ -608,6 +687,8 @@ struct notify_shm_drv_object *notify_shm_drv_create(
 	memcpy(&(obj->params), (void *) params,
 				sizeof(struct notify_shm_drv_params));
 	obj->num_events = notify_state.cfg.num_events;
+	tasklet_init(&obj->kick_tasklet, notify_shmdrv_kick,
+			(unsigned long)obj);
 	/* Set the handle in the driverHandles array. */
 	notify_shm_drv_state.driver_handles
 		[params->remote_proc_id][params->line_id] = obj;
@@ -792,6 +873,8 @@ int notify_shm_drv_delete(struct notify_shm_drv_object **handle_ptr)
 #endif
 		}
 
+		tasklet_kill(&obj->kick_tasklet);
+
 		tmp_status = notify_unregister_driver(obj->drv_handle);
 		if (status >= 0 && tmp_status < 0)
 			status = tmp_status;
@@ -1102,6 +1185,10 @@ int notify_shm_drv_send_event(struct notify_driver_object *handle,
 		event from other side*/
 		while ((event_entry->flag != NOTIFYSHMDRIVER_DOWN) && \
 			(status >= 0)) {
+			/* The other side may not have been told about the
+			 * previous event yet; do not wait for kick_tasklet. */
+			notify_shmdrv_flush_kick(obj);
+
 			/* Leave critical section protection. Create a window
 			 * of opportunity for other interrupts to be handled.*/
 			mutex_unlock(notify_shm_drv_state.gate_handle);
@@ -1144,9 +1231,24 @@ int notify_shm_drv_send_event(struct notify_driver_object *handle,
 		/* Send an interrupt with the event information to the
 		 * remote processor */
 		msg = ((obj->remote_proc_id << 16) | event_id);
-
-		omap_mbox_msg_send((struct omap_mbox *)mbox,
+		atomic_inc(&obj->stats.events_sent);
+
+		if (obj->params.coalesce && !wait_clear) {
+			/* The remote side looks at every event on each
+			 * interrupt, so one still to be sent covers this
+			 * event too. */
+			obj->kick_msg = msg;
+			if (!test_and_set_bit(0, &obj->kick_pending))
+				tasklet_schedule(&obj->kick_tasklet);
+		} else {
+			/* A sender waiting for the flag to clear will
+			 * wait again on its next event, so interrupt the
+			 * other side now.  This covers any pending kick. */
+			clear_bit(0, &obj->kick_pending);
+			atomic_inc(&obj->stats.ints_sent);
+			omap_mbox_msg_send((struct omap_mbox *)mbox,
 							msg);
+		}
 
 		/* Leave critical section protection. */
 		mutex_unlock(notify_shm_drv_state.gate_handle);
@@ -1160,6 +1262,24 @@ exit:
 	return status;
 }
 
+/* Raise one interrupt for all the events posted since the last one, if
+ * it has not been raised yet. */
+static void notify_shmdrv_flush_kick(struct notify_shm_drv_object *obj)
+{
+	/* Events posted after this are left to the next interrupt. */
+	if (!test_and_clear_bit(0, &obj->kick_pending))
+		return;
+
+	atomic_inc(&obj->stats.ints_sent);
+	omap_mbox_msg_send((struct omap_mbox *)notify_shm_drv_state.
+			mbox_handle[obj->remote_proc_id], obj->kick_msg);
+}
+
+static void notify_shmdrv_kick(unsigned long data)
+{
+	notify_shmdrv_flush_kick((struct notify_shm_drv_object *)data);
+}
+
 /* Disable all events for this Notify driver.*/
 int notify_shm_drv_disable(struct notify_driver_object *handle)
 {
@@ -1460,6 +1580,21 @@ exit:
 	return mem_req;
 }
 
+/* Get the event and interrupt counters of the notify_shm_drv. */
+void notify_shm_drv_get_stats(struct notify_shm_drv_object *handle,
+				struct notify_shm_drv_stats *stats)
+{
+	if (WARN_ON(unlikely(handle == NULL || stats == NULL)))
+		return;
+
+	stats->events_sent = atomic_read(&handle->stats.events_sent);
+	stats->ints_sent = atomic_read(&handle->stats.ints_sent);
+	stats->events_recv = atomic_read(&handle->stats.events_recv);
+	stats->ints_recv = atomic_read(&handle->stats.ints_recv);
+	stats->events_polled = atomic_read(&handle->stats.events_polled);
+}
+EXPORT_SYMBOL(notify_shm_drv_get_stats);
+
 /* This function implements the interrupt service routine for the interrupt
  * received from the Ducati processor. */
 static int notify_shmdrv_isr(struct notifier_block *nb, unsigned long val,
@@ -1534,16 +1669,15 @@ static int notify_shmdrv_vpss_isr(struct notifier_block *nb, unsigned long val,
 }
 EXPORT_SYMBOL(notify_shmdrv_vpss_isr);
 
-static bool notify_shmdrv_isr_callback(void *ref_data, void *notify_msg)
+/* Handle all pending events, returns how many there were. */
+static u32 notify_shmdrv_scan(struct notify_shm_drv_object *obj)
 {
 	u32 payload = 0;
 	u32 i = 0;
+	u32 count = 0;
 	VOLATILE struct notify_shm_drv_event_entry  *event_entry;
-	struct notify_shm_drv_object *obj;
 	u32 event_id;
 
-	obj = (struct notify_shm_drv_object *) ref_data;
-
 	dsb();
 	/* Execute the loop till no asserted event is found for one complete
 	 * loop through all registered events */
@@ -1587,6 +1721,7 @@ static bool notify_shmdrv_isr_callback(void *ref_data, void *notify_msg)
 			/* Execute the callback function */
 			notify_exec(obj->drv_handle->notify_handle, event_id,
 					payload);
+			count++;
 
 			/* reinitialize the event check counter. */
 			i = 0;
@@ -1596,5 +1731,33 @@ static bool notify_shmdrv_isr_callback(void *ref_data, void *notify_msg)
 		}
 	} while ((event_id != (u32) -1) && (i < obj->num_events));
 
+	return count;
+}
+
+static bool notify_shmdrv_isr_callback(void *ref_data, void *notify_msg)
+{
+	struct notify_shm_drv_object *obj;
+	ktime_t end;
+	u32 count;
+
+	obj = (struct notify_shm_drv_object *) ref_data;
+
+	atomic_inc(&obj->stats.ints_recv);
+	atomic_add(notify_shmdrv_scan(obj), &obj->stats.events_recv);
+
+	if (!obj->params.poll_usecs)
+		return true;
+
+	/* Busy poll: events the remote side sends shortly after are taken
+	 * from shared memory right away instead of after their interrupt
+	 * has made it through the mailbox. */
+	end = ktime_add_us(ktime_get(), obj->params.poll_usecs);
+	do {
+		cpu_relax();
+		count = notify_shmdrv_scan(obj);
+		atomic_add(count, &obj->stats.events_recv);
+		atomic_add(count, &obj->stats.events_polled);
+	} while (ktime_get().tv64 < end.tv64);
+
 	return true;
 }
@@ -16,6 +16,7 @@
 
 /* Linux headers */
 #include <linux/spinlock.h>
+#include <linux/moduleparam.h>
 /*#include <linux/module.h>
 #include <linux/init.h>
 #include <linux/fs.h>
@@ -42,6 +43,22 @@ static struct notify_shm_drv_object *notify_setup_driver_handles[
 static
 struct notify_object *notify_setup_notify_handles[MULTIPROC_MAXPROCESSORS];
 
+/* Processors (bit n for processor id n) to coalesce event interrupts for */
+static uint coalesce_mask;
+module_param(coalesce_mask, uint, S_IRUGO);
+MODULE_PARM_DESC(coalesce_mask, "Processor ids, as a bit mask, for which "
+				"events are signalled one interrupt per batch");
+
+/* Processors to busy poll for events from after each interrupt */
+static uint poll_mask;
+module_param(poll_mask, uint, S_IRUGO);
+MODULE_PARM_DESC(poll_mask, "Processor ids, as a bit mask, for which "
+				"events are busy polled after an interrupt");
+
+static uint poll_usecs = 20;
+module_param(poll_usecs, uint, S_IRUGO);
+MODULE_PARM_DESC(poll_usecs, "Busy poll time after an interrupt (usecs)");
+
 
 /* Function to perform device specific setup for Notify module.
  * This function creates the Notify drivers. */
@@ -68,6 +85,9 @@ int notify_setup_omap_attach(u16 proc_id, void *shared_addr)
 	notify_shm_params.remote_int_id = 0u; /* TBD: Ipc_getConfig */
 	notify_shm_params.remote_proc_id = proc_id;
 	notify_shm_params.shared_addr = shared_addr;
+	notify_shm_params.coalesce = (coalesce_mask & (1u << proc_id)) != 0;
+	if (poll_mask & (1u << proc_id))
+		notify_shm_params.poll_usecs = poll_usecs;
 
 	notify_setup_driver_handles[proc_id] = notify_shm_drv_create(
 							&notify_shm_params);
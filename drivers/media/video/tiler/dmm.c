@@ -23,6 +23,7 @@
 #include <linux/io.h>              /* ioremap() */
 #include <linux/errno.h>
 #include <linux/slab.h>
+#include <linux/dma-mapping.h>
 
 #include <mach/dmm.h>
 
@@ -49,28 +50,81 @@ static struct platform_driver dmm_driver_ldm = {
 	.remove = NULL,
 };
 
-s32 dmm_pat_refill(struct dmm *dmm, struct pat *pd, enum pat_mode mode)
-{
-	void __iomem *r;
-	u32 v;
+/* PAT descriptor as fetched by the refill engine, see DMM_PAT_DESCR__0 */
+struct dmm_pat_desc {
+	u32 next;
+	u32 area;
+	u32 ctrl;
+	u32 data;
+};
 
-	/* Only manual refill supported */
-	if (mode != MANUAL)
-		return -EFAULT;
+/* number of descriptors in the automatic refill chain (one page) */
+#define DMM_PAT_DESCS	(PAGE_SIZE / sizeof(struct dmm_pat_desc))
 
+/* refill error bits of PAT engine 0 in DMM_PAT_IRQSTATUS_RAW */
+#define DMM_PAT_IRQ_ERR	0xFC
+
+static void dmm_pat_check(struct dmm *dmm)
+{
 	/* Check that the DMM_PAT_STATUS register has not reported an error */
-	r = dmm->base + DMM_PAT_STATUS__0;
-	v = __raw_readl(r);
+	u32 v = __raw_readl(dmm->base + DMM_PAT_STATUS__0);
 	if ((v & 0xFC00) != 0) {
 		while (1)
 			printk(KERN_ERR "dmm_pat_refill() error.\n");
 	}
+}
 
-	/* Set "next" register to NULL */
-	r = dmm->base + DMM_PAT_DESCR__0;
-	v = __raw_readl(r);
-	v = SET_FLD(v, 31, 4, (u32) NULL);
+static void dmm_pat_set_descr(struct dmm *dmm, u32 pa)
+{
+	void __iomem *r = dmm->base + DMM_PAT_DESCR__0;
+	u32 v = __raw_readl(r);
+
+	v = SET_FLD(v, 31, 4, pa >> 4);
 	__raw_writel(v, r);
+	wmb();
+}
+
+static void dmm_pat_irq_clear(struct dmm *dmm)
+{
+	void __iomem *r;
+	u32 v;
+
+	/* clear the DMM_PAT_IRQSTATUS register */
+	r = dmm->base + DMM_PAT_IRQSTATUS;
+	__raw_writel(0xFFFFFFFF, r);
+	wmb();
+
+	r = dmm->base + DMM_PAT_IRQSTATUS_RAW;
+	do {
+		v = __raw_readl(r);
+		DEBUG("DMM_PAT_IRQSTATUS_RAW", v);
+	} while (v != 0x0);
+}
+
+/* wait for PAT_IRQSTATUS_RAW to report the (last) refill */
+static s32 dmm_pat_irq_wait(struct dmm *dmm)
+{
+	void __iomem *r = dmm->base + DMM_PAT_IRQSTATUS_RAW;
+	u32 v;
+
+	do {
+		v = __raw_readl(r);
+		DEBUG("DMM_PAT_IRQSTATUS_RAW", v);
+		if (v & DMM_PAT_IRQ_ERR) {
+			printk(KERN_ERR "dmm_pat_refill() irq error 0x%x\n", v);
+			return -EFAULT;
+		}
+	} while ((v & 0x3) != 0x3);
+
+	return 0;
+}
+
+/* program one descriptor through the PAT registers and wait for it */
+static s32 dmm_pat_refill_manual(struct dmm *dmm, struct pat *pd)
+{
+	void __iomem *r;
+	u32 v;
+	s32 res;
 
 	/* Set area to be refilled */
 	r = dmm->base + DMM_PAT_AREA__0;
@@ -90,16 +144,7 @@ s32 dmm_pat_refill(struct dmm *dmm, struct pat *pd, enum pat_mode mode)
 						(char)pd->area.y1);
 #endif
 
-	/* First, clear the DMM_PAT_IRQSTATUS register */
-	r = dmm->base + DMM_PAT_IRQSTATUS;
-	__raw_writel(0xFFFFFFFF, r);
-	wmb();
-
-	r = dmm->base + DMM_PAT_IRQSTATUS_RAW;
-	do {
-		v = __raw_readl(r);
-		DEBUG("DMM_PAT_IRQSTATUS_RAW", v);
-	} while (v != 0x0);
+	dmm_pat_irq_clear(dmm);
 
 	/* Fill data register */
 	r = dmm->base + DMM_PAT_DATA__0;
@@ -127,42 +172,100 @@ s32 dmm_pat_refill(struct dmm *dmm, struct pat *pd, enum pat_mode mode)
 	__raw_writel(v, r);
 	wmb();
 
-	/* Check if PAT_IRQSTATUS_RAW is set after the PAT has been refilled */
-	r = dmm->base + DMM_PAT_IRQSTATUS_RAW;
-	do {
-		v = __raw_readl(r);
-		DEBUG("DMM_PAT_IRQSTATUS_RAW", v);
-	} while ((v & 0x3) != 0x3);
+	res = dmm_pat_irq_wait(dmm);
+	dmm_pat_irq_clear(dmm);
+	return res;
+}
 
-	/* Again, clear the DMM_PAT_IRQSTATUS register */
-	r = dmm->base + DMM_PAT_IRQSTATUS;
-	__raw_writel(0xFFFFFFFF, r);
+/*
+ * Copy up to DMM_PAT_DESCS descriptors of the chain at *@pd into the DMM's
+ * descriptor memory, and let the refill engine walk them on its own.  The
+ * IRQ handshake is done once for the whole chain.  *@pd is advanced past the
+ * descriptors programmed.
+ */
+static s32 dmm_pat_refill_auto(struct dmm *dmm, struct pat **pd)
+{
+	struct dmm_pat_desc *d = dmm->descs;
+	struct pat *p = *pd;
+	u32 i, v;
+	s32 res;
+
+	for (i = 0; p && i < DMM_PAT_DESCS; i++, p = p->next, d++) {
+		/* p->data must be 16 aligned */
+		BUG_ON(p->data & 15);
+
+		v = SET_FLD(0, 30, 24, p->area.y1);
+		v = SET_FLD(v, 23, 16, p->area.x1);
+		v = SET_FLD(v, 14, 8, p->area.y0);
+		d->area = SET_FLD(v, 7, 0, p->area.x0);
+
+		v = SET_FLD(0, 31, 28, p->ctrl.ini);
+		v = SET_FLD(v, 16, 16, p->ctrl.sync);
+		v = SET_FLD(v, 9, 8, p->ctrl.lut_id);
+		v = SET_FLD(v, 6, 4, p->ctrl.dir);
+		d->ctrl = SET_FLD(v, 0, 0, p->ctrl.start);
+
+		d->data = p->data;
+		d->next = dmm->descs_pa + (i + 1) * sizeof(*d);
+	}
+	/* terminate the chain */
+	d[-1].next = 0;
+	*pd = p;
+
+	dmm_pat_irq_clear(dmm);
+
+	/* descriptors are in coherent memory, start the engine on them */
 	wmb();
+	dmm_pat_set_descr(dmm, dmm->descs_pa);
 
-	r = dmm->base + DMM_PAT_IRQSTATUS_RAW;
-	do {
-		v = __raw_readl(r);
-		DEBUG("DMM_PAT_IRQSTATUS_RAW", v);
-	} while (v != 0x0);
+	res = dmm_pat_irq_wait(dmm);
+	dmm_pat_irq_clear(dmm);
+	return res;
+}
 
-	/* Again, set "next" register to NULL to clear any PAT STATUS errors */
-	r = dmm->base + DMM_PAT_DESCR__0;
-	v = __raw_readl(r);
-	v = SET_FLD(v, 31, 4, (u32) NULL);
-	__raw_writel(v, r);
+/*
+ * Refill the PAT for @pd and every descriptor linked from it through
+ * pd->next.  In MANUAL mode each descriptor is programmed and waited for
+ * through the PAT registers; in AUTO mode the chain is handed to the refill
+ * engine through DMM_PAT_DESCR and only its last descriptor is waited for.
+ */
+s32 dmm_pat_refill(struct dmm *dmm, struct pat *pd, enum pat_mode mode)
+{
+	s32 res = 0;
+
+	if (mode != MANUAL && mode != AUTO)
+		return -EFAULT;
+
+	/* fall back to manual refill without descriptor memory */
+	if (!dmm->descs)
+		mode = MANUAL;
+
+	mutex_lock(&dmm->mtx);
+	dmm_pat_check(dmm);
+
+	/* Set "next" register to NULL */
+	dmm_pat_set_descr(dmm, 0);
+
+	while (pd && !res) {
+		if (mode == AUTO) {
+			res = dmm_pat_refill_auto(dmm, &pd);
+		} else {
+			res = dmm_pat_refill_manual(dmm, pd);
+			pd = pd->next;
+		}
+
+		/* set "next" register to NULL to clear any PAT STATUS errors */
+		dmm_pat_set_descr(dmm, 0);
+	}
 
 	/*
 	 * Now, check that the DMM_PAT_STATUS register
 	 * has not reported an error before exiting.
 	*/
-	r = dmm->base + DMM_PAT_STATUS__0;
-	v = __raw_readl(r);
-	if ((v & 0xFC00) != 0) {
-		while (1)
-			printk(KERN_ERR "dmm_pat_refill() error.\n");
-	}
+	dmm_pat_check(dmm);
+	mutex_unlock(&dmm->mtx);
 
-	return 0;
+	return res;
 }
 EXPORT_SYMBOL(dmm_pat_refill);
 
@@ -188,6 +291,11 @@ struct dmm *dmm_pat_init(u32 id)
 		kfree(dmm);
 		return NULL;
 	}
+	mutex_init(&dmm->mtx);
+
+	/* descriptors for AUTO refill must be at 16-byte aligned addresses */
+	dmm->descs = dma_alloc_coherent(NULL, PAGE_SIZE, &dmm->descs_pa,
+								GFP_KERNEL);
 
 	__raw_writel(0x88888888, dmm->base + DMM_PAT_VIEW__0);
 	__raw_writel(0x88888888, dmm->base + DMM_PAT_VIEW__1);
@@ -208,6 +316,9 @@ EXPORT_SYMBOL(dmm_pat_init);
 void dmm_pat_release(struct dmm *dmm)
 {
 	if (dmm) {
+		if (dmm->descs)
+			dma_free_coherent(NULL, PAGE_SIZE, dmm->descs,
+							dmm->descs_pa);
 		iounmap(dmm->base);
 		kfree(dmm);
 	}
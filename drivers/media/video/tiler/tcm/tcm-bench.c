@@ -0,0 +1,232 @@
+/*
+ * tcm-bench.c
+ *
+ * Allocation latency and fragmentation benchmark of the SiTA and bitmap
+ * tiler container managers.
+ *
+ * Copyright (C) 2009-2010 Texas Instruments, Inc.
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/*
+ * Both managers get a container of their own and are driven through the
+ * same pseudo-random sequence of 2D and 1D reservations and frees, with at
+ * most "live" areas reserved at a time.  For each manager this reports:
+ *
+ *  - the mean and worst time of a 2D and of a 1D reservation,
+ *  - the reservations that failed although the container had enough free
+ *    slots for them, which is the cost of fragmentation,
+ *  - after the sequence, how full the container gets when 16x16 areas
+ *    are reserved until one fails.
+ *
+ * The module does all of its work from init and then fails to load.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#include "tcm-sita.h"
+#include "tcm-bmap.h"
+
+#define PRINT_PREF KERN_INFO "tcm-bench: "
+
+/* default container geometry is that of the OMAP4 TILER */
+static int width = 256;
+module_param(width, int, S_IRUGO);
+MODULE_PARM_DESC(width, "Container width in slots");
+
+static int height = 128;
+module_param(height, int, S_IRUGO);
+MODULE_PARM_DESC(height, "Container height in slots");
+
+static int ops = 20000;
+module_param(ops, int, S_IRUGO);
+MODULE_PARM_DESC(ops, "Reservations and frees per container manager");
+
+static int live = 16;
+module_param(live, int, S_IRUGO);
+MODULE_PARM_DESC(live, "Maximum number of areas reserved at a time");
+
+static int seed = 1;
+module_param(seed, int, S_IRUGO);
+MODULE_PARM_DESC(seed, "Seed of the reservation sequence");
+
+struct bench_stats {
+	u32 n2d, n1d;		/* successful reservations */
+	u64 ns2d, ns1d;		/* total time of the successful ones */
+	u32 max2d, max1d;	/* worst time of a successful one */
+	u32 nospace;		/* failed, the container was full */
+	u32 fragmented;		/* failed, with enough free slots */
+	u32 fill;		/* 16x16 areas reserved at the end */
+	u32 fill_used;		/* slots in use when the fill failed */
+};
+
+/*
+ * Reserve an area the size of a video buffer: mostly 2D, with the
+ * alignments the TILER driver asks for, sometimes a 1D buffer.
+ */
+static s32 bench_reserve(struct tcm *tcm, struct rnd_state *rnd,
+			 struct tcm_area *area, struct bench_stats *st,
+			 u32 free_slots)
+{
+	static const u16 aligns[] = { 0, 32, 64 };
+	u32 r = prandom32(rnd);
+	u16 w, h, align;
+	u32 slots, ns;
+	bool is2d = r % 4;
+	ktime_t start;
+	s32 ret;
+
+	if (is2d) {
+		w = 1 + (r >> 2) % min(64, width);
+		h = 1 + (r >> 8) % min(32, height);
+		align = aligns[(r >> 16) % ARRAY_SIZE(aligns)];
+		slots = w * h;
+
+		start = ktime_get();
+		ret = tcm_reserve_2d(tcm, w, h, align, area);
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	} else {
+		slots = 1 + (r >> 2) % (2 * width);
+
+		start = ktime_get();
+		ret = tcm_reserve_1d(tcm, slots, area);
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	}
+
+	if (ret) {
+		if (slots <= free_slots)
+			st->fragmented++;
+		else
+			st->nospace++;
+	} else if (is2d) {
+		st->n2d++;
+		st->ns2d += ns;
+		st->max2d = max(st->max2d, ns);
+	} else {
+		st->n1d++;
+		st->ns1d += ns;
+		st->max1d = max(st->max1d, ns);
+	}
+
+	return ret;
+}
+
+static int bench_run(const char *name, struct tcm *tcm)
+{
+	struct tcm_area *areas;
+	struct bench_stats st;
+	struct rnd_state rnd;
+	u32 total = width * height, used = 0;
+	int i, j, n = 0;
+
+	if (!tcm) {
+		printk(PRINT_PREF "%s: cannot create container\n", name);
+		return -ENOMEM;
+	}
+
+	/* room for the fill areas too */
+	areas = kcalloc(live + total / 256, sizeof(*areas), GFP_KERNEL);
+	if (!areas) {
+		tcm_deinit(tcm);
+		return -ENOMEM;
+	}
+
+	memset(&st, 0, sizeof(st));
+	prandom32_seed(&rnd, seed);
+
+	/*
+	 * SiTA keeps pointers to the reserved areas, so they stay in place;
+	 * a slot of @areas is in use while its tcm field is set.
+	 */
+	for (i = 0; i < ops; i++) {
+		/* free a random area one time in three, or when at the limit */
+		if (n && (n == live || !(prandom32(&rnd) % 3))) {
+			j = prandom32(&rnd) % live;
+			while (!areas[j].tcm)
+				j = (j + 1) % live;
+			used -= tcm_sizeof(areas[j]);
+			tcm_free(&areas[j]);
+			n--;
+			continue;
+		}
+
+		for (j = 0; areas[j].tcm; j++)
+			;
+		if (!bench_reserve(tcm, &rnd, &areas[j], &st, total - used)) {
+			used += tcm_sizeof(areas[j]);
+			n++;
+		}
+		cond_resched();
+	}
+
+	/* how much of what is left can still be used */
+	st.fill_used = used;
+	for (j = live; j < live + total / 256; j++) {
+		if (tcm_reserve_2d(tcm, 16, 16, 0, &areas[j]))
+			break;
+		st.fill++;
+		st.fill_used += tcm_sizeof(areas[j]);
+	}
+
+	printk(PRINT_PREF "%s: 2D %u in %llu ns avg, %u ns max; "
+	       "1D %u in %llu ns avg, %u ns max\n", name,
+	       st.n2d, st.n2d ? div_u64(st.ns2d, st.n2d) : 0ULL, st.max2d,
+	       st.n1d, st.n1d ? div_u64(st.ns1d, st.n1d) : 0ULL, st.max1d);
+	printk(PRINT_PREF "%s: %u failed with enough free slots, %u full; "
+	       "16x16 fill %u areas, %u%% of slots used\n", name,
+	       st.fragmented, st.nospace, st.fill,
+	       st.fill_used * 100 / total);
+
+	/* the container goes away with all of its areas */
+	tcm_deinit(tcm);
+	kfree(areas);
+
+	return 0;
+}
+
+static int __init tcm_bench_init(void)
+{
+	struct tcm_pt div_pt;
+	int ret;
+
+	if (width <= 0 || width > 0xffff || height <= 0 || height > 0xffff ||
+	    ops < 0 || live <= 0)
+		return -EINVAL;
+
+	printk(PRINT_PREF "%dx%d container, %d operations, %d areas, "
+	       "seed %d\n", width, height, ops, live, seed);
+
+	/* same division point as tiler_init() */
+	div_pt.x = width;
+	div_pt.y = (3 * height) / 4;
+
+	ret = bench_run("sita", sita_init(width, height, &div_pt));
+	if (!ret)
+		ret = bench_run("bmap", bmap_init(width, height, &div_pt));
+	if (ret)
+		return ret;
+
+	/* all the work is done from init, there is nothing to keep */
+	return -EAGAIN;
+}
+
+static void __exit tcm_bench_exit(void) { }
+
+module_init(tcm_bench_init);
+module_exit(tcm_bench_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("TILER container manager allocation benchmark");
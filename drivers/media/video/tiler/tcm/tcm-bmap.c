@@ -0,0 +1,253 @@
+/*
+ * tcm-bmap.c
+ *
+ * Bitmap based tiler container manager: 2D and 1D allocation(reservation)
+ * algorithm
+ *
+ * Copyright (C) 2009-2010 Texas Instruments, Inc.
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+/*
+ * The container is tracked as one bit per slot in raster order, so a
+ * container row is a whole number of bitmap words and a 1D area is simply
+ * a run of bits.  Finding room for a w x h 2D area at row y ORs the h rows
+ * below y together and looks for an aligned run of w clear bits, which
+ * costs a few word operations per row instead of a test per slot.
+ */
+#include <linux/slab.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/bitmap.h>
+
+#include "tcm-bmap.h"
+
+#define TCM_ALG_NAME "tcm_bmap"
+#include "tcm-utils.h"
+
+struct bmap_pvt {
+	struct mutex mtx;
+	u16 div_y;		/* first row preferred for 1D areas */
+	unsigned long *map;	/* one bit per slot, set if reserved */
+	unsigned long *row;	/* scratch row for 2D searches */
+};
+
+static s32 bmap_reserve_2d(struct tcm *tcm, u16 h, u16 w, u8 align,
+			   struct tcm_area *area);
+static s32 bmap_reserve_1d(struct tcm *tcm, u32 slots, struct tcm_area *area);
+static s32 bmap_free(struct tcm *tcm, struct tcm_area *area);
+static void bmap_deinit(struct tcm *tcm);
+
+struct tcm *bmap_init(u16 width, u16 height, struct tcm_pt *attr)
+{
+	struct tcm *tcm;
+	struct bmap_pvt *pvt;
+
+	if (width == 0 || height == 0 || width % BITS_PER_LONG)
+		return NULL;
+
+	tcm = kzalloc(sizeof(*tcm), GFP_KERNEL);
+	pvt = kzalloc(sizeof(*pvt), GFP_KERNEL);
+	if (!tcm || !pvt)
+		goto error;
+
+	pvt->map = kcalloc(BITS_TO_LONGS(width * height), sizeof(long),
+			   GFP_KERNEL);
+	pvt->row = kcalloc(BITS_TO_LONGS(width), sizeof(long), GFP_KERNEL);
+	if (!pvt->map || !pvt->row)
+		goto error;
+
+	tcm->height = height;
+	tcm->width = width;
+	tcm->reserve_2d = bmap_reserve_2d;
+	tcm->reserve_1d = bmap_reserve_1d;
+	tcm->free = bmap_free;
+	tcm->deinit = bmap_deinit;
+	tcm->pvt = (void *)pvt;
+
+	mutex_init(&pvt->mtx);
+	if (attr && attr->y < height)
+		pvt->div_y = attr->y;
+	else
+		pvt->div_y = (height * 3) / 4;
+
+	return tcm;
+
+error:
+	if (pvt) {
+		kfree(pvt->map);
+		kfree(pvt->row);
+	}
+	kfree(tcm);
+	kfree(pvt);
+	return NULL;
+}
+EXPORT_SYMBOL(bmap_init);
+
+static void bmap_deinit(struct tcm *tcm)
+{
+	struct bmap_pvt *pvt = (struct bmap_pvt *)tcm->pvt;
+
+	mutex_destroy(&pvt->mtx);
+	kfree(pvt->row);
+	kfree(pvt->map);
+	kfree(pvt);
+	kfree(tcm);
+}
+
+static inline unsigned long *map_row(struct tcm *tcm, u16 y)
+{
+	struct bmap_pvt *pvt = (struct bmap_pvt *)tcm->pvt;
+
+	return pvt->map + BITS_TO_LONGS(tcm->width) * y;
+}
+
+/* set or clear the bits of all slots in @area */
+static void fill_area(struct tcm *tcm, struct tcm_area *area, bool busy)
+{
+	struct bmap_pvt *pvt = (struct bmap_pvt *)tcm->pvt;
+	u32 start, len;
+	u16 y;
+
+	for (y = area->p0.y; y <= area->p1.y; y++) {
+		if (area->is2d) {
+			start = y * tcm->width + area->p0.x;
+			len = tcm_awidth(*area);
+		} else {
+			start = y * tcm->width +
+				(y == area->p0.y ? area->p0.x : 0);
+			len = (y == area->p1.y ? area->p1.x :
+			       tcm->width - 1) + 1 -
+			      (start - y * tcm->width);
+		}
+
+		if (busy)
+			bitmap_set(pvt->map, start, len);
+		else
+			bitmap_clear(pvt->map, start, len);
+	}
+}
+
+/**
+ * Reserve a 2D area in the container: the first row from the top with
+ * room for it, leftmost position within that row.
+ *
+ * @param w	width
+ * @param h	height
+ * @param area	pointer to the area that will be populated with the reserved
+ *		area
+ *
+ * @return 0 on success, non-0 error value on failure.
+ */
+static s32 bmap_reserve_2d(struct tcm *tcm, u16 h, u16 w, u8 align,
+			   struct tcm_area *area)
+{
+	struct bmap_pvt *pvt = (struct bmap_pvt *)tcm->pvt;
+	int words = BITS_TO_LONGS(tcm->width);
+	unsigned long x;
+	u16 y, i;
+	s32 ret = -ENOMEM;
+
+	/* not supporting more than 64 as alignment */
+	if (align > 64)
+		return -EINVAL;
+
+	/* keep the same preferred alignments as SiTA */
+	align = align <= 1 ? 1 : align <= 32 ? 32 : 64;
+
+	mutex_lock(&pvt->mtx);
+	for (y = 0; y + h <= tcm->height; y++) {
+		/* cheap rejection on the top row alone */
+		x = bitmap_find_next_zero_area(map_row(tcm, y), tcm->width,
+					       0, w, align - 1);
+		if (x >= tcm->width)
+			continue;
+
+		bitmap_copy(pvt->row, map_row(tcm, y), tcm->width);
+		for (i = 1; i < h; i++)
+			bitmap_or(pvt->row, pvt->row, map_row(tcm, y + i),
+				  words * BITS_PER_LONG);
+
+		x = bitmap_find_next_zero_area(pvt->row, tcm->width, x, w,
+					       align - 1);
+		if (x < tcm->width) {
+			assign(area, x, y, x + w - 1, y + h - 1);
+			fill_area(tcm, area, true);
+			ret = 0;
+			break;
+		}
+	}
+	mutex_unlock(&pvt->mtx);
+
+	PA(2, "reserve_2d:", area);
+	return ret;
+}
+
+/**
+ * Reserve a 1D area in the container, preferably at or below the division
+ * row so that 1D areas do not fragment the space used by 2D areas.
+ *
+ * @param num_slots	size of 1D area
+ * @param area		pointer to the area that will be populated with the
+ *			reserved area
+ *
+ * @return 0 on success, non-0 error value on failure.
+ */
+static s32 bmap_reserve_1d(struct tcm *tcm, u32 num_slots,
+			   struct tcm_area *area)
+{
+	struct bmap_pvt *pvt = (struct bmap_pvt *)tcm->pvt;
+	u32 size = tcm->width * tcm->height;
+	unsigned long start;
+	s32 ret = -ENOMEM;
+
+	mutex_lock(&pvt->mtx);
+	start = bitmap_find_next_zero_area(pvt->map, size,
+					   pvt->div_y * tcm->width,
+					   num_slots, 0);
+	if (start >= size)
+		start = bitmap_find_next_zero_area(pvt->map, size, 0,
+						   num_slots, 0);
+	if (start < size) {
+		assign(area, start % tcm->width, start / tcm->width,
+		       (start + num_slots - 1) % tcm->width,
+		       (start + num_slots - 1) / tcm->width);
+		fill_area(tcm, area, true);
+		ret = 0;
+	}
+	mutex_unlock(&pvt->mtx);
+
+	PA(2, "reserve_1d:", area);
+	return ret;
+}
+
+/**
+ * Unreserve a previously allocated 2D or 1D area
+ * @param area	area to be freed
+ * @return 0 - success
+ */
+static s32 bmap_free(struct tcm *tcm, struct tcm_area *area)
+{
+	struct bmap_pvt *pvt = (struct bmap_pvt *)tcm->pvt;
+	u32 first = area->p0.y * tcm->width + area->p0.x;
+	u32 last = area->p1.y * tcm->width + area->p1.x;
+
+	mutex_lock(&pvt->mtx);
+
+	/* check that this is in fact a reserved area */
+	WARN_ON(!test_bit(first, pvt->map) || !test_bit(last, pvt->map));
+
+	fill_area(tcm, area, false);
+
+	mutex_unlock(&pvt->mtx);
+
+	return 0;
+}
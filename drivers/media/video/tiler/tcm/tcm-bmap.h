@@ -0,0 +1,40 @@
+/*
+ * tcm-bmap.h
+ *
+ * Bitmap based tiler container manager interface.
+ *
+ * Copyright (C) 2009-2010 Texas Instruments, Inc.
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef TCM_BMAP_H
+#define TCM_BMAP_H
+
+#include "../tcm.h"
+
+/**
+ * Create a bitmap tiler container manager.
+ *
+ * 2D areas are placed first-fit from the top of the container, 1D areas
+ * first-fit from the row given in attr->y, falling back to the whole
+ * container.  The container width must be a multiple of BITS_PER_LONG.
+ *
+ * @param width  Container width
+ * @param height Container height
+ * @param attr   division point: attr->y is the first row preferred for
+ *		 1D allocations, attr->x is unused
+ *
+ * @return TCM instance
+ */
+struct tcm *bmap_init(u16 width, u16 height, struct tcm_pt *attr);
+
+TCM_INIT(bmap_init, struct tcm_pt);
+
+#endif /* TCM_BMAP_H */
@@ -179,10 +179,11 @@ static void sita_deinit(struct tcm *tcm)
 
 	mutex_destroy(&(pvt->mtx));
 
-	for (i = 0; i < tcm->height; i++)
+	for (i = 0; i < tcm->width; i++)
 		kfree(pvt->map[i]);
 	kfree(pvt->map);
 	kfree(pvt);
+	kfree(tcm);
 }
 
 /**
@@ -696,6 +697,12 @@ static s32 scan_r2l_b2t_one_dim(struct tcm *tcm, u32 num_slots,
 
 	}
 
+	/* the scan stopped one slot to the left of the area */
+	if (++x == tcm->width) {
+		x = 0;
+		y++;
+	}
+
 	/* set top-left corner */
 	area->p0.x = x;
 	area->p0.y = y;
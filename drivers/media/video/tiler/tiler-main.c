@@ -36,10 +36,12 @@
 #include "tmm.h"
 #include "_tiler.h"
 #include "tcm/tcm-sita.h"		/* TCM algorithm */
+#include "tcm/tcm-bmap.h"
 
 static bool ssptr_id = CONFIG_TILER_SSPTR_ID;
 static uint default_align = CONFIG_TILER_ALIGNMENT;
 static uint granularity = CONFIG_TILER_GRANULARITY;
+static char *tcm_alg = "sita";
 
 /*
  * We can only change ssptr_id if there are no blocks allocated, so that
@@ -52,6 +54,8 @@ module_param_named(align, default_align, uint, 0644);
 MODULE_PARM_DESC(align, "Default block ssptr alignment");
 module_param_named(grain, granularity, uint, 0644);
 MODULE_PARM_DESC(grain, "Granularity (bytes)");
+module_param_named(tcm, tcm_alg, charp, 0444);
+MODULE_PARM_DESC(tcm, "Container manager algorithm (sita or bmap)");
 
 struct tiler_dev {
 	struct cdev cdev;
@@ -82,33 +86,57 @@ static struct tcm *tcm[TILER_FORMATS];
 static struct tmm *tmm[TILER_FORMATS];
 static u32 *dmac_va;
 static dma_addr_t dmac_pa;
+static DEFINE_MUTEX(pat_mtx);		/* protects dmac_va */
+
+/*
+ * PAT refills are batched per area.  Each staged slice is padded to 16 bytes,
+ * so the staging buffer has room for that padding on top of the container.
+ */
+#define TILER_MAX_SLICES	4
+#define DMAC_SIZE ((tiler.width * tiler.height + 4 * TILER_MAX_SLICES) * \
+							sizeof(*dmac_va))
 
 /*
  *  TMM connectors
  *  ==========================================================================
  */
-/* wrapper around tmm_map */
+/* wrapper around tmm_map_n: all slices of an area go in one PAT refill */
 static s32 refill_pat(struct tmm *tmm, struct tcm_area *area, u32 *ptr)
 {
 	s32 res = 0;
-	struct pat_area p_area = {0};
+	struct pat_area p_area[TILER_MAX_SLICES];
+	u32 data[TILER_MAX_SLICES];
 	struct tcm_area slice, area_s;
+	u32 n = 0, off = 0;
 
+	/* dmac_va is shared by all refills */
+	mutex_lock(&pat_mtx);
 	tcm_for_each_slice(slice, *area, area_s) {
-		p_area.x0 = slice.p0.x;
-		p_area.y0 = slice.p0.y;
-		p_area.x1 = slice.p1.x;
-		p_area.y1 = slice.p1.y;
+		/* flush the batch if it is full */
+		if (n == TILER_MAX_SLICES) {
+			if (tmm_map_n(tmm, p_area, data, n)) {
+				res = -EFAULT;
+				break;
+			}
+			n = off = 0;
+		}
 
-		memcpy(dmac_va, ptr, sizeof(*ptr) * tcm_sizeof(slice));
-		ptr += tcm_sizeof(slice);
+		p_area[n].x0 = slice.p0.x;
+		p_area[n].y0 = slice.p0.y;
+		p_area[n].x1 = slice.p1.x;
+		p_area[n].y1 = slice.p1.y;
 
-		if (tmm_map(tmm, p_area, dmac_pa)) {
-			res = -EFAULT;
-			break;
-		}
+		/* stage each page list at a 16-byte aligned offset */
+		memcpy(dmac_va + off, ptr, sizeof(*ptr) * tcm_sizeof(slice));
+		ptr += tcm_sizeof(slice);
+		data[n++] = dmac_pa + off * sizeof(*dmac_va);
+		off += ALIGN(tcm_sizeof(slice), 4);
 	}
 
+	if (!res && n && tmm_map_n(tmm, p_area, data, n))
+		res = -EFAULT;
+	mutex_unlock(&pat_mtx);
+
 	return res;
 }
 
@@ -1113,7 +1141,7 @@ static s32 __init tiler_init(void)
 	s32 r = -1;
 	struct device *device = NULL;
 	struct tcm_pt div_pt;
-	struct tcm *sita = NULL;
+	struct tcm *cm = NULL;		/* container manager */
 	struct tmm *tmm_pat = NULL;
 
 	tiler.alloc = alloc_block;
@@ -1145,20 +1173,22 @@ static s32 __init tiler_init(void)
 	 * Array of physical pages for PAT programming, which must be a 16-byte
 	 * aligned physical address.
 	 */
-	dmac_va = dma_alloc_coherent(NULL, tiler.width * tiler.height *
-					sizeof(*dmac_va), &dmac_pa, GFP_ATOMIC);
+	dmac_va = dma_alloc_coherent(NULL, DMAC_SIZE, &dmac_pa, GFP_ATOMIC);
 	if (!dmac_va)
 		return -ENOMEM;
 
 	/* Allocate tiler container manager (we share 1 on OMAP4) */
 	div_pt.x = tiler.width;   /* hardcoded default */
 	div_pt.y = (3 * tiler.height) / 4;
-	sita = sita_init(tiler.width, tiler.height, (void *)&div_pt);
+	if (!strcmp(tcm_alg, "bmap"))
+		cm = bmap_init(tiler.width, tiler.height, (void *)&div_pt);
+	else
+		cm = sita_init(tiler.width, tiler.height, (void *)&div_pt);
 
-	tcm[TILFMT_8BIT]  = sita;
-	tcm[TILFMT_16BIT] = sita;
-	tcm[TILFMT_32BIT] = sita;
-	tcm[TILFMT_PAGE]  = sita;
+	tcm[TILFMT_8BIT]  = cm;
+	tcm[TILFMT_16BIT] = cm;
+	tcm[TILFMT_32BIT] = cm;
+	tcm[TILFMT_PAGE]  = cm;
 
 	/* Allocate tiler memory manager (must have 1 unique TMM per TCM ) */
 	tmm_pat = tmm_pat_init(0);
@@ -1170,7 +1200,7 @@ static s32 __init tiler_init(void)
 	tiler.nv12_packed = tcm[TILFMT_8BIT] == tcm[TILFMT_16BIT];
 
 	tiler_device = kmalloc(sizeof(*tiler_device), GFP_KERNEL);
-	if (!tiler_device || !sita || !tmm_pat) {
+	if (!tiler_device || !cm || !tmm_pat) {
 		r = -ENOMEM;
 		goto error;
 	}
@@ -1214,10 +1244,9 @@ error:
 	/* TODO: error handling for device registration */
 	if (r) {
 		kfree(tiler_device);
-		tcm_deinit(sita);
+		tcm_deinit(cm);
 		tmm_deinit(tmm_pat);
-		dma_free_coherent(NULL, tiler.width * tiler.height *
-					sizeof(*dmac_va), dmac_va, dmac_pa);
+		dma_free_coherent(NULL, DMAC_SIZE, dmac_va, dmac_pa);
 	}
 
 	return r;
@@ -1239,8 +1268,7 @@ static void __exit tiler_exit(void)
 
 	mutex_unlock(&mtx);
 
-	dma_free_coherent(NULL, tiler.width * tiler.height * sizeof(*dmac_va),
-							dmac_va, dmac_pa);
+	dma_free_coherent(NULL, DMAC_SIZE, dmac_va, dmac_pa);
 
 	/* close containers only once */
 	for (i = TILFMT_MIN; i <= TILFMT_MAX; i++) {
@@ -262,6 +262,38 @@ static s32 tmm_pat_map(struct tmm *tmm, struct pat_area area, u32 page_pa)
 	return dmm_pat_refill(pvt->dmm, &pat_desc, MANUAL);
 }
 
+/* descriptors built on the stack per chained refill */
+#define TMM_PAT_BATCH	8
+
+/* program a whole batch of areas with chained (AUTO) refills */
+static s32 tmm_pat_map_n(struct tmm *tmm, struct pat_area *areas,
+			 u32 *page_pa, u32 n)
+{
+	struct dmm_mem *pvt = (struct dmm_mem *) tmm->pvt;
+	struct pat pat_desc[TMM_PAT_BATCH];
+	s32 res = 0;
+	u32 i, m;
+
+	while (n && !res) {
+		m = min_t(u32, n, TMM_PAT_BATCH);
+		memset(pat_desc, 0, m * sizeof(*pat_desc));
+
+		for (i = 0; i < m; i++) {
+			pat_desc[i].ctrl.start = 1;
+			pat_desc[i].area = areas[i];
+			/* must be a 16-byte aligned physical address */
+			pat_desc[i].data = page_pa[i];
+			pat_desc[i].next = i + 1 < m ? pat_desc + i + 1 : NULL;
+		}
+
+		res = dmm_pat_refill(pvt->dmm, pat_desc, AUTO);
+		areas += m;
+		page_pa += m;
+		n -= m;
+	}
+	return res;
+}
+
 struct tmm *tmm_pat_init(u32 pat_id)
 {
 	struct tmm *tmm = NULL;
@@ -288,6 +320,7 @@ struct tmm *tmm_pat_init(u32 pat_id)
 		tmm->get = tmm_pat_get_pages;
 		tmm->free = tmm_pat_free_pages;
 		tmm->map = tmm_pat_map;
+		tmm->map_n = tmm_pat_map_n;
 		tmm->clear = NULL;   /* not yet supported */
 
 		return tmm;
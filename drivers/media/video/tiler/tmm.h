@@ -29,6 +29,8 @@ struct tmm {
 	u32 *(*get)	(struct tmm *tmm, u32 num_pages);
 	void (*free)	(struct tmm *tmm, u32 *pages);
 	s32  (*map)	(struct tmm *tmm, struct pat_area area, u32 page_pa);
+	s32  (*map_n)	(struct tmm *tmm, struct pat_area *areas, u32 *page_pa,
+			 u32 n);
 	void (*clear)	(struct tmm *tmm, struct pat_area area);
 	void (*deinit)	(struct tmm *tmm);
 };
@@ -69,6 +71,25 @@ s32 tmm_map(struct tmm *tmm, struct pat_area area, u32 page_pa)
 	return -ENODEV;
 }
 
+/**
+ * Program the physical address translator for several areas at once.
+ * Falls back to one tmm_map() per area if the TMM cannot batch.
+ * @param areas array of n PAT areas
+ * @param page_pa array of n 16-byte aligned page list addresses
+ */
+static inline
+s32 tmm_map_n(struct tmm *tmm, struct pat_area *areas, u32 *page_pa, u32 n)
+{
+	s32 res = 0;
+	u32 i;
+
+	if (tmm && tmm->map_n && tmm->pvt)
+		return tmm->map_n(tmm, areas, page_pa, n);
+	for (i = 0; i < n && !res; i++)
+		res = tmm_map(tmm, areas[i], page_pa[i]);
+	return res;
+}
+
 /**
  * Clears the physical address translator.
  * @param area PAT area
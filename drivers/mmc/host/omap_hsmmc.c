@@ -30,6 +30,8 @@
 #include <linux/mmc/core.h>
 #include <linux/mmc/mmc.h>
 #include <linux/io.h>
+#include <linux/slab.h>
+#include <linux/scatterlist.h>
 #include <linux/semaphore.h>
 #include <linux/gpio.h>
 #include <linux/regulator/consumer.h>
@@ -128,6 +130,14 @@
 #define MMC_TIMEOUT_MS		20
 #define DRIVER_NAME		"mmci-omap-hs"
 
+/*
+ * SG entries per request where the DMA links one transfer per entry, and
+ * the size of the buffer that requests whose entries are not whole blocks
+ * are bounced through.
+ */
+#define OMAP_HSMMC_MAX_SEGS	16
+#define OMAP_HSMMC_BOUNCE_SIZE	SZ_64K
+
 /* Timeouts for entering power saving states on inactivity, msec */
 #define OMAP_MMC_DISABLED_TIMEOUT	100
 #define OMAP_MMC_SLEEP_TIMEOUT		1000
@@ -149,6 +159,16 @@
 #define OMAP_HSMMC_WRITE(base, reg, val) \
 	__raw_writel((val), (base) + OMAP_HSMMC_##reg)
 
+/*
+ * DMA resources of the next request, prepared by pre_req while the
+ * current one is transferred.
+ */
+struct omap_hsmmc_next {
+	unsigned int	dma_len;
+	int		dma_ch;
+	s32		cookie;
+};
+
 struct omap_hsmmc_host {
 	struct	device		*dev;
 	struct	mmc_host	*mmc;
@@ -173,7 +193,10 @@ struct omap_hsmmc_host {
 	spinlock_t		irq_lock; /* Prevent races with irq handler */
 	unsigned int		id;
 	unsigned int		dma_len;
-	unsigned int		dma_sg_idx;
+	struct scatterlist	*dma_sg;	/* data->sg or bounce_sg */
+	s32			dma_cookie;	/* host_cookie of dma_len */
+	char			*bounce_buf;
+	struct scatterlist	bounce_sg;
 	unsigned char		bus_mode;
 	unsigned char		power_mode;
 	u32			*buffer;
@@ -192,6 +215,7 @@ struct omap_hsmmc_host {
 	int			reqs_blocked;
 	int			use_reg;
 	int			req_in_progress;
+	struct omap_hsmmc_next	next_data;
 
 	struct	omap_mmc_platform_data	*pdata;
 };
@@ -939,6 +963,26 @@ omap_hsmmc_get_dma_dir(struct omap_hsmmc_host *host, struct mmc_data *data)
 		return DMA_FROM_DEVICE;
 }
 
+/*
+ * Unmap the data of a request that was not prepared by pre_req, copying
+ * it out of the bounce buffer if it went through it.
+ */
+static void omap_hsmmc_dma_unmap(struct omap_hsmmc_host *host,
+				 struct mmc_data *data)
+{
+	int dir = omap_hsmmc_get_dma_dir(host, data);
+
+	if (host->dma_sg != &host->bounce_sg) {
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len, dir);
+		return;
+	}
+
+	dma_unmap_sg(mmc_dev(host->mmc), &host->bounce_sg, 1, dir);
+	if (dir == DMA_FROM_DEVICE)
+		sg_copy_from_buffer(data->sg, data->sg_len, host->bounce_buf,
+				    host->bounce_sg.length);
+}
+
 static void omap_hsmmc_request_done(struct omap_hsmmc_host *host, struct mmc_request *mrq)
 {
 	int dma_ch;
@@ -1029,8 +1073,9 @@ static void omap_hsmmc_dma_cleanup(struct omap_hsmmc_host *host, int errno)
 	spin_unlock(&host->irq_lock);
 
 	if (host->use_dma && dma_ch != -1) {
-		dma_unmap_sg(mmc_dev(host->mmc), host->data->sg, host->dma_len,
-			omap_hsmmc_get_dma_dir(host, host->data));
+		/* Data prepared by pre_req is unmapped in post_req */
+		if (!host->data->host_cookie)
+			omap_hsmmc_dma_unmap(host, host->data);
 		omap_free_dma(dma_ch);
 	}
 	host->data = NULL;
@@ -1362,14 +1407,13 @@ static int omap_hsmmc_get_dma_sync_dev(struct omap_hsmmc_host *host,
 }
 
 static void omap_hsmmc_config_dma_params(struct omap_hsmmc_host *host,
-				       struct mmc_data *data,
+				       int dma_ch, struct mmc_data *data,
 				       struct scatterlist *sgl)
 {
-	int blksz, nblk, dma_ch;
+	int blksz, nblk;
 	int bindex = 0, cindex = 0;
 
-	dma_ch = host->dma_ch;
-	blksz = host->data->blksz;
+	blksz = data->blksz;
 	nblk = sg_dma_len(sgl) / blksz;
 	if (cpu_is_ti81xx()) {
 		bindex = 4;
@@ -1392,8 +1436,6 @@ static void omap_hsmmc_config_dma_params(struct omap_hsmmc_host *host,
 			blksz / 4, nblk, OMAP_DMA_SYNC_FRAME,
 			omap_hsmmc_get_dma_sync_dev(host, data),
 			!(data->flags & MMC_DATA_WRITE));
-
-	omap_start_dma(dma_ch);
 }
 
 /*
@@ -1414,17 +1456,9 @@ static void omap_hsmmc_dma_cb(int lch, u16 ch_status, void *cb_data)
 		return;
 	}
 
-	host->dma_sg_idx++;
-	if (host->dma_sg_idx < host->dma_len) {
-		/* Fire up the next transfer. */
-		omap_hsmmc_config_dma_params(host, data,
-					   data->sg + host->dma_sg_idx);
-		spin_unlock(&host->irq_lock);
-		return;
-	}
-
-	dma_unmap_sg(mmc_dev(host->mmc), data->sg, host->dma_len,
-		omap_hsmmc_get_dma_dir(host, data));
+	/* Data prepared by pre_req is unmapped in post_req */
+	if (!data->host_cookie)
+		omap_hsmmc_dma_unmap(host, data);
 
 	req_in_progress = host->req_in_progress;
 	dma_ch = host->dma_ch;
@@ -1442,46 +1476,184 @@ static void omap_hsmmc_dma_cb(int lch, u16 ch_status, void *cb_data)
 	}
 }
 
+/* Can each SG entry be moved as whole DMA frames of one block? */
+static bool omap_hsmmc_sg_aligned(struct mmc_data *data)
+{
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(data->sg, sg, data->sg_len, i)
+		if (sg->length % data->blksz)
+			return false;
+	return true;
+}
+
 /*
- * Routine to configure and start DMA for the MMC card
+ * Map the data of a request that is not prepared by pre_req.  Requests
+ * whose SG entries are not whole blocks (SDIO scatter requests) are
+ * bounced through one contiguous buffer.  Returns the number of mapped
+ * entries, with host->dma_sg set to the list they are in.
  */
-static int omap_hsmmc_start_dma_transfer(struct omap_hsmmc_host *host,
-					struct mmc_request *req)
+static int omap_hsmmc_dma_map(struct omap_hsmmc_host *host,
+			      struct mmc_data *data)
 {
-	int dma_ch = 0, ret = 0, i;
-	struct mmc_data *data = req->data;
+	unsigned int len = data->blksz * data->blocks;
+	int dir = omap_hsmmc_get_dma_dir(host, data);
 
-	/* Sanity check: all the SG entries must be aligned by block size. */
-	for (i = 0; i < data->sg_len; i++) {
-		struct scatterlist *sgl;
+	if (omap_hsmmc_sg_aligned(data)) {
+		host->dma_sg = data->sg;
+		return dma_map_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+				  dir);
+	}
 
-		sgl = data->sg + i;
-		if (sgl->length % data->blksz)
+	if (!host->bounce_buf || len > OMAP_HSMMC_BOUNCE_SIZE)
+		return 0;
+
+	if (dir == DMA_TO_DEVICE)
+		sg_copy_to_buffer(data->sg, data->sg_len, host->bounce_buf,
+				  len);
+	sg_init_one(&host->bounce_sg, host->bounce_buf, len);
+	host->dma_sg = &host->bounce_sg;
+	return dma_map_sg(mmc_dev(host->mmc), &host->bounce_sg, 1, dir);
+}
+
+/*
+ * Get a DMA channel and program it for the whole mapped SG list: the first
+ * entry in the channel itself, the others in PaRAM sets linked after it, so
+ * that the transfer runs to the end with a single completion interrupt.
+ */
+static int omap_hsmmc_dma_setup(struct omap_hsmmc_host *host,
+				struct mmc_data *data, struct scatterlist *sg,
+				int dma_len, int *dma_ch)
+{
+	int ret;
+
+	ret = omap_request_dma(omap_hsmmc_get_dma_sync_dev(host, data),
+			       "MMC/SD", omap_hsmmc_dma_cb, host, dma_ch);
+	if (ret != 0) {
+		dev_err(mmc_dev(host->mmc),
+			"%s: omap_request_dma() failed with %d\n",
+			mmc_hostname(host->mmc), ret);
+		return ret;
+	}
+
+	omap_hsmmc_config_dma_params(host, *dma_ch, data, sg);
+	if (dma_len > 1) {
+#ifdef CONFIG_ARCH_TI81XX
+		ret = omap_dma_link_sg(*dma_ch, sg, dma_len);
+#else
+		/* max_segs is 1 without SG linking */
+		ret = -EINVAL;
+#endif
+	}
+	if (ret) {
+		omap_free_dma(*dma_ch);
+		*dma_ch = -1;
+	}
+
+	return ret;
+}
+
+/*
+ * Map the SG list and get a DMA channel programmed for it.  Called from
+ * pre_req with @next to prepare the next request while the current one is
+ * transferred, and from the request itself with @next NULL, which picks up
+ * the prepared resources if the cookie matches.
+ */
+static int omap_hsmmc_pre_dma_transfer(struct omap_hsmmc_host *host,
+				       struct mmc_data *data,
+				       struct omap_hsmmc_next *next)
+{
+	int dma_ch = -1, dma_len, ret;
+
+	if (!next && data->host_cookie) {
+		if (data->host_cookie == host->next_data.cookie &&
+		    host->next_data.dma_ch != -1) {
+			host->dma_len = host->next_data.dma_len;
+			host->dma_ch = host->next_data.dma_ch;
+			host->dma_sg = data->sg;
+			host->dma_cookie = data->host_cookie;
+			host->next_data.dma_ch = -1;
+			return 0;
+		}
+		/*
+		 * A retried request whose prepared channel is already used:
+		 * the data stays mapped until post_req, so only a new channel
+		 * is needed.
+		 */
+		if (WARN_ON(data->host_cookie != host->dma_cookie))
 			return -EINVAL;
+		return omap_hsmmc_dma_setup(host, data, data->sg,
+					    host->dma_len, &host->dma_ch);
 	}
+
 	if ((data->blksz % 4) != 0)
 		/* REVISIT: The MMC buffer increments only when MSB is written.
 		 * Return error for blksz which is non multiple of four.
 		 */
 		return -EINVAL;
 
-	BUG_ON(host->dma_ch != -1);
+	if (next) {
+		int dir = omap_hsmmc_get_dma_dir(host, data);
 
-	ret = omap_request_dma(omap_hsmmc_get_dma_sync_dev(host, data),
-			       "MMC/SD", omap_hsmmc_dma_cb, host, &dma_ch);
-	if (ret != 0) {
-		dev_err(mmc_dev(host->mmc),
-			"%s: omap_request_dma() failed with %d\n",
-			mmc_hostname(host->mmc), ret);
+		/* bounced requests are left to the request itself */
+		if (!omap_hsmmc_sg_aligned(data))
+			return -EINVAL;
+
+		dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
+				     data->sg_len, dir);
+		if (!dma_len)
+			return -EINVAL;
+
+		ret = omap_hsmmc_dma_setup(host, data, data->sg, dma_len,
+					   &dma_ch);
+		if (ret) {
+			dma_unmap_sg(mmc_dev(host->mmc), data->sg,
+				     data->sg_len, dir);
+			return ret;
+		}
+
+		next->dma_len = dma_len;
+		next->dma_ch = dma_ch;
+		if (++next->cookie < 0)
+			next->cookie = 1;
+		data->host_cookie = next->cookie;
+		return 0;
+	}
+
+	dma_len = omap_hsmmc_dma_map(host, data);
+	if (!dma_len)
+		return -EINVAL;
+
+	ret = omap_hsmmc_dma_setup(host, data, host->dma_sg, dma_len,
+				   &dma_ch);
+	if (ret) {
+		omap_hsmmc_dma_unmap(host, data);
 		return ret;
 	}
 
-	host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
-			data->sg_len, omap_hsmmc_get_dma_dir(host, data));
+	host->dma_len = dma_len;
 	host->dma_ch = dma_ch;
-	host->dma_sg_idx = 0;
+	host->dma_cookie = 0;
 
-	omap_hsmmc_config_dma_params(host, data, data->sg);
+	return 0;
+}
+
+/*
+ * Routine to configure and start DMA for the MMC card
+ */
+static int omap_hsmmc_start_dma_transfer(struct omap_hsmmc_host *host,
+					struct mmc_request *req)
+{
+	int ret;
+
+	BUG_ON(host->dma_ch != -1);
+
+	ret = omap_hsmmc_pre_dma_transfer(host, req->data, NULL);
+	if (ret)
+		return ret;
+
+	omap_start_dma(host->dma_ch);
 
 	return 0;
 }
@@ -1559,6 +1731,41 @@ omap_hsmmc_prepare_data(struct omap_hsmmc_host *host, struct mmc_request *req)
 	return 0;
 }
 
+static void omap_hsmmc_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+				int err)
+{
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+
+	if (!host->use_dma || !data || !data->host_cookie)
+		return;
+
+	/* The request was prepared but never started */
+	if (data->host_cookie == host->next_data.cookie &&
+	    host->next_data.dma_ch != -1) {
+		omap_free_dma(host->next_data.dma_ch);
+		host->next_data.dma_ch = -1;
+	}
+
+	dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+		     omap_hsmmc_get_dma_dir(host, data));
+	data->host_cookie = 0;
+}
+
+static void omap_hsmmc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			       bool is_first_req)
+{
+	struct omap_hsmmc_host *host = mmc_priv(mmc);
+
+	if (!host->use_dma || !mrq->data)
+		return;
+
+	/* Left unprepared if the previous one was never started */
+	mrq->data->host_cookie = 0;
+	if (host->next_data.dma_ch == -1)
+		omap_hsmmc_pre_dma_transfer(host, mrq->data, &host->next_data);
+}
+
 /*
  * Request function. for read/write operation
  */
@@ -2009,6 +2216,8 @@ static int omap_hsmmc_disable_fclk(struct mmc_host *mmc, int lazy)
 static const struct mmc_host_ops omap_hsmmc_ops = {
 	.enable = omap_hsmmc_enable_fclk,
 	.disable = omap_hsmmc_disable_fclk,
+	.post_req = omap_hsmmc_post_req,
+	.pre_req = omap_hsmmc_pre_req,
 	.request = omap_hsmmc_request,
 	.set_ios = omap_hsmmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
@@ -2020,6 +2229,8 @@ static const struct mmc_host_ops omap_hsmmc_ops = {
 static const struct mmc_host_ops omap_hsmmc_ps_ops = {
 	.enable = omap_hsmmc_enable,
 	.disable = omap_hsmmc_disable,
+	.post_req = omap_hsmmc_post_req,
+	.pre_req = omap_hsmmc_pre_req,
 	.request = omap_hsmmc_request,
 	.set_ios = omap_hsmmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
@@ -2153,6 +2364,8 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 	host->use_dma	= 1;
 	host->dev->dma_mask = &pdata->dma_mask;
 	host->dma_ch	= -1;
+	host->next_data.dma_ch = -1;
+	host->next_data.cookie = 1;
 	host->irq	= irq;
 	host->id	= pdev->id;
 	host->slot_id	= 0;
@@ -2235,9 +2448,18 @@ static int __init omap_hsmmc_probe(struct platform_device *pdev)
 		clk_enable(host->dbclk);
 	}
 
-	/* Since we do only SG emulation, we can have as many segs
-	 * as we want. */
+	/*
+	 * On TI81xx the EDMA links one PaRAM set per SG entry, elsewhere a
+	 * request is a single DMA transfer.  Requests with SG entries that
+	 * are not whole blocks are bounced.
+	 */
 	mmc->max_segs = 1;
+#ifdef CONFIG_ARCH_TI81XX
+	if (cpu_is_ti81xx()) {
+		mmc->max_segs = OMAP_HSMMC_MAX_SEGS;
+		host->bounce_buf = kmalloc(OMAP_HSMMC_BOUNCE_SIZE, GFP_KERNEL);
+	}
+#endif
 
 	mmc->max_blk_size = 512;       /* Block Length at max can be 1024 */
 	mmc->max_blk_count = 0xFFFF;    /* No. of Blocks is 16 bits */
@@ -2352,6 +2574,7 @@ err_irq:
 		clk_put(host->dbclk);
 	}
 err1:
+	kfree(host->bounce_buf);
 	iounmap(host->base);
 	platform_set_drvdata(pdev, NULL);
 	mmc_free_host(mmc);
@@ -2388,6 +2611,7 @@ static int omap_hsmmc_remove(struct platform_device *pdev)
 			clk_put(host->dbclk);
 		}
 
+		kfree(host->bounce_buf);
 		mmc_free_host(host->mmc);
 		iounmap(host->base);
 		omap_hsmmc_gpio_free(pdev->dev.platform_data);
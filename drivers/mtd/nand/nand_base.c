@@ -42,6 +42,7 @@
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/nand.h>
 #include <linux/mtd/nand_ecc.h>
+#include <linux/mtd/nand_bch.h>
 #include <linux/interrupt.h>
 #include <linux/bitops.h>
 #include <linux/leds.h>
@@ -1457,7 +1458,7 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 	struct nand_chip *chip = mtd->priv;
 	struct mtd_ecc_stats stats;
 	int blkcheck = (1 << (chip->phys_erase_shift - chip->page_shift)) - 1;
-	int sndcmd = 1;
+	int sndcmd = 1, cacheread = 0;
 	int ret = 0;
 	uint32_t readlen = ops->len;
 	uint32_t oobreadlen = ops->ooblen;
@@ -1484,12 +1485,30 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 		aligned = (bytes == mtd->writesize);
 
 		/* Is the current page in the buffer ? */
-		if (realpage != chip->pagebuf || oob) {
+		if (realpage != chip->pagebuf || oob || cacheread) {
 			bufpoi = aligned ? buf : chip->buffers->databuf;
 
 			if (likely(sndcmd)) {
 				chip->cmdfunc(mtd, NAND_CMD_READ0, 0x00, page);
 				sndcmd = 0;
+				/*
+				 * Let the chip fetch the following pages of
+				 * this block while this one is transferred.
+				 */
+				cacheread = NAND_HAS_CACHEREAD(chip) &&
+					readlen > bytes &&
+					((page + 1) & blkcheck);
+				if (cacheread)
+					chip->cmdfunc(mtd, NAND_CMD_READCACHESEQ,
+						      -1, -1);
+			} else if (cacheread) {
+				/* Stop at the last page or the block end */
+				if (readlen <= mtd->writesize ||
+				    !((page + 1) & blkcheck))
+					cacheread = 0;
+				chip->cmdfunc(mtd, cacheread ?
+					      NAND_CMD_READCACHESEQ :
+					      NAND_CMD_READCACHEEND, -1, -1);
 			}
 
 			/* Now read the page into the buffer */
@@ -1565,10 +1584,15 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 		/* Check, if the chip supports auto page increment
 		 * or if we have hit a block boundary.
 		 */
-		if (!NAND_CANAUTOINCR(chip) || !(page & blkcheck))
+		if (!cacheread &&
+		    (!NAND_CANAUTOINCR(chip) || !(page & blkcheck)))
 			sndcmd = 1;
 	}
 
+	/* Terminate a cache read sequence cut short by an error */
+	if (cacheread)
+		chip->cmdfunc(mtd, NAND_CMD_READCACHEEND, -1, -1);
+
 	ops->retlen = ops->len - (size_t) readlen;
 	if (oob)
 		ops->oobretlen = ops->ooblen - oobreadlen;
@@ -3249,7 +3273,7 @@ int nand_scan_tail(struct mtd_info *mtd)
 	/*
 	 * If no default placement scheme is given, select an appropriate one
 	 */
-	if (!chip->ecc.layout) {
+	if (!chip->ecc.layout && (chip->ecc.mode != NAND_ECC_SOFT_BCH)) {
 		switch (mtd->oobsize) {
 		case 8:
 			chip->ecc.layout = &nand_oob_8;
@@ -3352,6 +3376,41 @@ int nand_scan_tail(struct mtd_info *mtd)
 		chip->ecc.bytes = 3;
 		break;
 
+	case NAND_ECC_SOFT_BCH:
+		if (!mtd_nand_has_bch()) {
+			printk(KERN_WARNING "CONFIG_MTD_NAND_ECC_BCH "
+			       "not enabled\n");
+			BUG();
+		}
+		chip->ecc.calculate = nand_bch_calculate_ecc;
+		chip->ecc.correct = nand_bch_correct_data;
+		chip->ecc.read_page = nand_read_page_swecc;
+		chip->ecc.read_subpage = nand_read_subpage;
+		chip->ecc.write_page = nand_write_page_swecc;
+		chip->ecc.read_page_raw = nand_read_page_raw;
+		chip->ecc.write_page_raw = nand_write_page_raw;
+		chip->ecc.read_oob = nand_read_oob_std;
+		chip->ecc.write_oob = nand_write_oob_std;
+		/*
+		 * Board driver should supply ecc.size and ecc.bytes values to
+		 * select how many bits are correctable; see nand_bch_init()
+		 * for details. Otherwise, default to 4 bits for large page
+		 * devices.
+		 */
+		if (!chip->ecc.size && (mtd->oobsize >= 64)) {
+			chip->ecc.size = 512;
+			chip->ecc.bytes = 7;
+		}
+		chip->ecc.priv = nand_bch_init(mtd,
+					       chip->ecc.size,
+					       chip->ecc.bytes,
+					       &chip->ecc.layout);
+		if (!chip->ecc.priv) {
+			printk(KERN_WARNING "BCH ECC initialization failed!\n");
+			BUG();
+		}
+		break;
+
 	case NAND_ECC_NONE:
 		printk(KERN_WARNING "NAND_ECC_NONE selected by board driver. "
 		       "This is not recommended !!\n");
@@ -3412,6 +3471,13 @@ int nand_scan_tail(struct mtd_info *mtd)
 	}
 	chip->subpagesize = mtd->writesize >> mtd->subpage_sft;
 
+	/*
+	 * Cache read is only available on large page chips, and only if
+	 * the page read does not issue read commands of its own.
+	 */
+	if (mtd->writesize <= 512 || chip->ecc.mode == NAND_ECC_HW_OOB_FIRST)
+		chip->options &= ~NAND_CACHEREAD;
+
 	/* Initialize state */
 	chip->state = FL_READY;
 
@@ -3514,6 +3580,9 @@ void nand_release(struct mtd_info *mtd)
 	if (!(chip->options & NAND_OWN_BUFFERS))
 		kfree(chip->buffers);
 
+	if (chip->ecc.mode == NAND_ECC_SOFT_BCH)
+		nand_bch_free((struct nand_bch_control *)chip->ecc.priv);
+
 	/* Free bad block descriptor memory */
 	if (chip->badblock_pattern && chip->badblock_pattern->options
 			& NAND_BBT_DYNAMICSTRUCT)
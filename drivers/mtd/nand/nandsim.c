@@ -34,6 +34,7 @@
 #include <linux/string.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/nand.h>
+#include <linux/mtd/nand_bch.h>
 #include <linux/mtd/partitions.h>
 #include <linux/delay.h>
 #include <linux/list.h>
@@ -108,6 +109,8 @@ static unsigned int rptwear = 0;
 static unsigned int overridesize = 0;
 static char *cache_file = NULL;
 static unsigned int bbt;
+static unsigned int bch;
+static unsigned int cacheread;
 
 module_param(first_id_byte,  uint, 0400);
 module_param(second_id_byte, uint, 0400);
@@ -132,6 +135,8 @@ module_param(rptwear,        uint, 0400);
 module_param(overridesize,   uint, 0400);
 module_param(cache_file,     charp, 0400);
 module_param(bbt,	     uint, 0400);
+module_param(bch,	     uint, 0400);
+module_param(cacheread,	     uint, 0400);
 
 MODULE_PARM_DESC(first_id_byte,  "The first byte returned by NAND Flash 'read ID' command (manufacturer ID)");
 MODULE_PARM_DESC(second_id_byte, "The second byte returned by NAND Flash 'read ID' command (chip ID)");
@@ -165,6 +170,9 @@ MODULE_PARM_DESC(overridesize,   "Specifies the NAND Flash size overriding the I
 				 " e.g. 5 means a size of 32 erase blocks");
 MODULE_PARM_DESC(cache_file,     "File to use to cache nand pages instead of memory");
 MODULE_PARM_DESC(bbt,		 "0 OOB, 1 BBT with marker in OOB, 2 BBT with marker in data area");
+MODULE_PARM_DESC(bch,		 "Enable BCH ecc and set how many bits should "
+				 "be correctable in 512-byte blocks");
+MODULE_PARM_DESC(cacheread,	 "Support sequential cache read (large pages)");
 
 /* The largest possible page size */
 #define NS_LARGEST_PAGE_SIZE	4096
@@ -361,6 +369,14 @@ struct nandsim {
 	void *file_buf;
 	struct page *held_pages[NS_MAX_HELD_PAGES];
 	int held_cnt;
+
+	/* Sequential cache read state */
+	struct {
+		int active;         /* a cache read sequence is in progress */
+		uint row;           /* the page in the output register */
+		uint32_t *op;       /* the read operation being continued */
+		uint16_t stateidx;  /* its data output state index */
+	} cache;
 };
 
 /*
@@ -1951,6 +1967,68 @@ static u_char ns_nand_read_byte(struct mtd_info *mtd)
 	return outb;
 }
 
+/*
+ * Sequential cache read. The first READCACHESEQ after a page read keeps that
+ * page in the output register; every following READCACHESEQ, and the final
+ * READCACHEEND, outputs the next page of the sequence.
+ */
+static void ns_cache_read(struct nandsim *ns, u_char byte)
+{
+	if (!(ns->options & OPT_LARGEPAGE) || !cacheread) {
+		NS_ERR("cache_read: unknown command %#x\n", (uint)byte);
+		return;
+	}
+
+	if (!ns->cache.active) {
+		if (byte != NAND_CMD_READCACHESEQ
+			|| NS_STATE(ns->state) != STATE_DATAOUT
+			|| ns->regs.command != NAND_CMD_READSTART) {
+			NS_ERR("cache_read: unexpected command %#x in %s\n",
+				(uint)byte, get_state_name(ns->state));
+			switch_to_ready_state(ns, NS_STATUS_FAILED(ns));
+			return;
+		}
+		NS_DBG("cache_read: start at page %d\n", ns->regs.row);
+		ns->cache.active   = 1;
+		ns->cache.row      = ns->regs.row;
+		ns->cache.op       = ns->op;
+		ns->cache.stateidx = ns->stateidx;
+		return;
+	}
+
+	if (ns->cache.row + 1 >= ns->geom.pgnum) {
+		NS_ERR("cache_read: no page after page %d\n", ns->cache.row);
+		ns->cache.active = 0;
+		switch_to_ready_state(ns, NS_STATUS_FAILED(ns));
+		return;
+	}
+	ns->cache.row += 1;
+	if (byte == NAND_CMD_READCACHEEND)
+		ns->cache.active = 0;
+
+	/* Restart the data output state of the read operation */
+	ns->op          = ns->cache.op;
+	ns->stateidx    = ns->cache.stateidx;
+	ns->state       = ns->op[ns->stateidx];
+	ns->nxstate     = ns->op[ns->stateidx + 1];
+	ns->npstates    = 0;
+	ns->regs.command = byte;
+	ns->regs.row    = ns->cache.row;
+	ns->regs.column = 0;
+	ns->regs.off    = 0;
+	ns->regs.count  = 0;
+	ns->regs.num    = ns->geom.pgszoob;
+
+	/*
+	 * The array read of this page was overlapped with the output of the
+	 * previous one, so only the transfer to the output register is left.
+	 */
+	read_page(ns, ns->geom.pgszoob);
+	NS_LOG("read page %d (cache)\n", ns->regs.row);
+	NS_UDELAY(input_cycle * ns->geom.pgsz / 1000 /
+		  (ns->busw == 8 ? 1 : 2));
+}
+
 static void ns_nand_write_byte(struct mtd_info *mtd, u_char byte)
 {
 	struct nandsim *ns = ((struct nand_chip *)mtd->priv)->priv;
@@ -1972,10 +2050,20 @@ static void ns_nand_write_byte(struct mtd_info *mtd, u_char byte)
 
 		if (byte == NAND_CMD_RESET) {
 			NS_LOG("reset chip\n");
+			ns->cache.active = 0;
 			switch_to_ready_state(ns, NS_STATUS_OK(ns));
 			return;
 		}
 
+		if (byte == NAND_CMD_READCACHESEQ ||
+		    byte == NAND_CMD_READCACHEEND) {
+			ns_cache_read(ns, byte);
+			return;
+		}
+		/* Any other command but a column change ends a cache read */
+		if (byte != NAND_CMD_RNDOUT && byte != NAND_CMD_RNDOUTSTART)
+			ns->cache.active = 0;
+
 		/* Check that the command byte is correct */
 		if (check_command(byte)) {
 			NS_ERR("write_byte: unknown command %#x\n", (uint)byte);
@@ -2266,6 +2354,8 @@ static int __init ns_init_module(void)
 	/* The NAND_SKIP_BBTSCAN option is necessary for 'overridesize' */
 	/* and 'badblocks' parameters to work */
 	chip->options   |= NAND_SKIP_BBTSCAN;
+	if (cacheread)
+		chip->options |= NAND_CACHEREAD;
 
 	switch (bbt) {
 	case 2:
@@ -2310,7 +2400,43 @@ static int __init ns_init_module(void)
 	if ((retval = parse_gravepages()) != 0)
 		goto error;
 
-	if ((retval = nand_scan(nsmtd, 1)) != 0) {
+	retval = nand_scan_ident(nsmtd, 1, NULL);
+	if (retval) {
+		NS_ERR("cannot scan NAND Simulator device\n");
+		if (retval > 0)
+			retval = -ENXIO;
+		goto error;
+	}
+
+	if (bch) {
+		unsigned int eccsteps, eccbytes;
+		if (!mtd_nand_has_bch()) {
+			NS_ERR("BCH ECC support is disabled\n");
+			retval = -EINVAL;
+			goto error;
+		}
+		/* use 512-byte ecc blocks */
+		eccsteps = nsmtd->writesize/512;
+		eccbytes = (bch*13+7)/8;
+		/* do not bother supporting small page devices */
+		if ((nsmtd->oobsize < 64) || !eccsteps) {
+			NS_ERR("bch not available on small page devices\n");
+			retval = -EINVAL;
+			goto error;
+		}
+		if ((eccbytes*eccsteps+2) > nsmtd->oobsize) {
+			NS_ERR("invalid bch value %u\n", bch);
+			retval = -EINVAL;
+			goto error;
+		}
+		chip->ecc.mode = NAND_ECC_SOFT_BCH;
+		chip->ecc.size = 512;
+		chip->ecc.bytes = eccbytes;
+		NS_INFO("using %u-bit/%u bytes BCH ECC\n", bch, chip->ecc.size);
+	}
+
+	retval = nand_scan_tail(nsmtd);
+	if (retval) {
 		NS_ERR("can't register NAND Simulator\n");
 		if (retval > 0)
 			retval = -ENXIO;
@@ -19,6 +19,7 @@
 #include <linux/mtd/partitions.h>
 #include <linux/io.h>
 #include <linux/slab.h>
+#include <linux/bch.h>
 
 #include <plat/dma.h>
 #include <plat/gpmc.h>
@@ -108,7 +109,10 @@
 static const char *part_probes[] = { "cmdlinepart", NULL };
 #endif
 
-int decode_bch(int select_4_8, unsigned char *ecc, unsigned int *err_loc);
+struct bch_control *omap_bch_alloc(int select_4_8);
+void omap_bch_free(struct bch_control *bch);
+int omap_decode_bch(struct bch_control *bch, int select_4_8,
+		    unsigned char *ecc, unsigned int *err_loc);
 
 /* oob info generated runtime depending on ecc algorithm and layout selected */
 static struct nand_ecclayout omap_oobinfo;
@@ -144,6 +148,9 @@ struct omap_nand_info {
 	u_char				*buf;
 	int				buf_len;
 	int				ecc_opt;
+	dma_addr_t			dma_addr;	/* transfer in flight */
+	unsigned int			dma_len;
+	struct bch_control		*bch;		/* BCH4 decoder */
 };
 
 /**
@@ -355,13 +362,17 @@ static void omap_nand_dma_cb(int lch, u16 ch_status, void *data)
 }
 
 /*
- * omap_nand_dma_transfer: configer and start dma transfer
+ * omap_nand_dma_start: configure and start a dma transfer
  * @mtd: MTD device structure
  * @addr: virtual address in RAM of source/destination
  * @len: number of data bytes to be transferred
  * @is_write: flag for read/write operation
+ *
+ * Returns 0 if the transfer was started, to be finished by
+ * omap_nand_dma_wait(), or a negative value if the buffer has to be
+ * copied by the cpu instead.
  */
-static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
+static int omap_nand_dma_start(struct mtd_info *mtd, void *addr,
 					unsigned int len, int is_write)
 {
 	struct omap_nand_info *info = container_of(mtd,
@@ -370,7 +381,6 @@ static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
 							DMA_FROM_DEVICE;
 	dma_addr_t dma_addr;
 	int ret;
-	unsigned long tim, limit;
 
 	/* The fifo depth is 64 bytes max.
 	 * But configure the FIFO-threahold to 32 to get a sync at each frame
@@ -383,10 +393,10 @@ static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
 
 		if (((size_t)addr & PAGE_MASK) !=
 			((size_t)(addr + len - 1) & PAGE_MASK))
-			goto out_copy;
+			return -EINVAL;
 		p1 = vmalloc_to_page(addr);
 		if (!p1)
-			goto out_copy;
+			return -EINVAL;
 		addr = page_address(p1) + ((size_t)addr & ~PAGE_MASK);
 	}
 
@@ -394,7 +404,7 @@ static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
 	if (dma_mapping_error(&info->pdev->dev, dma_addr)) {
 		dev_err(&info->pdev->dev,
 			"Couldn't DMA map a %d byte buffer\n", len);
-		goto out_copy;
+		return -ENOMEM;
 	}
 
 	if (is_write) {
@@ -417,15 +427,33 @@ static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
 	/*  configure and start prefetch transfer */
 	ret = gpmc_prefetch_enable(info->gpmc_cs,
 			PREFETCH_FIFOTHRESHOLD_MAX, 0x1, len, is_write);
-	if (ret)
+	if (ret) {
 		/* PFPW engine is busy, use cpu copy method */
-		goto out_copy;
+		dma_unmap_single(&info->pdev->dev, dma_addr, len, dir);
+		return ret;
+	}
 
+	info->iomode = is_write ? OMAP_NAND_IO_WRITE : OMAP_NAND_IO_READ;
+	info->dma_addr = dma_addr;
+	info->dma_len = len;
 	init_completion(&info->comp);
 
 	omap_start_dma(info->dma_ch);
+	return 0;
+}
+
+/*
+ * omap_nand_dma_wait: wait for the transfer started by omap_nand_dma_start
+ * @mtd: MTD device structure
+ */
+static void omap_nand_dma_wait(struct mtd_info *mtd)
+{
+	struct omap_nand_info *info = container_of(mtd,
+					struct omap_nand_info, mtd);
+	enum dma_data_direction dir = info->iomode == OMAP_NAND_IO_WRITE ?
+					DMA_TO_DEVICE : DMA_FROM_DEVICE;
+	unsigned long tim, limit;
 
-	/* setup and start DMA using dma_addr */
 	wait_for_completion(&info->comp);
 	tim = 0;
 	limit = (loops_per_jiffy * msecs_to_jiffies(OMAP_NAND_TIMEOUT_MS));
@@ -435,7 +463,26 @@ static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
 	/* disable and stop the PFPW engine */
 	gpmc_prefetch_reset(info->gpmc_cs);
 
-	dma_unmap_single(&info->pdev->dev, dma_addr, len, dir);
+	dma_unmap_single(&info->pdev->dev, info->dma_addr, info->dma_len, dir);
+}
+
+/*
+ * omap_nand_dma_transfer: configer and start dma transfer
+ * @mtd: MTD device structure
+ * @addr: virtual address in RAM of source/destination
+ * @len: number of data bytes to be transferred
+ * @is_write: flag for read/write operation
+ */
+static inline int omap_nand_dma_transfer(struct mtd_info *mtd, void *addr,
+					unsigned int len, int is_write)
+{
+	struct omap_nand_info *info = container_of(mtd,
+					struct omap_nand_info, mtd);
+
+	if (omap_nand_dma_start(mtd, addr, len, is_write))
+		goto out_copy;
+
+	omap_nand_dma_wait(mtd);
 	return 0;
 
 out_copy:
@@ -530,20 +577,19 @@ done:
 }
 
 /*
- * omap_read_buf_irq_pref - read data from NAND controller into buffer
+ * omap_nand_irq_start - start an irq driven prefetch read
  * @mtd: MTD device structure
  * @buf: buffer to store date
  * @len: number of bytes to read
+ *
+ * Returns 0 if the transfer was started, to be finished by
+ * omap_nand_irq_wait(), or a negative value if the prefetch engine is busy.
  */
-static void omap_read_buf_irq_pref(struct mtd_info *mtd, u_char *buf, int len)
+static int omap_nand_irq_start(struct mtd_info *mtd, u_char *buf, int len)
 {
 	struct omap_nand_info *info = container_of(mtd,
 						struct omap_nand_info, mtd);
-	int ret = 0;
-	if (len <= mtd->oobsize) {
-		omap_read_buf_pref(mtd, buf, len);
-		return;
-	}
+	int ret;
 
 	info->iomode = OMAP_NAND_IO_READ;
 	info->buf = buf;
@@ -553,19 +599,52 @@ static void omap_read_buf_irq_pref(struct mtd_info *mtd, u_char *buf, int len)
 	ret = gpmc_prefetch_enable(info->gpmc_cs,
 			PREFETCH_FIFOTHRESHOLD_MAX/2, 0x0, len, 0x0);
 	if (ret)
-		/* PFPW engine is busy, use cpu copy method */
-		goto out_copy;
+		return ret;
 
 	info->buf_len = len;
 	/* enable irq */
 	gpmc_cs_configure(info->gpmc_cs, GPMC_ENABLE_IRQ,
 		(GPMC_IRQ_FIFOEVENTENABLE | GPMC_IRQ_COUNT_EVENT));
+	return 0;
+}
+
+/*
+ * omap_nand_irq_wait - wait for the read started by omap_nand_irq_start
+ * @mtd: MTD device structure
+ */
+static void omap_nand_irq_wait(struct mtd_info *mtd)
+{
+	struct omap_nand_info *info = container_of(mtd,
+						struct omap_nand_info, mtd);
 
 	/* waiting for read to complete */
 	wait_for_completion(&info->comp);
 
 	/* disable and stop the PFPW engine */
 	gpmc_prefetch_reset(info->gpmc_cs);
+}
+
+/*
+ * omap_read_buf_irq_pref - read data from NAND controller into buffer
+ * @mtd: MTD device structure
+ * @buf: buffer to store date
+ * @len: number of bytes to read
+ */
+static void omap_read_buf_irq_pref(struct mtd_info *mtd, u_char *buf, int len)
+{
+	struct omap_nand_info *info = container_of(mtd,
+						struct omap_nand_info, mtd);
+
+	if (len <= mtd->oobsize) {
+		omap_read_buf_pref(mtd, buf, len);
+		return;
+	}
+
+	if (omap_nand_irq_start(mtd, buf, len))
+		/* PFPW engine is busy, use cpu copy method */
+		goto out_copy;
+
+	omap_nand_irq_wait(mtd);
 	return;
 
 out_copy:
@@ -575,6 +654,49 @@ out_copy:
 		omap_read_buf8(mtd, buf, len);
 }
 
+/*
+ * omap_read_buf_start - start reading data from NAND controller into buffer
+ * @mtd: MTD device structure
+ * @buf: buffer to store date
+ * @len: number of bytes to read
+ *
+ * Returns 1 if the read is left running in DMA or irq mode, to be finished
+ * by omap_read_buf_wait(), or 0 if it was done before returning.
+ */
+static int omap_read_buf_start(struct mtd_info *mtd, u_char *buf, int len)
+{
+	struct omap_nand_info *info = container_of(mtd,
+						struct omap_nand_info, mtd);
+	int ret = -EINVAL;
+
+	if (len > mtd->oobsize) {
+		if (info->pdata->xfer_type == NAND_OMAP_PREFETCH_DMA)
+			ret = omap_nand_dma_start(mtd, buf, len, 0x0);
+		else if (info->pdata->xfer_type == NAND_OMAP_PREFETCH_IRQ)
+			ret = omap_nand_irq_start(mtd, buf, len);
+	}
+	if (!ret)
+		return 1;
+
+	info->nand.read_buf(mtd, buf, len);
+	return 0;
+}
+
+/*
+ * omap_read_buf_wait - finish a read started by omap_read_buf_start
+ * @mtd: MTD device structure
+ */
+static void omap_read_buf_wait(struct mtd_info *mtd)
+{
+	struct omap_nand_info *info = container_of(mtd,
+						struct omap_nand_info, mtd);
+
+	if (info->pdata->xfer_type == NAND_OMAP_PREFETCH_DMA)
+		omap_nand_dma_wait(mtd);
+	else
+		omap_nand_irq_wait(mtd);
+}
+
 /*
  * omap_write_buf_irq_pref - write buffer to NAND controller
  * @mtd: MTD device structure
@@ -807,6 +929,13 @@ static int omap_compare_ecc(u8 *ecc_data1,	/* read from NAND memory */
  *
  * For BCH syndrome calculation and error correction using ELM module.
  * Syndrome calculation is surpressed for reading of non page aligned length
+ *
+ * In DMA and irq modes the data of each ecc step is read while the previous
+ * step is being corrected.  The syndrome of a step only depends on its own
+ * data and ecc bytes, so the BCH engine can be restarted for the next step
+ * as soon as the syndrome is read out.  A DMA read into a buffer that is not
+ * cache line aligned could discard corrections made to the neighbouring
+ * step, so such buffers are corrected after the whole page is read.
  */
 static int omap_read_page_bch(struct mtd_info *mtd, struct nand_chip *chip,
 				uint8_t *buf, int page)
@@ -821,17 +950,25 @@ static int omap_read_page_bch(struct mtd_info *mtd, struct nand_chip *chip,
 	uint8_t *oob = &chip->oob_poi[eccpos[0]];
 	uint32_t data_pos;
 	uint32_t oob_pos;
+	int correct = !(chip->ops.len & 0x7ff);
+	int overlap = correct && IS_ALIGNED((unsigned long)buf, L1_CACHE_BYTES);
+	int pending;
 
 	data_pos = 0;
 	/* oob area start */
 	oob_pos = (eccsize * eccsteps) + chip->ecc.layout->eccpos[0];
 
+	chip->ecc.hwctl(mtd, NAND_ECC_READ);
+	chip->cmdfunc(mtd, NAND_CMD_RNDOUT, data_pos, page);
+	pending = omap_read_buf_start(mtd, p, eccsize);
+
 	for (i = 0; eccsteps; eccsteps--, i += eccbytes, p += eccsize,
 				oob += eccbytes) {
-		chip->ecc.hwctl(mtd, NAND_ECC_READ);
-		/* read data */
-		chip->cmdfunc(mtd, NAND_CMD_RNDOUT, data_pos, page);
-		chip->read_buf(mtd, p, eccsize);
+		int stat;
+
+		/* wait for data */
+		if (pending)
+			omap_read_buf_wait(mtd);
 
 		/* read respective ecc from oob area */
 		chip->cmdfunc(mtd, NAND_CMD_RNDOUT, oob_pos, page);
@@ -842,8 +979,30 @@ static int omap_read_page_bch(struct mtd_info *mtd, struct nand_chip *chip,
 
 		data_pos += eccsize;
 		oob_pos += eccbytes;
+
+		/* start reading the next step */
+		if (eccsteps > 1) {
+			chip->ecc.hwctl(mtd, NAND_ECC_READ);
+			chip->cmdfunc(mtd, NAND_CMD_RNDOUT, data_pos, page);
+			pending = omap_read_buf_start(mtd, p + eccsize,
+						      eccsize);
+		}
+
+		if (!overlap)
+			continue;
+
+		/* and correct this one meanwhile */
+		memcpy(&ecc_code[i], oob, eccbytes);
+		stat = chip->ecc.correct(mtd, p, &ecc_code[i], &ecc_calc[i]);
+		if (stat < 0)
+			mtd->ecc_stats.failed++;
+		else
+			mtd->ecc_stats.corrected += stat;
 	}
 
+	if (overlap || !correct)
+		return 0;
+
 	for (i = 0; i < chip->ecc.total; i++)
 		ecc_code[i] = chip->oob_poi[eccpos[i]];
 
@@ -853,15 +1012,11 @@ static int omap_read_page_bch(struct mtd_info *mtd, struct nand_chip *chip,
 	for (i = 0 ; eccsteps; eccsteps--, i += eccbytes, p += eccsize) {
 		int stat;
 
-		if (!(chip->ops.len & 0x7ff)) {
-			stat = chip->ecc.correct(mtd, p, &ecc_code[i],
-					&ecc_calc[i]);
-
-			if (stat < 0)
-				mtd->ecc_stats.failed++;
-			else
-				mtd->ecc_stats.corrected += stat;
-		}
+		stat = chip->ecc.correct(mtd, p, &ecc_code[i], &ecc_calc[i]);
+		if (stat < 0)
+			mtd->ecc_stats.failed++;
+		else
+			mtd->ecc_stats.corrected += stat;
 	}
 	return 0;
 }
@@ -934,7 +1089,8 @@ static int omap_correct_data(struct mtd_info *mtd, u_char *dat,
 
 			count = 0;
 			if (eccflag == 1)
-				count = decode_bch(0, calc_ecc, err_loc);
+				count = omap_decode_bch(info->bch, 0,
+							calc_ecc, err_loc);
 
 			for (j = 0; j < count; j++) {
 				if (err_loc[j] < 4096)
@@ -1120,6 +1276,7 @@ static int __devinit omap_nand_probe(struct platform_device *pdev)
 	init_waitqueue_head(&info->controller.wq);
 
 	info->pdev = pdev;
+	info->pdata = pdata;
 
 	info->gpmc_cs		= pdata->cs;
 	info->phys_base		= pdata->phys_base;
@@ -1132,6 +1289,7 @@ static int __devinit omap_nand_probe(struct platform_device *pdev)
 
 	info->nand.options	= pdata->devsize;
 	info->nand.options	|= NAND_SKIP_BBTSCAN;
+	info->nand.options	|= pdata->options & NAND_CACHEREAD;
 
 	/* NAND write protect off */
 	gpmc_cs_configure(info->gpmc_cs, GPMC_CONFIG_WP, 0);
@@ -1231,6 +1389,11 @@ static int __devinit omap_nand_probe(struct platform_device *pdev)
 		if (pdata->ecc_opt == OMAP_ECC_BCH4_CODE_HW) {
 			info->nand.ecc.bytes    = 4*7;
 			info->nand.ecc.size     = 4*512;
+			info->bch = omap_bch_alloc(0);
+			if (!info->bch) {
+				err = -ENOMEM;
+				goto out_release_mem_region;
+			}
 		} else if (pdata->ecc_opt == OMAP_ECC_BCH8_CODE_HW) {
 			info->nand.ecc.bytes     = 14;
 			info->nand.ecc.size      = 512;
@@ -1327,6 +1490,7 @@ static int __devinit omap_nand_probe(struct platform_device *pdev)
 	return 0;
 
 out_release_mem_region:
+	omap_bch_free(info->bch);
 	release_mem_region(info->phys_base, NAND_IO_SIZE);
 out_free_info:
 	kfree(info);
@@ -1351,6 +1515,7 @@ static int omap_nand_remove(struct platform_device *pdev)
 	nand_release(&info->mtd);
 	iounmap(info->nand.IO_ADDR_R);
 	release_mem_region(info->phys_base, NAND_IO_SIZE);
+	omap_bch_free(info->bch);
 	kfree(&info->mtd);
 	return 0;
 }
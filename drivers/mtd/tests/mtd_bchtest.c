@@ -0,0 +1,293 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * Test and benchmark of the BCH library, and of BCH ecc on a NAND device.
+ *
+ * The library test encodes random 512 byte blocks, flips up to t random
+ * bits of data and ecc, and checks that decoding gives back the original
+ * block.  It then reports the encoding and decoding times per block.
+ *
+ * If "dev" is given, random data is also written to the first "ebcnt"
+ * eraseblocks of that MTD device and read back.  Loading nandsim with
+ * "bch=4 bitflips=4" makes it a test of the NAND core BCH ecc with random
+ * bitflips on every read.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/err.h>
+#include <linux/random.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/mtd/mtd.h>
+#include <linux/bch.h>
+
+#define PRINT_PREF KERN_INFO "mtd_bchtest: "
+
+#define BCH_BLOCK_SIZE	512
+
+static int iterations = 1000;
+module_param(iterations, int, S_IRUGO);
+MODULE_PARM_DESC(iterations, "Blocks decoded per correction capability");
+
+static int dev = -1;
+module_param(dev, int, S_IRUGO);
+MODULE_PARM_DESC(dev, "MTD device number to write and read back, if any");
+
+static int ebcnt = 8;
+module_param(ebcnt, int, S_IRUGO);
+MODULE_PARM_DESC(ebcnt, "Number of eraseblocks to test on the MTD device");
+
+#if defined(CONFIG_BCH) || defined(CONFIG_BCH_MODULE)
+
+static unsigned char data[BCH_BLOCK_SIZE];
+static unsigned char error_data[BCH_BLOCK_SIZE];
+
+/* Flip nerrs distinct bits among the nbits of data followed by ecc */
+static void inject_bit_errors(unsigned char *buf, unsigned char *ecc,
+			      unsigned int nbits, int nerrs)
+{
+	unsigned int pos[16];
+	int i, j;
+
+	for (i = 0; i < nerrs; i++) {
+		pos[i] = random32() % nbits;
+		for (j = 0; j < i; j++)
+			if (pos[j] == pos[i])
+				break;
+		if (j < i) {
+			i--;
+			continue;
+		}
+		if (pos[i] < BCH_BLOCK_SIZE * 8)
+			buf[pos[i] / 8] ^= 0x80 >> (pos[i] % 8);
+		else
+			ecc[pos[i] / 8 - BCH_BLOCK_SIZE] ^=
+				0x80 >> (pos[i] % 8);
+	}
+}
+
+static int bch_test(int t)
+{
+	struct bch_control *bch;
+	unsigned char ecc[32], error_ecc[32];
+	unsigned int errloc[16];
+	unsigned int nbits;
+	int i, j, count, nerrs, err = 0;
+	s64 enc_ns = 0, dec_ns = 0;
+	ktime_t start;
+
+	bch = init_bch(13, t, 0);
+	if (!bch) {
+		printk(PRINT_PREF "error: cannot initialize t=%d\n", t);
+		return -ENOMEM;
+	}
+	nbits = BCH_BLOCK_SIZE * 8 + bch->ecc_bits;
+
+	for (i = 0; i < iterations; i++) {
+		get_random_bytes(data, BCH_BLOCK_SIZE);
+
+		memset(ecc, 0, bch->ecc_bytes);
+		start = ktime_get();
+		encode_bch(bch, data, BCH_BLOCK_SIZE, ecc);
+		enc_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		memcpy(error_data, data, BCH_BLOCK_SIZE);
+		memcpy(error_ecc, ecc, bch->ecc_bytes);
+		nerrs = i % (t + 1);
+		inject_bit_errors(error_data, error_ecc, nbits, nerrs);
+
+		start = ktime_get();
+		count = decode_bch(bch, error_data, BCH_BLOCK_SIZE, error_ecc,
+				   NULL, NULL, errloc);
+		dec_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		if (count != nerrs) {
+			printk(KERN_ERR "mtd_bchtest: not ok - t=%d: %d errors"
+			       " injected, decoder returned %d\n", t, nerrs,
+			       count);
+			err = -EINVAL;
+			break;
+		}
+		for (j = 0; j < count; j++)
+			if (errloc[j] < BCH_BLOCK_SIZE * 8)
+				error_data[errloc[j] / 8] ^=
+					1 << (errloc[j] & 7);
+
+		if (memcmp(data, error_data, BCH_BLOCK_SIZE)) {
+			printk(KERN_ERR "mtd_bchtest: not ok - t=%d: "
+			       "data not corrected\n", t);
+			print_hex_dump(KERN_DEBUG, "", DUMP_PREFIX_OFFSET, 16,
+				       4, error_data, BCH_BLOCK_SIZE, false);
+			err = -EINVAL;
+			break;
+		}
+		cond_resched();
+	}
+
+	if (!err && iterations > 0)
+		printk(PRINT_PREF "ok - t=%d, %d blocks: encode %lld ns, "
+		       "decode %lld ns per block\n", t, iterations,
+		       div_s64(enc_ns, iterations),
+		       div_s64(dec_ns, iterations));
+
+	free_bch(bch);
+	return err;
+}
+
+#else
+
+static int bch_test(int t)
+{
+	return 0;
+}
+
+#endif
+
+static struct mtd_info *mtd;
+static unsigned char *writebuf;
+static unsigned char *readbuf;
+
+static int erase_eraseblock(int ebnum)
+{
+	int err;
+	struct erase_info ei;
+	loff_t addr = ebnum * mtd->erasesize;
+
+	memset(&ei, 0, sizeof(struct erase_info));
+	ei.mtd  = mtd;
+	ei.addr = addr;
+	ei.len  = mtd->erasesize;
+
+	err = mtd->erase(mtd, &ei);
+	if (err) {
+		printk(PRINT_PREF "error %d while erasing EB %d\n", err, ebnum);
+		return err;
+	}
+
+	if (ei.state == MTD_ERASE_FAILED) {
+		printk(PRINT_PREF "some erase error occurred at EB %d\n",
+		       ebnum);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int check_eraseblock(int ebnum)
+{
+	loff_t addr = ebnum * mtd->erasesize;
+	size_t retlen;
+	int err;
+
+	get_random_bytes(writebuf, mtd->erasesize);
+
+	err = erase_eraseblock(ebnum);
+	if (err)
+		return err;
+
+	err = mtd->write(mtd, addr, mtd->erasesize, &retlen, writebuf);
+	if (err || retlen != mtd->erasesize) {
+		printk(PRINT_PREF "error: write failed at %#llx\n",
+		       (long long)addr);
+		return err ? err : -EIO;
+	}
+
+	err = mtd->read(mtd, addr, mtd->erasesize, &retlen, readbuf);
+	if (err == -EUCLEAN)
+		err = 0;
+	if (err || retlen != mtd->erasesize) {
+		printk(PRINT_PREF "error: read failed at %#llx\n",
+		       (long long)addr);
+		return err ? err : -EIO;
+	}
+
+	if (memcmp(writebuf, readbuf, mtd->erasesize)) {
+		printk(PRINT_PREF "error: verify failed at %#llx\n",
+		       (long long)addr);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int mtd_test(void)
+{
+	struct mtd_ecc_stats stats;
+	int i, tested = 0, err = 0;
+
+	mtd = get_mtd_device(NULL, dev);
+	if (IS_ERR(mtd)) {
+		printk(PRINT_PREF "error: cannot get MTD device\n");
+		return PTR_ERR(mtd);
+	}
+
+	if (mtd->type != MTD_NANDFLASH) {
+		printk(PRINT_PREF "this test requires NAND flash\n");
+		goto out;
+	}
+
+	writebuf = kmalloc(mtd->erasesize, GFP_KERNEL);
+	readbuf = kmalloc(mtd->erasesize, GFP_KERNEL);
+	if (!writebuf || !readbuf) {
+		printk(PRINT_PREF "error: cannot allocate memory\n");
+		err = -ENOMEM;
+		goto out;
+	}
+
+	stats = mtd->ecc_stats;
+	for (i = 0; i < ebcnt && (uint64_t)i * mtd->erasesize < mtd->size;
+	     i++) {
+		if (mtd->block_isbad && mtd->block_isbad(mtd,
+				(loff_t)i * mtd->erasesize))
+			continue;
+		err = check_eraseblock(i);
+		if (err)
+			break;
+		tested++;
+		cond_resched();
+	}
+
+	printk(PRINT_PREF "MTD device %d: %d eraseblocks %s, %u bitflips "
+	       "corrected, %u uncorrectable\n", dev, tested,
+	       err ? "failed" : "ok",
+	       mtd->ecc_stats.corrected - stats.corrected,
+	       mtd->ecc_stats.failed - stats.failed);
+out:
+	kfree(readbuf);
+	kfree(writebuf);
+	put_mtd_device(mtd);
+	return err;
+}
+
+static int __init bch_test_init(void)
+{
+	int err;
+
+	srandom32(jiffies);
+
+	err = bch_test(4);
+	if (!err)
+		err = bch_test(8);
+	if (!err && dev >= 0)
+		err = mtd_test();
+
+	return err;
+}
+
+static void __exit bch_test_exit(void)
+{
+}
+
+module_init(bch_test_init);
+module_exit(bch_test_exit);
+
+MODULE_DESCRIPTION("BCH ECC test and benchmark module");
+MODULE_LICENSE("GPL");
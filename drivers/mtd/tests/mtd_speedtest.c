@@ -33,6 +33,11 @@ static int dev;
 module_param(dev, int, S_IRUGO);
 MODULE_PARM_DESC(dev, "MTD device number to use");
 
+static int count = 16;
+module_param(count, int, S_IRUGO);
+MODULE_PARM_DESC(count, "Number of pages per read in the multi-page read "
+			"test (default 16)");
+
 static struct mtd_info *mtd;
 static unsigned char *iobuf;
 static unsigned char *bbt;
@@ -259,6 +264,33 @@ static int read_eraseblock_by_2pages(int ebnum)
 	return err;
 }
 
+static int read_eraseblock_by_npages(int ebnum, int n)
+{
+	size_t read = 0, sz;
+	int i, err = 0;
+	loff_t addr = ebnum * mtd->erasesize;
+	void *buf = iobuf;
+
+	for (i = 0; i < pgcnt; i += n) {
+		sz = min(n, pgcnt - i) * pgsize;
+		err = mtd->read(mtd, addr, sz, &read, buf);
+		/* Ignore corrected ECC errors */
+		if (err == -EUCLEAN)
+			err = 0;
+		if (err || read != sz) {
+			printk(PRINT_PREF "error: read failed at %#llx\n",
+			       addr);
+			if (!err)
+				err = -EINVAL;
+			break;
+		}
+		addr += sz;
+		buf += sz;
+	}
+
+	return err;
+}
+
 static int is_block_bad(int ebnum)
 {
 	loff_t addr = ebnum * mtd->erasesize;
@@ -469,6 +501,24 @@ static int __init mtd_speedtest_init(void)
 	speed = calc_speed();
 	printk(PRINT_PREF "2 page read speed is %ld KiB/s\n", speed);
 
+	/* Read all eraseblocks, count pages at a time */
+	if (count > 2 && count < pgcnt) {
+		printk(PRINT_PREF "testing %d page read speed\n", count);
+		start_timing();
+		for (i = 0; i < ebcnt; ++i) {
+			if (bbt[i])
+				continue;
+			err = read_eraseblock_by_npages(i, count);
+			if (err)
+				goto out;
+			cond_resched();
+		}
+		stop_timing();
+		speed = calc_speed();
+		printk(PRINT_PREF "%d page read speed is %ld KiB/s\n", count,
+		       speed);
+	}
+
 	/* Erase all eraseblocks */
 	printk(PRINT_PREF "Testing erase speed\n");
 	start_timing();
@@ -49,6 +49,9 @@ do {								\
 } while (0)
 
 #define CPSW_POLL_WEIGHT	64
+#define CPSW_MAX_QUEUES		8	/* one per cpdma channel priority */
+#define CPSW_RX_PRIO_DESCS	16	/* rx buffers of each priority queue */
+#define CPSW_RX_HDR_SIZE	128	/* frame bytes copied to the skb head */
 #define CPSW_MIN_PACKET_SIZE	60
 #define CPSW_MAX_PACKET_SIZE	(1500 + 14 + 4 + 4)
 #define CPSW_USE_DEFAULT	0x0afbdce1  /**< Flag to indicate use of a
@@ -130,6 +133,12 @@ do {								\
 #define CPSW_CMINTMAX_INTVL	(1000 / CPSW_CMINTMIN_CNT)
 #define CPSW_CMINTMIN_INTVL	((1000 / CPSW_CMINTMAX_CNT) + 1)
 
+/* adaptive interrupt pacing: packet rate sampling period */
+#define CPSW_COAL_SAMPLE_MS	100
+/* with no poll for this long, the pacer falls back to its lowest level */
+#define CPSW_COAL_IDLE_MS	(2 * CPSW_COAL_SAMPLE_MS)
+#define CPSW_COAL_LEVELS	5
+
 #define switchcmd(__cmd__)	((__cmd__)->cmd_data.switchcmd)
 #define portcmd(__cmd__)	((__cmd__)->cmd_data.portcmd)
 #define priocmd(__cmd__)	((__cmd__)->cmd_data.priocmd)
@@ -345,8 +354,19 @@ struct cpsw_priv {
 	struct net_device		*ndev;
 	struct resource			*cpsw_res;
 	struct resource			*cpsw_ss_res;
-	struct napi_struct		napi;
-#define napi_to_priv(napi)	container_of(napi, struct cpsw_priv, napi)
+	/*
+	 * Queue n sends and receives on cpdma channel n; with fixed
+	 * priority the highest numbered channel is served first.
+	 */
+	struct cpsw_queue {
+		struct napi_struct	napi;
+		struct cpsw_priv	*priv;
+		int			index;
+	}				queues[CPSW_MAX_QUEUES];
+#define napi_to_queue(napi)	container_of(napi, struct cpsw_queue, napi)
+	int				num_queues;
+	/* queues being polled, interrupts are off until none is left */
+	atomic_t			napi_active;
 	struct device			*dev;
 	struct cpsw_platform_data	data;
 	struct cpsw_regs __iomem	*regs;
@@ -361,6 +381,20 @@ struct cpsw_priv {
 	u32				cpsw_version;
 	u32				msg_enable;
 	u32				coal_intvl;
+	/* adaptive interrupt pacing, see cpsw_coal_sample() */
+	struct cpsw_coal {
+		/* serializes sampling, idle decay and ethtool changes */
+		spinlock_t		lock;
+		struct timer_list	idle_timer;
+		bool			adaptive;
+		int			level;
+		atomic_t		pkts;
+		unsigned long		stamp;
+		u32			rate;
+		u32			irqs;
+		u32			changes;
+		u32			samples[CPSW_COAL_LEVELS];
+	}				coal;
 	u32				bus_freq_mhz;
 	struct net_device_stats		stats;
 	int				rx_packet_max;
@@ -377,7 +411,9 @@ struct cpsw_priv {
 #define slave(priv, idx)		((priv)->slaves + idx)
 
 	struct cpdma_ctlr		*dma;
-	struct cpdma_chan		*txch, *rxch;
+	struct cpdma_chan		*txch[CPSW_MAX_QUEUES];
+	struct cpdma_chan		*rxch[CPSW_MAX_QUEUES];
+	struct cpsw_rx_pool		*rx_pool[CPSW_MAX_QUEUES];
 	struct cpsw_ale			*ale;
 
 #ifdef CPSW_IRQ_QUIRK
@@ -621,12 +657,13 @@ void cpsw_tx_handler(void *token, int len, int status)
 	struct sk_buff		*skb = token;
 	struct net_device	*ndev = skb->dev;
 	struct cpsw_priv	*priv = netdev_priv(ndev);
+	u16			queue = skb_get_queue_mapping(skb);
 #ifdef CONFIG_PTP_1588_CLOCK_CPTS
 	u32			evt_high = 0;
 #endif
 
-	if (unlikely(netif_queue_stopped(ndev)))
-		netif_start_queue(ndev);
+	if (unlikely(__netif_subqueue_stopped(ndev, queue)))
+		netif_wake_subqueue(ndev, queue);
 
 #ifdef CONFIG_PTP_1588_CLOCK_CPTS
 	if ((priv->cpts_time->enable_timestamping) &&
@@ -644,12 +681,287 @@ void cpsw_tx_handler(void *token, int len, int status)
 	dev_kfree_skb_any(skb);
 }
 
+/*
+ * RX buffers are pages that stay DMA mapped while the interface is up.
+ * The head of a received frame is copied into a small skb and the rest
+ * is attached to it as a page fragment.  Once the stack has dropped its
+ * reference, the page goes back to the hardware with just a cache sync.
+ * A queue has twice as many buffers as rx descriptors and reuses them in
+ * FIFO order, so a page has usually been released by the time its buffer
+ * comes round again; one that is still held is replaced.
+ */
+struct cpsw_rx_buf {
+	struct page		*page;
+	dma_addr_t		dma;
+	struct cpsw_rx_pool	*pool;
+};
+
+struct cpsw_rx_pool {
+	spinlock_t		lock;
+	struct cpsw_priv	*priv;
+	struct device		*dev;		/* the one cpdma maps for */
+	int			queue;
+	int			len;		/* hardware buffer length */
+	int			order;
+	int			num;
+	/* ring of the buffers not queued to the hardware */
+	int			head, count;
+	/* descriptors that failed to be queued, retried from the poll */
+	atomic_t		missing;
+	struct cpsw_rx_buf	**free;
+	struct cpsw_rx_buf	bufs[0];
+};
+
+static struct cpsw_rx_pool *cpsw_rx_pool_create(struct cpsw_priv *priv,
+						int queue, int num)
+{
+	struct cpsw_rx_pool *pool;
+	int i;
+
+	pool = kzalloc(sizeof(*pool) + num * (sizeof(pool->bufs[0]) +
+					      sizeof(pool->free[0])),
+		       GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	spin_lock_init(&pool->lock);
+	pool->priv	= priv;
+	pool->dev	= &priv->pdev->dev;
+	pool->queue	= queue;
+	pool->len	= priv->rx_packet_max;
+	pool->order	= get_order(NET_IP_ALIGN + pool->len);
+	pool->num	= num;
+	pool->free	= (struct cpsw_rx_buf **)&pool->bufs[num];
+	for (i = 0; i < num; i++) {
+		pool->bufs[i].pool = pool;
+		pool->free[i] = &pool->bufs[i];
+	}
+	pool->count	= num;
+	atomic_set(&pool->missing, 0);
+
+	return pool;
+}
+
+static void cpsw_rx_buf_unmap(struct cpsw_rx_buf *buf)
+{
+	struct cpsw_rx_pool *pool = buf->pool;
+
+	dma_unmap_page(pool->dev, buf->dma, PAGE_SIZE << pool->order,
+		       DMA_FROM_DEVICE);
+	put_page(buf->page);
+	buf->page = NULL;
+}
+
+/* Release the pages of a pool, all its buffers must be off the hardware */
+static void cpsw_rx_pool_drain(struct cpsw_rx_pool *pool)
+{
+	int i;
+
+	WARN_ON(pool->count != pool->num);
+	for (i = 0; i < pool->num; i++)
+		if (pool->bufs[i].page)
+			cpsw_rx_buf_unmap(&pool->bufs[i]);
+	atomic_set(&pool->missing, 0);
+}
+
+static void cpsw_rx_pool_destroy(struct cpsw_rx_pool *pool)
+{
+	if (!pool)
+		return;
+
+	cpsw_rx_pool_drain(pool);
+	kfree(pool);
+}
+
+static void cpsw_rx_buf_put(struct cpsw_rx_buf *buf)
+{
+	struct cpsw_rx_pool *pool = buf->pool;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	pool->free[(pool->head + pool->count++) % pool->num] = buf;
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/* @buf could not be queued to the hardware, let the next poll retry */
+static void cpsw_rx_buf_defer(struct cpsw_rx_buf *buf)
+{
+	cpsw_rx_buf_put(buf);
+	atomic_inc(&buf->pool->missing);
+}
+
+/*
+ * Take the oldest free buffer of @pool and make it ready for the hardware,
+ * reusing its page if the stack is done with it.
+ */
+static struct cpsw_rx_buf *cpsw_rx_buf_get(struct cpsw_rx_pool *pool,
+					   gfp_t gfp)
+{
+	struct cpsw_rx_buf *buf;
+	struct page *page;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	if (!pool->count) {
+		spin_unlock_irqrestore(&pool->lock, flags);
+		return NULL;
+	}
+	buf = pool->free[pool->head];
+	pool->head = (pool->head + 1) % pool->num;
+	pool->count--;
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	if (likely(buf->page && page_count(buf->page) == 1)) {
+		dma_sync_single_for_device(pool->dev, buf->dma,
+					   NET_IP_ALIGN + pool->len,
+					   DMA_FROM_DEVICE);
+		return buf;
+	}
+
+	/* the stack holds a reference of its own to a page still in use */
+	if (buf->page)
+		cpsw_rx_buf_unmap(buf);
+
+	if (pool->order)
+		gfp |= __GFP_COMP;
+	page = alloc_pages(gfp | __GFP_COLD, pool->order);
+	if (!page)
+		goto fail;
+
+	buf->dma = dma_map_page(pool->dev, page, 0, PAGE_SIZE << pool->order,
+				DMA_FROM_DEVICE);
+	if (dma_mapping_error(pool->dev, buf->dma)) {
+		__free_pages(page, pool->order);
+		goto fail;
+	}
+	buf->page = page;
+	return buf;
+
+fail:
+	cpsw_rx_buf_put(buf);
+	return NULL;
+}
+
+/* Describe @buf to cpdma, which leaves the mapping alone */
+static void cpsw_rx_buf_desc(struct cpsw_rx_buf *buf, struct cpdma_buf *desc)
+{
+	desc->token	= buf;
+	desc->data	= NULL;
+	desc->dma	= buf->dma + NET_IP_ALIGN;
+	desc->len	= buf->pool->len;
+	desc->directed	= 0;
+}
+
+/* Build the skb for a frame of @len bytes received into @buf */
+static struct sk_buff *cpsw_rx_build_skb(struct net_device *ndev,
+					 struct cpsw_rx_buf *buf, int len)
+{
+	struct cpsw_rx_pool *pool = buf->pool;
+	void *data = page_address(buf->page) + NET_IP_ALIGN;
+	int hlen = min(len, CPSW_RX_HDR_SIZE);
+	struct sk_buff *skb;
+
+	dma_sync_single_for_cpu(pool->dev, buf->dma + NET_IP_ALIGN, len,
+				DMA_FROM_DEVICE);
+
+	skb = netdev_alloc_skb_ip_align(ndev, CPSW_RX_HDR_SIZE);
+	if (unlikely(!skb))
+		return NULL;
+
+	memcpy(skb_put(skb, hlen), data, hlen);
+	if (len > hlen) {
+		get_page(buf->page);
+		skb_add_rx_frag(skb, 0, buf->page, NET_IP_ALIGN + hlen,
+				len - hlen);
+	}
+
+	return skb;
+}
+
+/*
+ * Replacement RX buffers are handed back to the hardware in one batch at
+ * the end of each poll rather than one at a time from the RX handler.
+ * The stash is per CPU as with dual EMAC both interfaces poll the shared
+ * RX channels; it refills the channel being processed, and is only used
+ * while a poll has set that channel.
+ */
+struct cpsw_rx_refill {
+	struct cpdma_chan	*chan;
+	int			count;
+	struct cpdma_buf	bufs[CPSW_POLL_WEIGHT];
+};
+
+static DEFINE_PER_CPU(struct cpsw_rx_refill, cpsw_rx_refill);
+
+static void cpsw_rx_refill_flush(void)
+{
+	struct cpsw_rx_refill *refill = &__get_cpu_var(cpsw_rx_refill);
+	int i = 0, ret;
+
+	if (!refill->count)
+		return;
+
+	ret = cpdma_chan_submit_batch(refill->chan, refill->bufs,
+				      refill->count, GFP_ATOMIC);
+	if (ret > 0)
+		i = ret;
+
+	for (; i < refill->count; i++)
+		cpsw_rx_buf_defer(refill->bufs[i].token);
+	refill->count = 0;
+}
+
+static void cpsw_rx_refill_queue(struct cpsw_rx_buf *buf)
+{
+	struct cpsw_rx_pool *pool = buf->pool;
+	struct cpsw_rx_refill *refill;
+	struct cpdma_buf desc;
+	int ret;
+
+	refill = &get_cpu_var(cpsw_rx_refill);
+	if (unlikely(!refill->chan)) {
+		/* not called from a poll, nothing would flush the stash */
+		put_cpu_var(cpsw_rx_refill);
+		cpsw_rx_buf_desc(buf, &desc);
+		ret = cpdma_chan_submit_batch(pool->priv->rxch[pool->queue],
+					      &desc, 1, GFP_ATOMIC);
+		if (ret < 1)
+			cpsw_rx_buf_defer(buf);
+		return;
+	}
+
+	if (refill->count == ARRAY_SIZE(refill->bufs))
+		cpsw_rx_refill_flush();
+
+	cpsw_rx_buf_desc(buf, &refill->bufs[refill->count++]);
+	put_cpu_var(cpsw_rx_refill);
+}
+
+/* Retry the buffers of @pool that earlier refills failed to queue */
+static void cpsw_rx_pool_refill(struct cpsw_rx_pool *pool)
+{
+	struct cpsw_rx_buf *buf;
+	int i, n;
+
+	n = atomic_xchg(&pool->missing, 0);
+	for (i = 0; i < n; i++) {
+		buf = cpsw_rx_buf_get(pool, GFP_ATOMIC);
+		if (!buf) {
+			atomic_add(n - i, &pool->missing);
+			break;
+		}
+		cpsw_rx_refill_queue(buf);
+	}
+}
+
 void cpsw_rx_handler(void *token, int len, int status)
 {
-	struct sk_buff		*skb = token;
-	struct net_device	*ndev = skb->dev;
-	struct cpsw_priv	*priv = netdev_priv(ndev);
-	int			ret = 0;
+	struct cpsw_rx_buf	*buf = token, *new;
+	struct cpsw_rx_pool	*pool = buf->pool;
+	struct cpsw_priv	*priv = pool->priv;
+	struct net_device	*ndev = priv->ndev;
+	struct sk_buff		*skb;
+	u16			queue = pool->queue;
 #ifdef CONFIG_PTP_1588_CLOCK_CPTS
 	u32			evt_high = 0;
 #endif
@@ -658,24 +970,37 @@ void cpsw_rx_handler(void *token, int len, int status)
 	if (CPDMA_RX_SOURCE_PORT(status) == 1) {
 		ndev = priv->slaves[0].ndev;
 		priv = netdev_priv(ndev);
-		skb->dev = ndev;
 	} else if (CPDMA_RX_SOURCE_PORT(status) == 2) {
 		ndev = priv->slaves[1].ndev;
 		priv = netdev_priv(ndev);
-		skb->dev = ndev;
 	}
 #endif /* CONFIG_TI_CPSW_DUAL_EMAC */
 
-	/* free and bail if we are shutting down */
+	/* keep the buffer and bail if we are shutting down */
 	if (unlikely(!netif_running(ndev)) ||
 			unlikely(!netif_carrier_ok(ndev))) {
-		dev_kfree_skb_any(skb);
+		cpsw_rx_buf_put(buf);
 		return;
 	}
 
-	if (likely(status >= 0)) {
-		skb_put(skb, len);
+	if (unlikely(status < 0)) {
+		cpsw_rx_refill_queue(buf);
+		return;
+	}
 
+	/*
+	 * Without a buffer to take its place, drop the frame and give
+	 * @buf back to the hardware as it is.
+	 */
+	new = cpsw_rx_buf_get(pool, GFP_ATOMIC);
+	if (unlikely(!new)) {
+		priv->stats.rx_dropped++;
+		cpsw_rx_refill_queue(buf);
+		return;
+	}
+
+	skb = cpsw_rx_build_skb(ndev, buf, len);
+	if (likely(skb)) {
 #ifdef CONFIG_PTP_1588_CLOCK_CPTS
 		if ((priv->cpts_time->enable_timestamping) &&
 				((htons(*((unsigned short *)&skb->data[12])))
@@ -687,30 +1012,144 @@ void cpsw_rx_handler(void *token, int len, int status)
 #endif
 
 		skb->protocol = eth_type_trans(skb, ndev);
+		skb_record_rx_queue(skb, queue);
 		netif_receive_skb(skb);
 		priv->stats.rx_bytes += len;
 		priv->stats.rx_packets++;
-		skb = NULL;
+	} else {
+		priv->stats.rx_dropped++;
 	}
 
+	/* a page the stack now shares is replaced when the buffer is reused */
+	cpsw_rx_buf_put(buf);
+	cpsw_rx_refill_queue(new);
+}
+
+/*
+ * Adaptive pacing levels, from unpaced for lowest latency up to the
+ * longest interval the pacer reaches without dilating its 4us pulse.
+ * A level is picked when the packet rate exceeds its threshold.
+ */
+static const struct {
+	u32	usecs;
+	u32	min_rate;	/* packets per second */
+} cpsw_coal_levels[CPSW_COAL_LEVELS] = {
+	{ 0,		0 },
+	{ 50,		10000 },
+	{ 125,		30000 },
+	{ 250,		60000 },
+	{ CPSW_CMINTMAX_INTVL,	100000 },
+};
+
+static u32 cpsw_set_pacer(struct cpsw_priv *priv, u32 coal_intvl);
 
-	if (unlikely(!netif_running(ndev))) {
-		if (skb)
-			dev_kfree_skb_any(skb);
+/*
+ * Called from every poll: once per sampling period, work out the packet
+ * rate seen since the last sample and move the interrupt pacer one level
+ * towards the level matching it. Moving a single level at a time keeps
+ * short bursts from flipping the pacer between its extremes.
+ */
+static void cpsw_coal_sample(struct cpsw_priv *priv, int pkts)
+{
+	struct cpsw_coal *coal = &priv->coal;
+	unsigned long stamp, now = jiffies;
+	int level, target;
+	u32 rate, usecs;
+
+	atomic_add(pkts, &coal->pkts);
+	if (!coal->adaptive || time_before(now, coal->stamp +
+			msecs_to_jiffies(CPSW_COAL_SAMPLE_MS)))
+		return;
+
+	/* only one of the queues polled concurrently takes the sample */
+	spin_lock(&coal->lock);
+	stamp = coal->stamp;
+	if (!coal->adaptive || time_before(now, stamp +
+			msecs_to_jiffies(CPSW_COAL_SAMPLE_MS))) {
+		spin_unlock(&coal->lock);
 		return;
 	}
+	coal->stamp = now;
+
+	rate = atomic_xchg(&coal->pkts, 0) * HZ / max(now - stamp, 1UL);
+	for (target = CPSW_COAL_LEVELS - 1; target > 0; target--)
+		if (rate >= cpsw_coal_levels[target].min_rate)
+			break;
 
-	if (likely(!skb)) {
-		skb = netdev_alloc_skb_ip_align(ndev, priv->rx_packet_max);
-		if (WARN_ON(!skb))
-			return;
+	level = coal->level;
+	if (target > level)
+		level++;
+	else if (target < level)
+		level--;
 
-		ret = cpdma_chan_submit(priv->rxch, skb, skb->data,
-				skb_tailroom(skb), 0, GFP_KERNEL);
+	coal->rate = rate;
+	coal->samples[level]++;
+	if (level != coal->level) {
+		coal->level = level;
+		coal->changes++;
+		usecs = cpsw_coal_levels[level].usecs;
+		priv->coal_intvl = cpsw_set_pacer(priv, usecs);
 	}
 
-	WARN_ON(ret < 0);
+	if (level)
+		mod_timer(&coal->idle_timer,
+			  now + msecs_to_jiffies(CPSW_COAL_IDLE_MS));
+	spin_unlock(&coal->lock);
+}
+
+/*
+ * Polls stopped while the pacer was above its lowest level: the link
+ * went idle, so drop the pacing at once instead of holding back the
+ * interrupt of the next packet to arrive.
+ */
+static void cpsw_coal_idle(unsigned long data)
+{
+	struct cpsw_priv *priv = (struct cpsw_priv *)data;
+	struct cpsw_coal *coal = &priv->coal;
 
+	spin_lock(&coal->lock);
+	if (coal->adaptive && coal->level &&
+	    !time_before(jiffies, coal->stamp +
+			 msecs_to_jiffies(CPSW_COAL_IDLE_MS))) {
+		coal->level = 0;
+		coal->rate = 0;
+		coal->changes++;
+		priv->coal_intvl = cpsw_set_pacer(priv,
+						  cpsw_coal_levels[0].usecs);
+	}
+	spin_unlock(&coal->lock);
+}
+
+static void cpsw_coal_init(struct cpsw_priv *priv)
+{
+	spin_lock_init(&priv->coal.lock);
+	setup_timer(&priv->coal.idle_timer, cpsw_coal_idle,
+		    (unsigned long)priv);
+}
+
+/*
+ * Schedule NAPI for each queue with completed rx or tx descriptors.  From
+ * the interrupt handler (@irq set) at least one queue must be polled, as
+ * the last poll to complete turns interrupts back on.
+ */
+static void cpsw_schedule_queues(struct cpsw_priv *priv, bool irq)
+{
+	u32 pending;
+	int i;
+
+	pending = cpdma_ctlr_chan_pending(priv->dma);
+	if (irq && !(pending & (BIT(priv->num_queues) - 1)))
+		pending = BIT(0);
+
+	for (i = 0; i < priv->num_queues; i++) {
+		struct napi_struct *napi = &priv->queues[i].napi;
+
+		if (!(pending & BIT(i)) || !napi_schedule_prep(napi))
+			continue;
+
+		atomic_inc(&priv->napi_active);
+		__napi_schedule(napi);
+	}
 }
 
 static irqreturn_t cpsw_interrupt(int irq, void *dev_id)
@@ -722,17 +1161,19 @@ static irqreturn_t cpsw_interrupt(int irq, void *dev_id)
 #endif /* CONFIG_PTP_1588_CLOCK_CPTS */
 
 	if (likely(netif_running(priv->ndev))) {
+		priv->coal.irqs++;
 		cpsw_intr_disable(priv);
 		cpsw_disable_irq(priv);
-		napi_schedule(&priv->napi);
+		cpsw_schedule_queues(priv, true);
 	}
 
 #ifdef CONFIG_TI_CPSW_DUAL_EMAC
 	else if (likely(netif_running(priv->slaves[1].ndev))) {
 		struct cpsw_priv *priv_sl2 = netdev_priv(priv->slaves[1].ndev);
+		priv_sl2->coal.irqs++;
 		cpsw_intr_disable(priv_sl2);
 		cpsw_disable_irq(priv_sl2);
-		napi_schedule(&priv_sl2->napi);
+		cpsw_schedule_queues(priv_sl2, true);
 	}
 #endif /* CONFIG_TI_CPSW_DUAL_EMAC */
 
@@ -741,20 +1182,40 @@ static irqreturn_t cpsw_interrupt(int irq, void *dev_id)
 
 static int cpsw_poll(struct napi_struct *napi, int budget)
 {
-	struct cpsw_priv	*priv = napi_to_priv(napi);
+	struct cpsw_queue	*queue = napi_to_queue(napi);
+	struct cpsw_priv	*priv = queue->priv;
+	struct cpdma_chan	*rxch = priv->rxch[queue->index];
 	int			num_tx, num_rx;
 
-	num_tx = cpdma_chan_process(priv->txch, 128);
-	num_rx = cpdma_chan_process(priv->rxch, budget);
+	num_tx = cpdma_chan_process(priv->txch[queue->index], 128);
+
+	__get_cpu_var(cpsw_rx_refill).chan = rxch;
+	num_rx = cpdma_chan_process(rxch, budget);
+	if (unlikely(atomic_read(&priv->rx_pool[queue->index]->missing)))
+		cpsw_rx_pool_refill(priv->rx_pool[queue->index]);
+	cpsw_rx_refill_flush();
+	__get_cpu_var(cpsw_rx_refill).chan = NULL;
 
 	if (num_rx || num_tx)
-		msg(dbg, intr, "poll %d rx, %d tx pkts\n", num_rx, num_tx);
+		msg(dbg, intr, "poll queue %d: %d rx, %d tx pkts\n",
+		    queue->index, num_rx, num_tx);
+
+	cpsw_coal_sample(priv, num_rx + num_tx);
 
 	if (num_rx < budget) {
 		napi_complete(napi);
-		cpdma_ctlr_eoi(priv->dma);
-		cpsw_intr_enable(priv);
-		cpsw_enable_irq(priv);
+		if (atomic_dec_and_test(&priv->napi_active)) {
+			cpdma_ctlr_eoi(priv->dma);
+			cpsw_intr_enable(priv);
+			cpsw_enable_irq(priv);
+		}
+	} else {
+		/*
+		 * Interrupts stay off while this queue is busy, so look
+		 * for other queues to poll meanwhile: this keeps traffic
+		 * of other priorities from waiting behind a bulk transfer.
+		 */
+		cpsw_schedule_queues(priv, false);
 	}
 
 	return num_rx;
@@ -849,10 +1310,10 @@ static void cpsw_adjust_link(struct net_device *ndev)
 	if (link) {
 		netif_carrier_on(ndev);
 		if (netif_running(ndev))
-			netif_wake_queue(ndev);
+			netif_tx_wake_all_queues(ndev);
 	} else {
 		netif_carrier_off(ndev);
-		netif_stop_queue(ndev);
+		netif_tx_stop_all_queues(ndev);
 	}
 }
 
@@ -867,6 +1328,22 @@ static inline int __show_stat(char *buf, int maxlen, const char* name, u32 val)
 				leader + strlen(name), val);
 }
 
+/* Sum up the statistics of the @num channels of one direction */
+static void cpsw_get_dma_stats(struct cpdma_chan **chans, int num,
+			       struct cpdma_chan_stats *stats)
+{
+	struct cpdma_chan_stats	chan_stats;
+	u32			*sum = (u32 *)stats, *val = (u32 *)&chan_stats;
+	int			i, j;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < num; i++) {
+		cpdma_chan_get_stats(chans[i], &chan_stats);
+		for (j = 0; j < sizeof(*stats) / sizeof(u32); j++)
+			sum[j] += val[j];
+	}
+}
+
 static ssize_t cpsw_hw_stats_show(struct device *dev,
 				     struct device_attribute *attr,
 				     char *buf)
@@ -904,7 +1381,7 @@ static ssize_t cpsw_hw_stats_show(struct device *dev,
 	show_stat(netoctets);		show_stat(rxsofoverruns);
 	show_stat(rxmofoverruns);	show_stat(rxdmaoverruns);
 
-	cpdma_chan_get_stats(priv->rxch, &dma_stats);
+	cpsw_get_dma_stats(priv->rxch, priv->num_queues, &dma_stats);
 	len += snprintf(buf + len, SZ_4K - len, "\nRX DMA Statistics:\n");
 	show_dma_stat(head_enqueue);	show_dma_stat(tail_enqueue);
 	show_dma_stat(pad_enqueue);	show_dma_stat(misqueued);
@@ -912,8 +1389,10 @@ static ssize_t cpsw_hw_stats_show(struct device *dev,
 	show_dma_stat(runt_receive_buff); show_dma_stat(runt_transmit_buff);
 	show_dma_stat(empty_dequeue);	show_dma_stat(busy_dequeue);
 	show_dma_stat(good_dequeue);	show_dma_stat(teardown_dequeue);
+	show_dma_stat(batch_enqueue);	show_dma_stat(desc_alloc);
+	show_dma_stat(desc_pool_get);	show_dma_stat(desc_pool_put);
 
-	cpdma_chan_get_stats(priv->txch, &dma_stats);
+	cpsw_get_dma_stats(priv->txch, priv->num_queues, &dma_stats);
 	len += snprintf(buf + len, SZ_4K - len, "\nTX DMA Statistics:\n");
 	show_dma_stat(head_enqueue);	show_dma_stat(tail_enqueue);
 	show_dma_stat(pad_enqueue);	show_dma_stat(misqueued);
@@ -921,6 +1400,8 @@ static ssize_t cpsw_hw_stats_show(struct device *dev,
 	show_dma_stat(runt_receive_buff); show_dma_stat(runt_transmit_buff);
 	show_dma_stat(empty_dequeue);	show_dma_stat(busy_dequeue);
 	show_dma_stat(good_dequeue);	show_dma_stat(teardown_dequeue);
+	show_dma_stat(batch_enqueue);	show_dma_stat(desc_alloc);
+	show_dma_stat(desc_pool_get);	show_dma_stat(desc_pool_put);
 
 	return len;
 }
@@ -1043,6 +1524,27 @@ static void cpsw_slave_open(struct cpsw_slave *slave, struct cpsw_priv *priv)
 	}
 }
 
+/*
+ * Spread the eight packet priorities evenly over the rx channels, so
+ * that higher priorities land on higher numbered queues.
+ */
+static u32 cpsw_rx_chan_map(struct cpsw_priv *priv)
+{
+	u32 map = 0;
+	int pri;
+
+	for (pri = 0; pri < 8; pri++)
+		map |= (pri * priv->num_queues / 8) << (pri * 4);
+
+	return map;
+}
+
+/* Pick the tx queue, and so the cpdma channel priority, of a packet */
+static u16 cpsw_ndo_select_queue(struct net_device *ndev, struct sk_buff *skb)
+{
+	return min_t(u32, skb->priority, 7) * ndev->real_num_tx_queues / 8;
+}
+
 static void cpsw_init_host_port(struct cpsw_priv *priv)
 {
 	/* soft reset the controller and initialize ale */
@@ -1060,7 +1562,8 @@ static void cpsw_init_host_port(struct cpsw_priv *priv)
 
 	/* setup host port priority mapping */
 	__raw_writel(0x76543210, &priv->host_port_regs->cpdma_tx_pri_map);
-	__raw_writel(0, &priv->host_port_regs->cpdma_rx_chan_map);
+	__raw_writel(cpsw_rx_chan_map(priv),
+		     &priv->host_port_regs->cpdma_rx_chan_map);
 
 	cpsw_ale_control_set(priv->ale, priv->host_port,
 			     ALE_PORT_STATE, ALE_PORT_STATE_FORWARD);
@@ -1073,10 +1576,49 @@ static void cpsw_init_host_port(struct cpsw_priv *priv)
 #endif /* CONFIG_TI_CPSW_DUAL_EMAC */
 }
 
+/*
+ * Queue @num fresh RX buffers on rx queue @queue, a batch of descriptors
+ * at a time
+ */
+static int cpsw_rx_fill(struct cpsw_priv *priv, int queue, int num)
+{
+	struct cpdma_buf	bufs[16];
+	struct cpsw_rx_buf	*buf;
+	int			i, n, ret, done = 0;
+
+	while (done < num) {
+		for (n = 0; n < ARRAY_SIZE(bufs) && done + n < num; n++) {
+			buf = cpsw_rx_buf_get(priv->rx_pool[queue],
+					      GFP_KERNEL);
+			if (!buf)
+				break;
+
+			cpsw_rx_buf_desc(buf, &bufs[n]);
+		}
+		if (!n)
+			break;
+
+		ret = cpdma_chan_submit_batch(priv->rxch[queue], bufs, n,
+					      GFP_KERNEL);
+		for (i = max(ret, 0); i < n; i++)
+			cpsw_rx_buf_put(bufs[i].token);
+		if (ret < n) {
+			done += max(ret, 0);
+			break;
+		}
+		done += n;
+	}
+
+	/* whatever could not be queued now is retried from the poll */
+	atomic_add(num - done, &priv->rx_pool[queue]->missing);
+
+	return done;
+}
+
 static int cpsw_ndo_open(struct net_device *ndev)
 {
 	struct cpsw_priv *priv = netdev_priv(ndev);
-	int i, ret;
+	int i, q, ret;
 	u32 reg;
 
 #ifdef CONFIG_TI_CPSW_DUAL_EMAC
@@ -1147,22 +1689,13 @@ static int cpsw_ndo_open(struct net_device *ndev)
 				&priv->regs->stat_port_en);*/
 		__raw_writel(0x7, &priv->regs->stat_port_en);
 
-		if (WARN_ON(!priv->data.rx_descs))
-			priv->data.rx_descs = 128;
-
-		for (i = 0; i < priv->data.rx_descs; i++) {
-			struct sk_buff *skb;
-
-			ret = -ENOMEM;
-			skb = netdev_alloc_skb_ip_align(priv->ndev,
-							priv->rx_packet_max);
-			if (!skb)
-				break;
-			ret = cpdma_chan_submit(priv->rxch, skb, skb->data,
-					skb_tailroom(skb), 0, GFP_KERNEL);
-			if (WARN_ON(ret < 0))
-				break;
-		}
+		/*
+		 * Queue 0 carries the bulk of the traffic, the higher
+		 * priority queues get a few buffers each.
+		 */
+		i = cpsw_rx_fill(priv, 0, priv->data.rx_descs);
+		for (q = 1; q < priv->num_queues; q++)
+			i += cpsw_rx_fill(priv, q, CPSW_RX_PRIO_DESCS);
 		/* continue even if we didn't manage to submit
 		all receive descs */
 		msg(info, ifup, "submitted %d rx descriptors\n", i);
@@ -1171,16 +1704,31 @@ static int cpsw_ndo_open(struct net_device *ndev)
 #endif /* CONFIG_TI_CPSW_DUAL_EMAC */
 
 	/* Enable Interrupt pacing if configured */
-	if (priv->coal_intvl != 0) {
+	if (priv->coal.adaptive) {
+		priv->coal.stamp = jiffies;
+		atomic_set(&priv->coal.pkts, 0);
+		priv->coal_intvl = cpsw_set_pacer(priv,
+				cpsw_coal_levels[priv->coal.level].usecs);
+	} else if (priv->coal_intvl != 0) {
 		struct ethtool_coalesce coal;
 
+		coal.use_adaptive_rx_coalesce = 0;
 		coal.rx_coalesce_usecs = (priv->coal_intvl << 4);
 		cpsw_set_coalesce(ndev, &coal);
 	}
 
+	/*
+	 * napi_disable() in cpsw_ndo_stop() may have completed a queue
+	 * that was polling at full budget, without cpsw_poll() seeing it:
+	 * drop the stale count along with the IRQ disable it stands for.
+	 */
+	if (atomic_xchg(&priv->napi_active, 0))
+		cpsw_enable_irq(priv);
+
 	cpdma_ctlr_start(priv->dma);
 	cpsw_intr_enable(priv);
-	napi_enable(&priv->napi);
+	for (q = 0; q < priv->num_queues; q++)
+		napi_enable(&priv->queues[q].napi);
 	cpdma_ctlr_eoi(priv->dma);
 
 #ifdef CONFIG_PTP_1588_CLOCK_CPTS
@@ -1217,10 +1765,13 @@ static void cpsw_slave_stop(struct cpsw_slave *slave, struct cpsw_priv *priv)
 static int cpsw_ndo_stop(struct net_device *ndev)
 {
 	struct cpsw_priv *priv = netdev_priv(ndev);
+	int q;
 
 	msg(info, ifdown, "shutting down cpsw device\n");
-	netif_stop_queue(priv->ndev);
-	napi_disable(&priv->napi);
+	netif_tx_stop_all_queues(priv->ndev);
+	for (q = 0; q < priv->num_queues; q++)
+		napi_disable(&priv->queues[q].napi);
+	del_timer_sync(&priv->coal.idle_timer);
 	netif_carrier_off(priv->ndev);
 
 #ifdef CONFIG_TI_CPSW_DUAL_EMAC
@@ -1230,6 +1781,8 @@ static int cpsw_ndo_stop(struct net_device *ndev)
 		cpdma_ctlr_int_ctrl(priv->dma, false);
 		cpdma_ctlr_stop(priv->dma);
 		cpsw_ale_stop(priv->ale);
+		for (q = 0; q < priv->num_queues; q++)
+			cpsw_rx_pool_drain(priv->rx_pool[q]);
 #ifdef CONFIG_TI_CPSW_DUAL_EMAC
 	}
 #endif /* CONFIG_TI_CPSW_DUAL_EMAC */
@@ -1257,6 +1810,8 @@ static netdev_tx_t cpsw_ndo_start_xmit(struct sk_buff *skb,
 				       struct net_device *ndev)
 {
 	struct cpsw_priv *priv = netdev_priv(ndev);
+	u16 queue = skb_get_queue_mapping(skb);
+	struct cpdma_chan *txch = priv->txch[queue];
 	int ret;
 
 	ndev->trans_start = jiffies;
@@ -1269,14 +1824,14 @@ static netdev_tx_t cpsw_ndo_start_xmit(struct sk_buff *skb,
 
 #ifdef CONFIG_TI_CPSW_DUAL_EMAC
 	if (ndev == priv->slaves[0].ndev) {
-		ret = cpdma_chan_submit(priv->txch, skb, skb->data,
+		ret = cpdma_chan_submit(txch, skb, skb->data,
 				skb->len, 1, GFP_KERNEL);
 	} else {
-		ret = cpdma_chan_submit(priv->txch, skb, skb->data,
+		ret = cpdma_chan_submit(txch, skb, skb->data,
 				skb->len, 2, GFP_KERNEL);
 	}
 #else
-	ret = cpdma_chan_submit(priv->txch, skb, skb->data,
+	ret = cpdma_chan_submit(txch, skb, skb->data,
 				skb->len, 0, GFP_KERNEL);
 #endif /* CONFIG_TI_CPSW_DUAL_EMAC */
 
@@ -1288,7 +1843,7 @@ static netdev_tx_t cpsw_ndo_start_xmit(struct sk_buff *skb,
 	return NETDEV_TX_OK;
 fail:
 	priv->stats.tx_dropped++;
-	netif_stop_queue(ndev);
+	netif_stop_subqueue(ndev, queue);
 	return NETDEV_TX_BUSY;
 }
 
@@ -2487,13 +3042,16 @@ static int cpsw_ndo_set_mac_address(struct net_device *ndev, void *p)
 static void cpsw_ndo_tx_timeout(struct net_device *ndev)
 {
 	struct cpsw_priv *priv = netdev_priv(ndev);
+	int q;
 
 	msg(err, tx_err, "transmit timeout, restarting dma");
 	priv->stats.tx_errors++;
 	cpsw_intr_disable(priv);
 	cpdma_ctlr_int_ctrl(priv->dma, false);
-	cpdma_chan_stop(priv->txch);
-	cpdma_chan_start(priv->txch);
+	for (q = 0; q < priv->num_queues; q++) {
+		cpdma_chan_stop(priv->txch[q]);
+		cpdma_chan_start(priv->txch[q]);
+	}
 	cpdma_ctlr_int_ctrl(priv->dma, true);
 	cpsw_intr_enable(priv);
 	cpdma_ctlr_eoi(priv->dma);
@@ -2523,6 +3081,7 @@ static const struct net_device_ops cpsw_netdev_ops = {
 	.ndo_open		= cpsw_ndo_open,
 	.ndo_stop		= cpsw_ndo_stop,
 	.ndo_start_xmit		= cpsw_ndo_start_xmit,
+	.ndo_select_queue	= cpsw_ndo_select_queue,
 	.ndo_set_multicast_list	= cpsw_ndo_set_multicast_list,
 	.ndo_change_rx_flags	= cpsw_ndo_change_rx_flags,
 	.ndo_set_mac_address	= cpsw_ndo_set_mac_address,
@@ -2616,34 +3175,29 @@ static int cpsw_get_coalesce(struct net_device *ndev,
 	struct cpsw_priv *priv = netdev_priv(ndev);
 
 	coal->rx_coalesce_usecs = priv->coal_intvl;
+	coal->use_adaptive_rx_coalesce = priv->coal.adaptive;
 	return 0;
 
 }
 
-/**
- * cpsw_set_coalesce : Set interrupt coalesce settings for this device
- * @ndev : CPSW network adapter
- * @coal : ethtool coalesce settings structure
- *
- * Set interrupt coalesce parameters
- *
+/*
+ * Program the interrupt pacer for @coal_intvl usecs between interrupts,
+ * or turn it off for 0. Returns the interval actually programmed.
  */
-static int cpsw_set_coalesce(struct net_device *ndev,
-				struct ethtool_coalesce *coal)
+static u32 cpsw_set_pacer(struct cpsw_priv *priv, u32 coal_intvl)
 {
-	struct cpsw_priv *priv = netdev_priv(ndev);
 	u32 int_ctrl;
 	u32 num_interrupts = 0;
 	u32 prescale = 0;
 	u32 addnl_dvdr = 1;
-	u32 coal_intvl = 0;
-
-	if (!coal->rx_coalesce_usecs)
-		return -EINVAL;
-
-	coal_intvl = coal->rx_coalesce_usecs;
 
 	int_ctrl =  __raw_readl(&priv->ss_regs->int_control);
+	if (!coal_intvl) {
+		__raw_writel(int_ctrl & ~CPSW_INTPACEEN,
+			     &priv->ss_regs->int_control);
+		return 0;
+	}
+
 	prescale = priv->bus_freq_mhz * 4;
 
 	if (coal_intvl < CPSW_CMINTMIN_INTVL)
@@ -2677,12 +3231,114 @@ static int cpsw_set_coalesce(struct net_device *ndev,
 	__raw_writel(num_interrupts, &priv->ss_regs->rx_imax);
 	__raw_writel(num_interrupts, &priv->ss_regs->tx_imax);
 
-	printk(KERN_INFO "Set coalesce to %d usecs.\n", coal_intvl);
+	return coal_intvl;
+}
+
+/**
+ * cpsw_set_coalesce : Set interrupt coalesce settings for this device
+ * @ndev : CPSW network adapter
+ * @coal : ethtool coalesce settings structure
+ *
+ * Set interrupt coalesce parameters. With adaptive-rx on, the pacer is
+ * retuned from the observed packet rate and rx-usecs is ignored. A new
+ * rx-usecs alone turns adaptive-rx off.
+ *
+ */
+static int cpsw_set_coalesce(struct net_device *ndev,
+				struct ethtool_coalesce *coal)
+{
+	struct cpsw_priv *priv = netdev_priv(ndev);
+	struct cpsw_coal *state = &priv->coal;
+	bool adaptive = coal->use_adaptive_rx_coalesce;
+	u32 coal_intvl;
+
+	/*
+	 * ethtool passes back the adaptive-rx setting it read from us, so
+	 * "-C rx-usecs N" arrives with adaptive-rx still on: a changed
+	 * interval means a fixed one was asked for.
+	 */
+	if (adaptive && state->adaptive &&
+	    coal->rx_coalesce_usecs != priv->coal_intvl)
+		adaptive = false;
+
+	if (adaptive) {
+		/* polls may be sampling, restart them under the same lock */
+		spin_lock_bh(&state->lock);
+		state->level = 0;
+		state->rate = 0;
+		state->irqs = 0;
+		state->changes = 0;
+		memset(state->samples, 0, sizeof(state->samples));
+		atomic_set(&state->pkts, 0);
+		state->stamp = jiffies;
+		priv->coal_intvl = cpsw_set_pacer(priv,
+						  cpsw_coal_levels[0].usecs);
+		state->adaptive = true;
+		spin_unlock_bh(&state->lock);
+		printk(KERN_INFO "Set adaptive coalesce.\n");
+		return 0;
+	}
+
+	if (!coal->rx_coalesce_usecs)
+		return -EINVAL;
+
+	spin_lock_bh(&state->lock);
+	state->adaptive = false;
+	coal_intvl = cpsw_set_pacer(priv, coal->rx_coalesce_usecs);
 	priv->coal_intvl = coal_intvl;
+	spin_unlock_bh(&state->lock);
+	del_timer_sync(&state->idle_timer);
+
+	printk(KERN_INFO "Set coalesce to %d usecs.\n", coal_intvl);
 
 	return 0;
 }
 
+static const char cpsw_coal_stat_strings[][ETH_GSTRING_LEN] = {
+	"coal_adaptive", "coal_usecs", "coal_level", "coal_pkt_rate",
+	"coal_irqs", "coal_level_changes", "coal_samples_level0",
+	"coal_samples_level1", "coal_samples_level2", "coal_samples_level3",
+	"coal_samples_level4",
+};
+
+static int cpsw_get_sset_count(struct net_device *ndev, int sset)
+{
+	switch (sset) {
+	case ETH_SS_STATS:
+		return ARRAY_SIZE(cpsw_coal_stat_strings);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void cpsw_get_strings(struct net_device *ndev, u32 sset, u8 *data)
+{
+	if (sset == ETH_SS_STATS)
+		memcpy(data, cpsw_coal_stat_strings,
+		       sizeof(cpsw_coal_stat_strings));
+}
+
+/*
+ * Adaptive pacing state: the current interval, level and packet rate,
+ * and as history the number of sampling periods spent at each level.
+ */
+static void cpsw_get_ethtool_stats(struct net_device *ndev,
+				   struct ethtool_stats *stats, u64 *data)
+{
+	struct cpsw_priv *priv = netdev_priv(ndev);
+	struct cpsw_coal *coal = &priv->coal;
+	int i, n = 0;
+
+	data[n++] = coal->adaptive;
+	data[n++] = priv->coal_intvl;
+	data[n++] = coal->level;
+	data[n++] = coal->rate;
+	data[n++] = coal->irqs;
+	data[n++] = coal->changes;
+	for (i = 0; i < CPSW_COAL_LEVELS; i++)
+		data[n++] = coal->samples[i];
+}
+
 static const struct ethtool_ops cpsw_ethtool_ops = {
 	.get_drvinfo	= cpsw_get_drvinfo,
 	.get_msglevel	= cpsw_get_msglevel,
@@ -2692,6 +3348,9 @@ static const struct ethtool_ops cpsw_ethtool_ops = {
 	.set_settings	= cpsw_set_settings,
 	.get_coalesce	= cpsw_get_coalesce,
 	.set_coalesce	= cpsw_set_coalesce,
+	.get_sset_count	= cpsw_get_sset_count,
+	.get_strings	= cpsw_get_strings,
+	.get_ethtool_stats = cpsw_get_ethtool_stats,
 };
 
 static void cpsw_slave_init(struct cpsw_slave *slave, struct cpsw_priv *priv)
@@ -2722,6 +3381,34 @@ static inline void cpsw_deinit_slave_emac(struct cpsw_priv *priv)
 #define cpsw_deinit_slave_emac(priv)
 #endif
 
+static void __devinit cpsw_napi_add(struct cpsw_priv *priv)
+{
+	int i;
+
+	for (i = 0; i < priv->num_queues; i++) {
+		struct cpsw_queue *queue = &priv->queues[i];
+
+		queue->priv = priv;
+		queue->index = i;
+		netif_napi_add(priv->ndev, &queue->napi, cpsw_poll,
+			       CPSW_POLL_WEIGHT);
+	}
+	atomic_set(&priv->napi_active, 0);
+}
+
+static void cpsw_destroy_chans(struct cpsw_priv *priv)
+{
+	int i;
+
+	for (i = 0; i < priv->num_queues; i++) {
+		if (priv->txch[i])
+			cpdma_chan_destroy(priv->txch[i]);
+		if (priv->rxch[i])
+			cpdma_chan_destroy(priv->rxch[i]);
+		cpsw_rx_pool_destroy(priv->rx_pool[i]);
+	}
+}
+
 static int __devinit cpsw_probe(struct platform_device *pdev)
 {
 	struct cpsw_platform_data	*data = pdev->dev.platform_data;
@@ -2742,7 +3429,8 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 		return -ENODEV;
 	}
 
-	ndev = alloc_etherdev(sizeof(struct cpsw_priv));
+	ndev = alloc_etherdev_mq(sizeof(struct cpsw_priv), clamp_t(u32,
+				 data->channels, 1, CPSW_MAX_QUEUES));
 	if (!ndev) {
 		pr_err("cpsw: error allocating net_device\n");
 		return -ENOMEM;
@@ -2751,6 +3439,7 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 	platform_set_drvdata(pdev, ndev);
 	priv = netdev_priv(ndev);
 	spin_lock_init(&priv->lock);
+	cpsw_coal_init(priv);
 	priv->data = *data;
 	priv->pdev = pdev;
 	priv->ndev = ndev;
@@ -2875,6 +3564,11 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 			(u32 __force)priv->cpsw_res->start + data->bd_ram_ofs;
 	dma_params.desc_hw_addr		= data->hw_ram_addr ?
 				data->hw_ram_addr : dma_params.desc_mem_phys ;
+	if (data->ocmc_bd_ram_size) {
+		dma_params.desc_mem_phys	= data->ocmc_bd_ram_phys;
+		dma_params.desc_hw_addr		= data->ocmc_bd_ram_phys;
+		dma_params.desc_mem_size	= data->ocmc_bd_ram_size;
+	}
 
 	priv->dma = cpdma_ctlr_create(&dma_params);
 	if (!priv->dma) {
@@ -2883,15 +3577,32 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 		goto clean_iomap_ret;
 	}
 
-	priv->txch = cpdma_chan_create(priv->dma, tx_chan_num(0),
-				       cpsw_tx_handler);
-	priv->rxch = cpdma_chan_create(priv->dma, rx_chan_num(0),
-				       cpsw_rx_handler);
+	priv->num_queues = ndev->real_num_tx_queues;
+	for (i = 0; i < priv->num_queues; i++) {
+		priv->txch[i] = cpdma_chan_create(priv->dma, tx_chan_num(i),
+						  cpsw_tx_handler);
+		priv->rxch[i] = cpdma_chan_create(priv->dma, rx_chan_num(i),
+						  cpsw_rx_handler);
 
-	if (WARN_ON(!priv->txch || !priv->rxch)) {
-		dev_err(priv->dev, "error initializing dma channels\n");
-		ret = -ENOMEM;
-		goto clean_dma_ret;
+		if (WARN_ON(!priv->txch[i] || !priv->rxch[i])) {
+			dev_err(priv->dev, "error initializing dma channels\n");
+			ret = -ENOMEM;
+			goto clean_dma_ret;
+		}
+	}
+
+	if (WARN_ON(!priv->data.rx_descs))
+		priv->data.rx_descs = 128;
+
+	/* twice the rx descriptors of each queue, see struct cpsw_rx_pool */
+	for (i = 0; i < priv->num_queues; i++) {
+		priv->rx_pool[i] = cpsw_rx_pool_create(priv, i, 2 * (i ?
+				CPSW_RX_PRIO_DESCS : priv->data.rx_descs));
+		if (!priv->rx_pool[i]) {
+			dev_err(priv->dev, "error allocating rx buffers\n");
+			ret = -ENOMEM;
+			goto clean_dma_ret;
+		}
 	}
 
 	memset(&ale_params, 0, sizeof(ale_params));
@@ -2939,7 +3650,7 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 
 	ndev->netdev_ops = &cpsw_netdev_ops;
 	SET_ETHTOOL_OPS(ndev, &cpsw_ethtool_ops);
-	netif_napi_add(ndev, &priv->napi, cpsw_poll, CPSW_POLL_WEIGHT);
+	cpsw_napi_add(priv);
 
 	/* register the network device */
 	SET_NETDEV_DEV(ndev, &pdev->dev);
@@ -2957,7 +3668,7 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 	priv->slaves[0].ndev = ndev;
 	priv->emac_port = 0;
 
-	ndev = alloc_etherdev(sizeof(struct cpsw_priv));
+	ndev = alloc_etherdev_mq(sizeof(struct cpsw_priv), priv->num_queues);
 	if (!ndev) {
 		pr_err("cpsw: error allocating net_device\n");
 		return -ENOMEM;
@@ -2965,7 +3676,9 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 
 	priv_sl2 = netdev_priv(ndev);
 	spin_lock_init(&priv_sl2->lock);
+	cpsw_coal_init(priv_sl2);
 	priv_sl2->data = *data;
+	priv_sl2->data.rx_descs = priv->data.rx_descs;
 	priv_sl2->pdev = pdev;
 	priv_sl2->ndev = ndev;
 	priv_sl2->dev  = &ndev->dev;
@@ -3010,8 +3723,10 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 	priv_sl2->cpsw_ss_res = priv->cpsw_ss_res;
 	priv_sl2->ss_regs = priv->ss_regs;
 	priv_sl2->dma = priv->dma;
-	priv_sl2->txch = priv->txch;
-	priv_sl2->rxch = priv->rxch;
+	priv_sl2->num_queues = priv->num_queues;
+	memcpy(priv_sl2->txch, priv->txch, sizeof(priv->txch));
+	memcpy(priv_sl2->rxch, priv->rxch, sizeof(priv->rxch));
+	memcpy(priv_sl2->rx_pool, priv->rx_pool, sizeof(priv->rx_pool));
 	priv_sl2->ale = priv->ale;
 	priv_sl2->cpts_reg = priv->cpts_reg;
 	for (i = 0; i < priv->num_irqs; i++) {
@@ -3028,7 +3743,7 @@ static int __devinit cpsw_probe(struct platform_device *pdev)
 
 	ndev->netdev_ops = &cpsw_netdev_ops;
 	SET_ETHTOOL_OPS(ndev, &cpsw_ethtool_ops);
-	netif_napi_add(ndev, &priv_sl2->napi, cpsw_poll, CPSW_POLL_WEIGHT);
+	cpsw_napi_add(priv_sl2);
 
 	/* register the network device */
 	SET_NETDEV_DEV(ndev, &pdev->dev);
@@ -3050,8 +3765,7 @@ clean_irq_ret:
 clean_ale_ret:
 	cpsw_ale_destroy(priv->ale);
 clean_dma_ret:
-	cpdma_chan_destroy(priv->txch);
-	cpdma_chan_destroy(priv->rxch);
+	cpsw_destroy_chans(priv);
 	cpdma_ctlr_destroy(priv->dma);
 clean_iomap_ret:
 	iounmap(priv->regs);
@@ -3083,8 +3797,7 @@ static int __devexit cpsw_remove(struct platform_device *pdev)
 	for (i = 0; i < priv->num_irqs; i++)
 		free_irq(priv->irqs_table[i], priv);
 	cpsw_ale_destroy(priv->ale);
-	cpdma_chan_destroy(priv->txch);
-	cpdma_chan_destroy(priv->rxch);
+	cpsw_destroy_chans(priv);
 	cpdma_ctlr_destroy(priv->dma);
 	iounmap(priv->regs);
 	release_mem_region(priv->cpsw_res->start,
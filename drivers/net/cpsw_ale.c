@@ -18,6 +18,9 @@
 #include <linux/slab.h>
 #include <linux/err.h>
 #include <linux/io.h>
+#include <linux/etherdevice.h>
+#include <linux/jhash.h>
+#include <linux/bitmap.h>
 
 #include "cpsw_ale.h"
 
@@ -27,6 +30,8 @@
 				(addr)[3], (addr)[4], (addr)[5]
 #define ALE_ENTRY_BITS		68
 #define ALE_ENTRY_WORDS		DIV_ROUND_UP(ALE_ENTRY_BITS, 32)
+#define ALE_HASH_BITS		8
+#define ALE_HASH_SIZE		BIT(ALE_HASH_BITS)
 
 /* ALE Registers */
 #define ALE_IDVER		0x00
@@ -132,6 +137,95 @@ static inline void cpsw_ale_set_addr(u32 *ale_entry, u8 *addr)
 		cpsw_ale_set_field(ale_entry, 40 - 8*i, 8, addr[i]);
 }
 
+/*
+ * The driver keeps a copy of every entry it writes, hashed on address and
+ * vlan id (or on vlan id alone for vlan entries), so that looking an entry
+ * up or finding a free one costs no table reads over MMIO. Entries the
+ * switch learns or ages by itself are unicast only and are not in the
+ * shadow: unicast lookups that miss fall back to scanning the table, and a
+ * slot that looks free is read back before it is handed out.
+ */
+struct cpsw_ale_shadow {
+	u32			entry[ALE_ENTRY_WORDS];
+	struct hlist_node	node;
+};
+
+static u32 cpsw_ale_hash(u8 *addr, u16 vid)
+{
+	u32 key;
+
+	if (!addr)
+		key = jhash_1word(vid, ALE_TYPE_VLAN);
+	else
+		key = jhash(addr, 6, vid);
+
+	return key & (ALE_HASH_SIZE - 1);
+}
+
+static u32 cpsw_ale_hash_entry(u32 *ale_entry)
+{
+	u8 addr[6];
+	int type = cpsw_ale_get_entry_type(ale_entry);
+	u16 vid = cpsw_ale_get_vlan_id(ale_entry);
+
+	if (type == ALE_TYPE_VLAN)
+		return cpsw_ale_hash(NULL, vid);
+
+	cpsw_ale_get_addr(ale_entry, addr);
+	return cpsw_ale_hash(addr, vid);
+}
+
+/* Whether the switch may age @ale_entry out by itself */
+static bool cpsw_ale_entry_ageable(u32 *ale_entry)
+{
+	int type = cpsw_ale_get_entry_type(ale_entry);
+
+	if (type != ALE_TYPE_ADDR && type != ALE_TYPE_VLAN_ADDR)
+		return false;
+	if (cpsw_ale_get_mcast(ale_entry))
+		return false;
+
+	type = cpsw_ale_get_ucast_type(ale_entry);
+	return type != ALE_UCAST_PERSISTANT && type != ALE_UCAST_OUI;
+}
+
+static void cpsw_ale_shadow_update(struct cpsw_ale *ale, int idx,
+				   u32 *ale_entry)
+{
+	struct cpsw_ale_shadow *shadow = &ale->shadow[idx];
+
+	if (!hlist_unhashed(&shadow->node))
+		hlist_del_init(&shadow->node);
+
+	memset(shadow->entry, 0, sizeof(shadow->entry));
+	if (cpsw_ale_get_entry_type(ale_entry) == ALE_TYPE_FREE) {
+		set_bit(idx, ale->free_map);
+		return;
+	}
+
+	/* learnt entries written back by a flush are left to the switch */
+	clear_bit(idx, ale->free_map);
+	if (cpsw_ale_entry_ageable(ale_entry))
+		return;
+
+	memcpy(shadow->entry, ale_entry, sizeof(shadow->entry));
+	hlist_add_head(&shadow->node,
+		       &ale->hash[cpsw_ale_hash_entry(ale_entry)]);
+}
+
+/* Forget all entries, after the table has been cleared */
+static void cpsw_ale_shadow_reset(struct cpsw_ale *ale)
+{
+	int idx;
+
+	memset(ale->shadow, 0, ale->ale_entries * sizeof(*ale->shadow));
+	for (idx = 0; idx < ale->ale_entries; idx++)
+		INIT_HLIST_NODE(&ale->shadow[idx].node);
+	for (idx = 0; idx < ALE_HASH_SIZE; idx++)
+		INIT_HLIST_HEAD(&ale->hash[idx]);
+	bitmap_fill(ale->free_map, ale->ale_entries);
+}
+
 static int cpsw_ale_read(struct cpsw_ale *ale, int idx, u32 *ale_entry)
 {
 	int i;
@@ -157,14 +251,36 @@ static int cpsw_ale_write(struct cpsw_ale *ale, int idx, u32 *ale_entry)
 
 	__raw_writel(idx | ALE_TABLE_WRITE, ale->ale_regs + ALE_TABLE_CONTROL);
 
+	cpsw_ale_shadow_update(ale, idx, ale_entry);
 	return idx;
 }
 
-int cpsw_ale_match_addr(struct cpsw_ale *ale, u8* addr, u16 vid)
+/* The lookups, like all table accesses, run under ale->lock */
+static int __cpsw_ale_match_addr(struct cpsw_ale *ale, u8 *addr, u16 vid)
 {
 	u32 ale_entry[ALE_ENTRY_WORDS];
+	struct cpsw_ale_shadow *shadow;
+	struct hlist_node *node;
 	int type, idx;
 
+	hlist_for_each_entry(shadow, node,
+			     &ale->hash[cpsw_ale_hash(addr, vid)], node) {
+		u8 entry_addr[6];
+
+		type = cpsw_ale_get_entry_type(shadow->entry);
+		if (type != ALE_TYPE_ADDR && type != ALE_TYPE_VLAN_ADDR)
+			continue;
+		if (cpsw_ale_get_vlan_id(shadow->entry) != vid)
+			continue;
+		cpsw_ale_get_addr(shadow->entry, entry_addr);
+		if (memcmp(entry_addr, addr, 6) == 0)
+			return shadow - ale->shadow;
+	}
+
+	/* only unicast entries are ever added behind our back */
+	if (is_multicast_ether_addr(addr))
+		return -ENOENT;
+
 	for (idx = 0; idx < ale->ale_entries; idx++) {
 		u8 entry_addr[6];
 
@@ -181,51 +297,86 @@ int cpsw_ale_match_addr(struct cpsw_ale *ale, u8* addr, u16 vid)
 	return -ENOENT;
 }
 
-int cpsw_ale_match_vlan(struct cpsw_ale *ale, u16 vid)
+static int __cpsw_ale_match_vlan(struct cpsw_ale *ale, u16 vid)
 {
-	u32 ale_entry[ALE_ENTRY_WORDS];
-	int type, idx;
+	struct cpsw_ale_shadow *shadow;
+	struct hlist_node *node;
+	int type;
 
-	for (idx = 0; idx < ale->ale_entries; idx++) {
-		cpsw_ale_read(ale, idx, ale_entry);
-		type = cpsw_ale_get_entry_type(ale_entry);
+	hlist_for_each_entry(shadow, node,
+			     &ale->hash[cpsw_ale_hash(NULL, vid)], node) {
+		type = cpsw_ale_get_entry_type(shadow->entry);
 		if (type != ALE_TYPE_VLAN)
 			continue;
-		if (cpsw_ale_get_vlan_id(ale_entry) == vid)
-			return idx;
+		if (cpsw_ale_get_vlan_id(shadow->entry) == vid)
+			return shadow - ale->shadow;
 	}
 	return -ENOENT;
 }
 
+int cpsw_ale_match_addr(struct cpsw_ale *ale, u8 *addr, u16 vid)
+{
+	int idx;
+
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_addr(ale, addr, vid);
+	spin_unlock_bh(&ale->lock);
+	return idx;
+}
+
+int cpsw_ale_match_vlan(struct cpsw_ale *ale, u16 vid)
+{
+	int idx;
+
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_vlan(ale, vid);
+	spin_unlock_bh(&ale->lock);
+	return idx;
+}
+
 static int cpsw_ale_match_free(struct cpsw_ale *ale)
 {
 	u32 ale_entry[ALE_ENTRY_WORDS];
 	int type, idx;
+	bool rescanned = false;
 
-	for (idx = 0; idx < ale->ale_entries; idx++) {
-		cpsw_ale_read(ale, idx, ale_entry);
-		type = cpsw_ale_get_entry_type(ale_entry);
-		if (type == ALE_TYPE_FREE)
-			return idx;
+	for (;;) {
+		idx = find_first_bit(ale->free_map, ale->ale_entries);
+		if (idx < ale->ale_entries) {
+			/* the switch may have learnt an address here */
+			cpsw_ale_read(ale, idx, ale_entry);
+			type = cpsw_ale_get_entry_type(ale_entry);
+			if (type == ALE_TYPE_FREE)
+				return idx;
+			clear_bit(idx, ale->free_map);
+			continue;
+		}
+
+		if (rescanned)
+			return -ENOENT;
+
+		/* learnt entries may have aged out since, look again */
+		for (idx = 0; idx < ale->ale_entries; idx++) {
+			cpsw_ale_read(ale, idx, ale_entry);
+			type = cpsw_ale_get_entry_type(ale_entry);
+			if (type == ALE_TYPE_FREE)
+				set_bit(idx, ale->free_map);
+		}
+		rescanned = true;
 	}
-	return -ENOENT;
 }
 
 static int cpsw_ale_find_ageable(struct cpsw_ale *ale)
 {
 	u32 ale_entry[ALE_ENTRY_WORDS];
-	int type, idx;
+	int idx;
 
 	for (idx = 0; idx < ale->ale_entries; idx++) {
-		cpsw_ale_read(ale, idx, ale_entry);
-		type = cpsw_ale_get_entry_type(ale_entry);
-		if (type != ALE_TYPE_ADDR && type != ALE_TYPE_VLAN_ADDR)
-			continue;
-		if (cpsw_ale_get_mcast(ale_entry))
+		/* entries in the shadow are never ageable */
+		if (!hlist_unhashed(&ale->shadow[idx].node))
 			continue;
-		type = cpsw_ale_get_ucast_type(ale_entry);
-		if (type != ALE_UCAST_PERSISTANT &&
-		    type != ALE_UCAST_OUI)
+		cpsw_ale_read(ale, idx, ale_entry);
+		if (cpsw_ale_entry_ageable(ale_entry))
 			return idx;
 	}
 	return -ENOENT;
@@ -253,8 +404,10 @@ int cpsw_ale_flush_multicast(struct cpsw_ale *ale, int port_mask)
 	u32 ale_entry[ALE_ENTRY_WORDS];
 	int ret, idx;
 
+	spin_lock_bh(&ale->lock);
+	/* multicast entries are only ever written by us, see the shadow */
 	for (idx = 0; idx < ale->ale_entries; idx++) {
-		cpsw_ale_read(ale, idx, ale_entry);
+		memcpy(ale_entry, ale->shadow[idx].entry, sizeof(ale_entry));
 		ret = cpsw_ale_get_entry_type(ale_entry);
 		if (ret != ALE_TYPE_ADDR && ret != ALE_TYPE_VLAN_ADDR)
 			continue;
@@ -263,12 +416,15 @@ int cpsw_ale_flush_multicast(struct cpsw_ale *ale, int port_mask)
 			u8 addr[6];
 
 			cpsw_ale_get_addr(ale_entry, addr);
-			if (!cpsw_ale_is_broadcast(addr))
-				cpsw_ale_flush_mcast(ale, ale_entry, port_mask);
-		}
+			if (cpsw_ale_is_broadcast(addr))
+				continue;
 
-		cpsw_ale_write(ale, idx, ale_entry);
+			cpsw_ale_read(ale, idx, ale_entry);
+			cpsw_ale_flush_mcast(ale, ale_entry, port_mask);
+			cpsw_ale_write(ale, idx, ale_entry);
+		}
 	}
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -288,6 +444,7 @@ int cpsw_ale_flush(struct cpsw_ale *ale, int port_mask)
 	u32 ale_entry[ALE_ENTRY_WORDS];
 	int ret, idx;
 
+	spin_lock_bh(&ale->lock);
 	for (idx = 0; idx < ale->ale_entries; idx++) {
 		cpsw_ale_read(ale, idx, ale_entry);
 		ret = cpsw_ale_get_entry_type(ale_entry);
@@ -301,6 +458,7 @@ int cpsw_ale_flush(struct cpsw_ale *ale, int port_mask)
 
 		cpsw_ale_write(ale, idx, ale_entry);
 	}
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -407,6 +565,7 @@ int cpsw_ale_dump(struct cpsw_ale *ale, int index, char *buf, int len)
 	int outlen = 0, idx;
 	u32 ale_entry[ALE_ENTRY_WORDS];
 
+	spin_lock_bh(&ale->lock);
 	if (index) {
 		cpsw_ale_read(ale, index, ale_entry);
 		outlen += cpsw_ale_dump_entry(index, ale_entry,
@@ -418,6 +577,7 @@ int cpsw_ale_dump(struct cpsw_ale *ale, int index, char *buf, int len)
 					buf + outlen, len - outlen);
 		}
 	}
+	spin_unlock_bh(&ale->lock);
 	return outlen;
 }
 
@@ -433,15 +593,19 @@ int cpsw_ale_add_ucast(struct cpsw_ale *ale, u8 *addr, int port, int flags)
 	cpsw_ale_set_blocked(ale_entry, (flags & ALE_BLOCKED) ? 1 : 0);
 	cpsw_ale_set_port_num(ale_entry, port);
 
-	idx = cpsw_ale_match_addr(ale, addr, 0);
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_addr(ale, addr, 0);
 	if (idx < 0)
 		idx = cpsw_ale_match_free(ale);
 	if (idx < 0)
 		idx = cpsw_ale_find_ageable(ale);
-	if (idx < 0)
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -ENOMEM;
+	}
 
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -454,15 +618,19 @@ int cpsw_ale_add_oui(struct cpsw_ale *ale, u8 *addr)
 	cpsw_ale_set_addr(ale_entry, addr);
 	cpsw_ale_set_ucast_type(ale_entry, ALE_UCAST_OUI);
 
-	idx = cpsw_ale_match_addr(ale, addr, 0);
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_addr(ale, addr, 0);
 	if (idx < 0)
 		idx = cpsw_ale_match_free(ale);
 	if (idx < 0)
 		idx = cpsw_ale_find_ageable(ale);
-	if (idx < 0)
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -ENOMEM;
+	}
 
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -471,12 +639,16 @@ int cpsw_ale_del_ucast(struct cpsw_ale *ale, u8 *addr, int port)
 	u32 ale_entry[ALE_ENTRY_WORDS] = {0, 0, 0};
 	int idx;
 
-	idx = cpsw_ale_match_addr(ale, addr, 0);
-	if (idx < 0)
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_addr(ale, addr, 0);
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -ENOENT;
+	}
 
 	cpsw_ale_set_entry_type(ale_entry, ALE_TYPE_FREE);
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -486,7 +658,8 @@ int cpsw_ale_add_mcast(struct cpsw_ale *ale, u8 *addr, int port_mask,
 	u32 ale_entry[ALE_ENTRY_WORDS] = {0, 0, 0};
 	int idx, mask;
 
-	idx = cpsw_ale_match_addr(ale, addr, 0);
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_addr(ale, addr, 0);
 	if (idx >= 0)
 		cpsw_ale_read(ale, idx, ale_entry);
 
@@ -504,10 +677,13 @@ int cpsw_ale_add_mcast(struct cpsw_ale *ale, u8 *addr, int port_mask,
 		idx = cpsw_ale_match_free(ale);
 	if (idx < 0)
 		idx = cpsw_ale_find_ageable(ale);
-	if (idx < 0)
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -ENOMEM;
+	}
 
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -516,9 +692,12 @@ int cpsw_ale_del_mcast(struct cpsw_ale *ale, u8 *addr, int port_mask)
 	u32 ale_entry[ALE_ENTRY_WORDS] = {0, 0, 0};
 	int idx;
 
-	idx = cpsw_ale_match_addr(ale, addr, 0);
-	if (idx < 0)
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_addr(ale, addr, 0);
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -EINVAL;
+	}
 
 	cpsw_ale_read(ale, idx, ale_entry);
 
@@ -528,6 +707,7 @@ int cpsw_ale_del_mcast(struct cpsw_ale *ale, u8 *addr, int port_mask)
 		cpsw_ale_set_entry_type(ale_entry, ALE_TYPE_FREE);
 
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -537,7 +717,8 @@ int cpsw_ale_add_vlan(struct cpsw_ale *ale, u16 vid, int port, int untag,
 	u32 ale_entry[ALE_ENTRY_WORDS] = {0, 0, 0};
 	int idx;
 
-	idx = cpsw_ale_match_vlan(ale, vid);
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_vlan(ale, vid);
 	if (idx >= 0)
 		cpsw_ale_read(ale, idx, ale_entry);
 
@@ -553,10 +734,13 @@ int cpsw_ale_add_vlan(struct cpsw_ale *ale, u16 vid, int port, int untag,
 		idx = cpsw_ale_match_free(ale);
 	if (idx < 0)
 		idx = cpsw_ale_find_ageable(ale);
-	if (idx < 0)
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -ENOMEM;
+	}
 
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -565,9 +749,12 @@ int cpsw_ale_del_vlan(struct cpsw_ale *ale, u16 vid, int port)
 	u32 ale_entry[ALE_ENTRY_WORDS] = {0, 0, 0};
 	int idx;
 
-	idx = cpsw_ale_match_vlan(ale, vid);
-	if (idx < 0)
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_vlan(ale, vid);
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -ENOENT;
+	}
 
 	cpsw_ale_read(ale, idx, ale_entry);
 
@@ -577,6 +764,7 @@ int cpsw_ale_del_vlan(struct cpsw_ale *ale, u16 vid, int port)
 		cpsw_ale_set_vlan_member_list(ale_entry, port);
 
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -594,15 +782,19 @@ int cpsw_ale_vlan_add_ucast(struct cpsw_ale *ale, u8 *addr, int port,
 	cpsw_ale_set_port_num(ale_entry, port);
 	cpsw_ale_set_vlan_id(ale_entry, vid);
 
-	idx = cpsw_ale_match_addr(ale, addr, vid);
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_addr(ale, addr, vid);
 	if (idx < 0)
 		idx = cpsw_ale_match_free(ale);
 	if (idx < 0)
 		idx = cpsw_ale_find_ageable(ale);
-	if (idx < 0)
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -ENOMEM;
+	}
 
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -611,12 +803,16 @@ int cpsw_ale_vlan_del_ucast(struct cpsw_ale *ale, u8 *addr, int port, u16 vid)
 	u32 ale_entry[ALE_ENTRY_WORDS] = {0, 0, 0};
 	int idx;
 
-	idx = cpsw_ale_match_addr(ale, addr, vid);
-	if (idx < 0)
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_addr(ale, addr, vid);
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -ENOENT;
+	}
 
 	cpsw_ale_set_entry_type(ale_entry, ALE_TYPE_FREE);
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -626,7 +822,8 @@ int cpsw_ale_vlan_add_mcast(struct cpsw_ale *ale, u8 *addr,
 	u32 ale_entry[ALE_ENTRY_WORDS] = {0, 0, 0};
 	int idx, mask;
 
-	idx = cpsw_ale_match_addr(ale, addr, vid);
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_addr(ale, addr, vid);
 	if (idx >= 0)
 		cpsw_ale_read(ale, idx, ale_entry);
 
@@ -645,10 +842,13 @@ int cpsw_ale_vlan_add_mcast(struct cpsw_ale *ale, u8 *addr,
 		idx = cpsw_ale_match_free(ale);
 	if (idx < 0)
 		idx = cpsw_ale_find_ageable(ale);
-	if (idx < 0)
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -ENOMEM;
+	}
 
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -658,9 +858,12 @@ int cpsw_ale_vlan_del_mcast(struct cpsw_ale *ale, u8 *addr,
 	u32 ale_entry[ALE_ENTRY_WORDS] = {0, 0, 0};
 	int idx;
 
-	idx = cpsw_ale_match_addr(ale, addr, vid);
-	if (idx < 0)
+	spin_lock_bh(&ale->lock);
+	idx = __cpsw_ale_match_addr(ale, addr, vid);
+	if (idx < 0) {
+		spin_unlock_bh(&ale->lock);
 		return -EINVAL;
+	}
 
 	cpsw_ale_read(ale, idx, ale_entry);
 
@@ -670,6 +873,7 @@ int cpsw_ale_vlan_del_mcast(struct cpsw_ale *ale, u8 *addr,
 		cpsw_ale_set_entry_type(ale_entry, ALE_TYPE_FREE);
 
 	cpsw_ale_write(ale, idx, ale_entry);
+	spin_unlock_bh(&ale->lock);
 	return 0;
 }
 
@@ -738,10 +942,15 @@ int cpsw_ale_control_set(struct cpsw_ale *ale, int port, int control,
 	offset = info->offset + (port * info->port_offset);
 	shift  = info->shift  + (port * info->port_shift);
 
+	spin_lock_bh(&ale->lock);
 	tmp = __raw_readl(ale->ale_regs + offset);
 	tmp = (tmp & ~(mask << shift)) | (value << shift);
 	__raw_writel(tmp, ale->ale_regs + offset);
 
+	if (control == ALE_CLEAR && value)
+		cpsw_ale_shadow_reset(ale);
+	spin_unlock_bh(&ale->lock);
+
 	{
 		volatile u32 dly = 10000;
 		while (dly)
@@ -850,11 +1059,13 @@ static ssize_t cpsw_ale_table_show(struct device *dev,
 	u32 ale_entry[ALE_ENTRY_WORDS];
 	struct cpsw_ale *ale = table_attr_to_ale(attr);
 
+	spin_lock_bh(&ale->lock);
 	for (idx = 0; idx < ale->ale_entries; idx++) {
 		cpsw_ale_read(ale, idx, ale_entry);
 		outlen += cpsw_ale_dump_entry(idx, ale_entry, buf + outlen,
 					      len - outlen);
 	}
+	spin_unlock_bh(&ale->lock);
 	return outlen;
 }
 DEVICE_ATTR(ale_table, S_IRUGO, cpsw_ale_table_show, NULL);
@@ -930,6 +1141,21 @@ struct cpsw_ale *cpsw_ale_create(struct cpsw_ale_params *params)
 
 	ale->params = *params;
 	ale->ageout = ale->params.ale_ageout * HZ;
+	spin_lock_init(&ale->lock);
+
+	ale->shadow = kcalloc(ale->ale_entries, sizeof(*ale->shadow),
+			      GFP_KERNEL);
+	ale->hash = kcalloc(ALE_HASH_SIZE, sizeof(*ale->hash), GFP_KERNEL);
+	ale->free_map = kcalloc(BITS_TO_LONGS(ale->ale_entries),
+				sizeof(long), GFP_KERNEL);
+	if (WARN_ON(!ale->shadow || !ale->hash || !ale->free_map)) {
+		kfree(ale->free_map);
+		kfree(ale->hash);
+		kfree(ale->shadow);
+		kfree(ale);
+		return NULL;
+	}
+	cpsw_ale_shadow_reset(ale);
 
 	return ale;
 }
@@ -938,6 +1164,9 @@ int cpsw_ale_destroy(struct cpsw_ale *ale)
 {
 	if (!ale)
 		return -EINVAL;
+	kfree(ale->free_map);
+	kfree(ale->hash);
+	kfree(ale->shadow);
 	kfree(ale);
 	return 0;
 }
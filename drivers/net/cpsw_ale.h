@@ -23,10 +23,22 @@ struct cpsw_ale_params {
 	unsigned long		ale_ports;
 };
 
+struct cpsw_ale_shadow;
+
 struct cpsw_ale {
 	struct cpsw_ale_params	params;
 	struct timer_list	timer;
 	unsigned long		ageout;
+	/*
+	 * Serializes table accesses, which go through a shared index
+	 * register, and the shadow: writers run from process context and
+	 * from set_multicast_list() with BHs off.
+	 */
+	spinlock_t		lock;
+	/* software copy of the entries written by the driver */
+	struct cpsw_ale_shadow	*shadow;
+	struct hlist_head	*hash;
+	unsigned long		*free_map;
 	struct device_attribute ale_control_attr;
 #define control_attr_to_ale(attr)	\
 	container_of(attr, struct cpsw_ale, ale_control_attr);
@@ -64,6 +64,16 @@
 
 #define CPDMA_TEARDOWN_VALUE	0xfffffffc
 
+/* in sw_len: the buffer was mapped by the submitter, don't unmap it */
+#define CPDMA_DESC_SW_PREMAPPED	BIT(31)
+
+/* descriptors moved between a channel and the shared pool at a time */
+#define CPDMA_DESC_CACHE	8
+/* below this many free descriptors channels stop caching on free */
+#define CPDMA_DESC_LOW_WATER	(2 * CPDMA_DESC_CACHE)
+/* completed descriptors taken off a channel per lock hold */
+#define CPDMA_REAP_BATCH	16
+
 struct cpdma_desc {
 	/* hardware fields */
 	u32			hw_next;
@@ -84,7 +94,9 @@ struct cpdma_desc_pool {
 	void			*cpumap;	/* dma_alloc map */
 	int			desc_size, mem_size;
 	int			num_desc, used_desc;
-	unsigned long		*bitmap;
+	/* free descriptor index stacks, [0] for rx and [1] for tx */
+	u16			*free_list[2];
+	int			free_count[2];
 	struct device		*dev;
 	spinlock_t		lock;
 };
@@ -118,6 +130,9 @@ struct cpdma_chan {
 	cpdma_handler_fn		handler;
 	enum dma_data_direction		dir;
 	struct cpdma_chan_stats		stats;
+	/* descriptors owned by this channel but not queued */
+	u16				free_desc[2 * CPDMA_DESC_CACHE];
+	int				nr_free;
 	/* offsets into dmaregs */
 	int	int_set, int_clear, td;
 };
@@ -144,8 +159,8 @@ static struct cpdma_desc_pool *
 cpdma_desc_pool_create(struct device *dev, u32 phys, u32 hw_addr,
 			int size, int align)
 {
-	int bitmap_size;
 	struct cpdma_desc_pool *pool;
+	int i, half;
 
 	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
 	if (!pool)
@@ -156,12 +171,24 @@ cpdma_desc_pool_create(struct device *dev, u32 phys, u32 hw_addr,
 	pool->dev	= dev;
 	pool->mem_size	= size;
 	pool->desc_size	= ALIGN(sizeof(struct cpdma_desc), align);
-	pool->num_desc	= size / pool->desc_size;
-
-	bitmap_size  = (pool->num_desc / BITS_PER_LONG) * sizeof(long);
-	pool->bitmap = kzalloc(bitmap_size, GFP_KERNEL);
-	if (!pool->bitmap)
+	pool->num_desc	= min_t(int, size / pool->desc_size, USHRT_MAX);
+
+	/*
+	 * The lower half of the pool serves rx channels and the upper half
+	 * tx channels, so that neither direction can starve the other.
+	 */
+	half = pool->num_desc / 2;
+	pool->free_list[0] = kmalloc(pool->num_desc * sizeof(u16), GFP_KERNEL);
+	if (!pool->free_list[0])
 		goto fail;
+	pool->free_list[1] = pool->free_list[0] + half;
+
+	for (i = 0; i < half; i++)
+		pool->free_list[0][i] = half - 1 - i;
+	for (i = 0; i < pool->num_desc - half; i++)
+		pool->free_list[1][i] = pool->num_desc - 1 - i;
+	pool->free_count[0] = half;
+	pool->free_count[1] = pool->num_desc - half;
 
 	if (phys) {
 		pool->phys  = phys;
@@ -178,7 +205,7 @@ cpdma_desc_pool_create(struct device *dev, u32 phys, u32 hw_addr,
 		return pool;
 
 fail:
-	kfree(pool->bitmap);
+	kfree(pool->free_list[0]);
 	kfree(pool);
 	return NULL;
 }
@@ -192,7 +219,7 @@ static void cpdma_desc_pool_destroy(struct cpdma_desc_pool *pool)
 
 	spin_lock_irqsave(&pool->lock, flags);
 	WARN_ON(pool->used_desc);
-	kfree(pool->bitmap);
+	kfree(pool->free_list[0]);
 	if (pool->cpumap) {
 		dma_free_coherent(pool->dev, pool->mem_size, pool->cpumap,
 				  pool->phys);
@@ -218,58 +245,132 @@ desc_from_phys(struct cpdma_desc_pool *pool, dma_addr_t dma)
 	return dma ? pool->iomap + dma - pool->hw_addr : NULL;
 }
 
-static struct cpdma_desc __iomem *
-cpdma_desc_alloc(struct cpdma_desc_pool *pool, int num_desc, bool is_rx)
+static inline u16 desc_index(struct cpdma_desc_pool *pool,
+			     struct cpdma_desc __iomem *desc)
+{
+	return ((unsigned long)desc - (unsigned long)pool->iomap) /
+		pool->desc_size;
+}
+
+static inline struct cpdma_desc __iomem *
+desc_from_index(struct cpdma_desc_pool *pool, u16 index)
+{
+	return pool->iomap + pool->desc_size * index;
+}
+
+/* Move up to @num free descriptor indices from the pool into @index */
+static int cpdma_desc_pool_get(struct cpdma_desc_pool *pool, u16 *index,
+			       int num, bool is_rx)
 {
 	unsigned long flags;
-	int index;
-	struct cpdma_desc __iomem *desc = NULL;
-	static int last_index = 4096;
+	int list = is_rx ? 0 : 1;
 
 	spin_lock_irqsave(&pool->lock, flags);
+	num = min(num, pool->free_count[list]);
+	pool->free_count[list] -= num;
+	memcpy(index, pool->free_list[list] + pool->free_count[list],
+	       num * sizeof(u16));
+	pool->used_desc += num;
+	spin_unlock_irqrestore(&pool->lock, flags);
 
-	if (is_rx) {
-		index = bitmap_find_next_zero_area(pool->bitmap,
-				pool->num_desc/2, 0, num_desc, 0);
-	 } else {
-		if (last_index >= pool->num_desc)
-			last_index = pool->num_desc / 2;
+	return num;
+}
 
-		index = bitmap_find_next_zero_area(pool->bitmap,
-				pool->num_desc, last_index, num_desc, 0);
+static void cpdma_desc_pool_put(struct cpdma_desc_pool *pool, u16 *index,
+				int num, bool is_rx)
+{
+	unsigned long flags;
+	int list = is_rx ? 0 : 1;
 
-		if (!(index < pool->num_desc)) {
-			index = bitmap_find_next_zero_area(pool->bitmap,
-				pool->num_desc, pool->num_desc/2, num_desc, 0);
-		}
+	spin_lock_irqsave(&pool->lock, flags);
+	memcpy(pool->free_list[list] + pool->free_count[list], index,
+	       num * sizeof(u16));
+	pool->free_count[list] += num;
+	pool->used_desc -= num;
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
 
-		if (index < pool->num_desc)
-			last_index = index + 1;
-		else
-			last_index = pool->num_desc / 2;
+/*
+ * With the shared pool empty, take cached descriptors from the other
+ * channels of the same direction.  The caller holds its own channel lock,
+ * so the controller and the other channel locks are only tried; whatever
+ * is busy is skipped.
+ */
+static int cpdma_chan_desc_steal(struct cpdma_chan *chan)
+{
+	struct cpdma_ctlr *ctlr = chan->ctlr;
+	struct cpdma_chan *other;
+	int i, num;
+
+	if (!spin_trylock(&ctlr->lock))
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(ctlr->channels) && !chan->nr_free; i++) {
+		other = ctlr->channels[i];
+		if (!other || other == chan ||
+		    is_rx_chan(other) != is_rx_chan(chan))
+			continue;
+		if (!spin_trylock(&other->lock))
+			continue;
+		num = min(other->nr_free, CPDMA_DESC_CACHE);
+		other->nr_free -= num;
+		memcpy(chan->free_desc, other->free_desc + other->nr_free,
+		       num * sizeof(u16));
+		chan->nr_free = num;
+		spin_unlock(&other->lock);
 	}
 
-	if (index < pool->num_desc) {
-		bitmap_set(pool->bitmap, index, num_desc);
-		desc = pool->iomap + pool->desc_size * index;
-		pool->used_desc++;
+	spin_unlock(&ctlr->lock);
+	return chan->nr_free;
+}
+
+/*
+ * Descriptors are allocated from a small per-channel free list, which is
+ * refilled from and drained to the shared pool CPDMA_DESC_CACHE entries at
+ * a time.  Both run in O(1) under the channel lock, which the caller holds.
+ * Once the pool runs low, frees go straight back to it so that descriptors
+ * do not sit in the cache of a quiet channel while another one starves.
+ */
+static struct cpdma_desc __iomem *
+cpdma_chan_desc_alloc(struct cpdma_chan *chan)
+{
+	struct cpdma_desc_pool *pool = chan->ctlr->pool;
+
+	if (unlikely(!chan->nr_free)) {
+		chan->stats.desc_pool_get++;
+		chan->nr_free = cpdma_desc_pool_get(pool, chan->free_desc,
+						    CPDMA_DESC_CACHE,
+						    is_rx_chan(chan));
+		if (!chan->nr_free && !cpdma_chan_desc_steal(chan))
+			return NULL;
 	}
 
-	spin_unlock_irqrestore(&pool->lock, flags);
-	return desc;
+	chan->stats.desc_alloc++;
+	return desc_from_index(pool, chan->free_desc[--chan->nr_free]);
 }
 
-static void cpdma_desc_free(struct cpdma_desc_pool *pool,
-			    struct cpdma_desc __iomem *desc, int num_desc)
+static void cpdma_chan_desc_free(struct cpdma_chan *chan,
+				 struct cpdma_desc __iomem *desc)
 {
-	unsigned long flags, index;
+	struct cpdma_desc_pool *pool = chan->ctlr->pool;
+	int list = is_rx_chan(chan) ? 0 : 1;
+	int num;
+
+	chan->free_desc[chan->nr_free++] = desc_index(pool, desc);
+
+	/* an unlocked peek is good enough for a watermark */
+	if (unlikely(ACCESS_ONCE(pool->free_count[list]) <
+		     CPDMA_DESC_LOW_WATER))
+		num = chan->nr_free;
+	else if (unlikely(chan->nr_free == ARRAY_SIZE(chan->free_desc)))
+		num = CPDMA_DESC_CACHE;
+	else
+		return;
 
-	index = ((unsigned long)desc - (unsigned long)pool->iomap) /
-		pool->desc_size;
-	spin_lock_irqsave(&pool->lock, flags);
-	bitmap_clear(pool->bitmap, index, num_desc);
-	pool->used_desc--;
-	spin_unlock_irqrestore(&pool->lock, flags);
+	chan->stats.desc_pool_put++;
+	chan->nr_free -= num;
+	cpdma_desc_pool_put(pool, chan->free_desc + chan->nr_free, num,
+			    is_rx_chan(chan));
 }
 
 struct cpdma_ctlr *cpdma_ctlr_create(struct cpdma_params *params)
@@ -510,6 +611,21 @@ void cpdma_ctlr_eoi_statistics(struct cpdma_ctlr *ctlr)
 }
 EXPORT_SYMBOL(cpdma_ctlr_eoi_statistics);
 
+/*
+ * Return a mask of the channel numbers with completed rx or tx
+ * descriptors, whether or not their interrupts are currently enabled.
+ */
+u32 cpdma_ctlr_chan_pending(struct cpdma_ctlr *ctlr)
+{
+	u32 pending;
+
+	pending = dma_reg_read(ctlr, CPDMA_TXINTSTATRAW);
+	pending |= dma_reg_read(ctlr, CPDMA_RXINTSTATRAW);
+
+	return pending & (BIT(ctlr->num_chan) - 1);
+}
+EXPORT_SYMBOL(cpdma_ctlr_chan_pending);
+
 struct cpdma_chan *cpdma_chan_create(struct cpdma_ctlr *ctlr, int chan_num,
 				     cpdma_handler_fn handler)
 {
@@ -579,6 +695,8 @@ int cpdma_chan_destroy(struct cpdma_chan *chan)
 	if (chan->state != CPDMA_STATE_IDLE)
 		cpdma_chan_stop(chan);
 	ctlr->channels[chan->chan_num] = NULL;
+	cpdma_desc_pool_put(ctlr->pool, chan->free_desc, chan->nr_free,
+			    is_rx_chan(chan));
 	spin_unlock_irqrestore(&ctlr->lock, flags);
 	kfree(chan);
 	return 0;
@@ -641,13 +759,26 @@ int cpdma_chan_dump(struct cpdma_chan *chan)
 		 chan->stats.requeue);
 	dev_info(dev, "\tstats teardown_dequeue: %d\n",
 		 chan->stats.teardown_dequeue);
+	dev_info(dev, "\tstats batch_enqueue: %d\n",
+		 chan->stats.batch_enqueue);
+	dev_info(dev, "\tstats desc_alloc: %d\n",
+		 chan->stats.desc_alloc);
+	dev_info(dev, "\tstats desc_pool_get: %d\n",
+		 chan->stats.desc_pool_get);
+	dev_info(dev, "\tstats desc_pool_put: %d\n",
+		 chan->stats.desc_pool_put);
 
 	spin_unlock_irqrestore(&chan->lock, flags);
 	return 0;
 }
 
+/*
+ * Append a chain of descriptors, already linked through hw_next/sw_next, to
+ * the channel queue.  The hardware is kicked at most once for the chain.
+ */
 static void __cpdma_chan_submit(struct cpdma_chan *chan,
-				struct cpdma_desc __iomem *desc)
+				struct cpdma_desc __iomem *first,
+				struct cpdma_desc __iomem *last)
 {
 	struct cpdma_ctlr		*ctlr = chan->ctlr;
 	struct cpdma_desc __iomem	*prev = chan->tail;
@@ -655,13 +786,13 @@ static void __cpdma_chan_submit(struct cpdma_chan *chan,
 	dma_addr_t			desc_dma;
 	u32				mode;
 
-	desc_dma = desc_phys(pool, desc);
+	desc_dma = desc_phys(pool, first);
 
 	/* simple case - idle channel */
 	if (!chan->head) {
 		chan->stats.head_enqueue++;
-		chan->head = desc;
-		chan->tail = desc;
+		chan->head = first;
+		chan->tail = last;
 		if (chan->state == CPDMA_STATE_ACTIVE)
 			chan_write(chan, hdp, desc_dma);
 		return;
@@ -670,7 +801,7 @@ static void __cpdma_chan_submit(struct cpdma_chan *chan,
 	/* first chain the descriptor at the tail of the list */
 	desc_write(prev, hw_next, desc_dma);
 	desc_write(prev, sw_next, desc_dma);
-	chan->tail = desc;
+	chan->tail = last;
 	chan->stats.tail_enqueue++;
 
 	/* next check if EOQ has been triggered already */
@@ -683,16 +814,48 @@ static void __cpdma_chan_submit(struct cpdma_chan *chan,
 	}
 }
 
+/*
+ * Set up @desc for a buffer of @len bytes at @data, or if @data is NULL
+ * for one the caller has already mapped at @buffer.
+ */
+static void cpdma_desc_fill(struct cpdma_chan *chan,
+			    struct cpdma_desc __iomem *desc, void *token,
+			    void *data, dma_addr_t buffer, int len,
+			    int directed)
+{
+	struct cpdma_ctlr		*ctlr = chan->ctlr;
+	u32				mode, sw_len;
+
+	if (len < ctlr->params.min_packet_size) {
+		len = ctlr->params.min_packet_size;
+		chan->stats.runt_transmit_buff++;
+	}
+
+	sw_len = len;
+	if (data)
+		buffer = dma_map_single(ctlr->dev, data, len, chan->dir);
+	else
+		sw_len |= CPDMA_DESC_SW_PREMAPPED;
+	mode = CPDMA_DESC_OWNER | CPDMA_DESC_SOP | CPDMA_DESC_EOP;
+	if ((!chan->rxfree) && ((directed == 1) || (directed == 2)))
+		mode |= (CPDMA_DESC_TO_PORT_EN | (directed << 16));
+
+	desc_write(desc, hw_next,   0);
+	desc_write(desc, sw_next,   0);
+	desc_write(desc, hw_buffer, buffer);
+	desc_write(desc, hw_len,    len);
+	desc_write(desc, hw_mode,   mode | len);
+	desc_write(desc, sw_token,  token);
+	desc_write(desc, sw_buffer, buffer);
+	desc_write(desc, sw_len,    sw_len);
+}
+
 int cpdma_chan_submit(struct cpdma_chan *chan, void *token, void *data,
 		      int len, int directed, gfp_t gfp_mask)
 {
-	struct cpdma_ctlr		*ctlr = chan->ctlr;
 	struct cpdma_desc __iomem	*desc;
-	dma_addr_t			buffer;
 	unsigned long			flags;
-	u32				mode;
 	int				ret = 0;
-	bool                            is_rx;
 
 	spin_lock_irqsave(&chan->lock, flags);
 
@@ -701,133 +864,235 @@ int cpdma_chan_submit(struct cpdma_chan *chan, void *token, void *data,
 		goto unlock_ret;
 	}
 
-	is_rx = (chan->rxfree != 0);
-	desc = cpdma_desc_alloc(ctlr->pool, 1, is_rx);
+	desc = cpdma_chan_desc_alloc(chan);
 	if (!desc) {
 		chan->stats.desc_alloc_fail++;
 		ret = -ENOMEM;
 		goto unlock_ret;
 	}
 
-	if (len < ctlr->params.min_packet_size) {
-		len = ctlr->params.min_packet_size;
-		chan->stats.runt_transmit_buff++;
+	cpdma_desc_fill(chan, desc, token, data, 0, len, directed);
+	__cpdma_chan_submit(chan, desc, desc);
+
+	if (chan->state == CPDMA_STATE_ACTIVE && chan->rxfree)
+		chan_write(chan, rxfree, 1);
+
+	chan->count++;
+
+unlock_ret:
+	spin_unlock_irqrestore(&chan->lock, flags);
+	return ret;
+}
+EXPORT_SYMBOL(cpdma_chan_submit);
+
+/*
+ * Queue up to @num buffers with a single pass over the channel lock and a
+ * single doorbell write.  Returns the number of buffers queued, which is
+ * less than @num if the descriptor pool ran dry, or a negative error if
+ * none could be queued.
+ */
+int cpdma_chan_submit_batch(struct cpdma_chan *chan, struct cpdma_buf *bufs,
+			    int num, gfp_t gfp_mask)
+{
+	struct cpdma_ctlr		*ctlr = chan->ctlr;
+	struct cpdma_desc_pool		*pool = ctlr->pool;
+	struct cpdma_desc __iomem	*desc, *first = NULL, *last = NULL;
+	dma_addr_t			desc_dma;
+	unsigned long			flags;
+	int				i, ret;
+
+	spin_lock_irqsave(&chan->lock, flags);
+
+	if (chan->state == CPDMA_STATE_TEARDOWN) {
+		ret = -EINVAL;
+		goto unlock_ret;
 	}
 
-	buffer = dma_map_single(ctlr->dev, data, len, chan->dir);
-	mode = CPDMA_DESC_OWNER | CPDMA_DESC_SOP | CPDMA_DESC_EOP;
-	if ((!is_rx) && ((directed == 1) || (directed == 2)))
-		mode |= (CPDMA_DESC_TO_PORT_EN | (directed << 16));
+	for (i = 0; i < num; i++) {
+		desc = cpdma_chan_desc_alloc(chan);
+		if (!desc) {
+			chan->stats.desc_alloc_fail++;
+			break;
+		}
 
-	desc_write(desc, hw_next,   0);
-	desc_write(desc, sw_next,   0);
-	desc_write(desc, hw_buffer, buffer);
-	desc_write(desc, hw_len,    len);
-	desc_write(desc, hw_mode,   mode | len);
-	desc_write(desc, sw_token,  token);
-	desc_write(desc, sw_buffer, buffer);
-	desc_write(desc, sw_len,    len);
+		cpdma_desc_fill(chan, desc, bufs[i].token, bufs[i].data,
+				bufs[i].dma, bufs[i].len, bufs[i].directed);
 
-	__cpdma_chan_submit(chan, desc);
+		/* link up privately, the hardware sees the whole chain */
+		if (last) {
+			desc_dma = desc_phys(pool, desc);
+			desc_write(last, hw_next, desc_dma);
+			desc_write(last, sw_next, desc_dma);
+		} else {
+			first = desc;
+		}
+		last = desc;
+	}
+
+	ret = -ENOMEM;
+	if (!i)
+		goto unlock_ret;
+
+	__cpdma_chan_submit(chan, first, last);
 
 	if (chan->state == CPDMA_STATE_ACTIVE && chan->rxfree)
-		chan_write(chan, rxfree, 1);
+		chan_write(chan, rxfree, i);
 
-	chan->count++;
+	chan->count += i;
+	chan->stats.batch_enqueue++;
+	ret = i;
 
 unlock_ret:
 	spin_unlock_irqrestore(&chan->lock, flags);
 	return ret;
 }
-EXPORT_SYMBOL(cpdma_chan_submit);
+EXPORT_SYMBOL(cpdma_chan_submit_batch);
+
+/* a reaped descriptor, as handed to the channel handler */
+struct cpdma_done {
+	void			*token;
+	dma_addr_t		buffer;
+	int			len;
+	int			outlen;
+	int			status;
+	bool			premapped;
+};
 
+/*
+ * Take a descriptor off the channel, noting what the handler needs, and
+ * give it back to the channel free list.  Called with the channel lock
+ * held.
+ */
 static void __cpdma_chan_free(struct cpdma_chan *chan,
 			      struct cpdma_desc __iomem *desc,
-			      int outlen, int status)
+			      int outlen, int status, struct cpdma_done *done)
 {
-	struct cpdma_ctlr		*ctlr = chan->ctlr;
-	struct cpdma_desc_pool		*pool = ctlr->pool;
-	dma_addr_t			buff_dma;
-	int				origlen;
-	void				*token;
+	u32 sw_len = desc_read(desc, sw_len);
 
-	token      = (void *)desc_read(desc, sw_token);
-	buff_dma   = desc_read(desc, sw_buffer);
-	origlen    = desc_read(desc, sw_len);
+	done->token	= (void *)desc_read(desc, sw_token);
+	done->buffer	= desc_read(desc, sw_buffer);
+	done->len	= sw_len & ~CPDMA_DESC_SW_PREMAPPED;
+	done->outlen	= outlen;
+	done->status	= status;
+	done->premapped	= !!(sw_len & CPDMA_DESC_SW_PREMAPPED);
 
-	dma_unmap_single(ctlr->dev, buff_dma, origlen, chan->dir);
-	cpdma_desc_free(pool, desc, 1);
+	cpdma_chan_desc_free(chan, desc);
+}
 
-	(*chan->handler)(token, outlen, status);
+/* Unmap a reaped buffer and complete it, without the channel lock */
+static void cpdma_chan_complete(struct cpdma_chan *chan,
+				struct cpdma_done *done)
+{
+	if (!done->premapped)
+		dma_unmap_single(chan->ctlr->dev, done->buffer, done->len,
+				 chan->dir);
+	(*chan->handler)(done->token, done->outlen, done->status);
 }
 
-static int __cpdma_chan_process(struct cpdma_chan *chan)
+/*
+ * Reap up to @quota completed descriptors into @done, acknowledging the
+ * completion pointer once for all of them.  Called with the channel lock
+ * held.  Returns the number reaped, or a negative error if there was none;
+ * @status is set to the status of the last one.
+ */
+static int __cpdma_chan_reap(struct cpdma_chan *chan, struct cpdma_done *done,
+			     int quota, int *status)
 {
 	struct cpdma_ctlr		*ctlr = chan->ctlr;
-	struct cpdma_desc __iomem	*desc;
-	u32				status, outlen;
 	struct cpdma_desc_pool		*pool = ctlr->pool;
-	dma_addr_t			desc_dma;
-	unsigned long			flags;
-
-	spin_lock_irqsave(&chan->lock, flags);
+	struct cpdma_desc __iomem	*desc, *last = NULL;
+	u32				mode, outlen;
+	int				used = 0;
 
 	desc = chan->head;
 	if (!desc) {
 		chan->stats.empty_dequeue++;
-		status = -ENOENT;
-		goto unlock_ret;
+		return -ENOENT;
 	}
-	desc_dma = desc_phys(pool, desc);
 
-	status	= __raw_readl(&desc->hw_mode);
-	outlen	= status & 0x7ff;
-	if (status & CPDMA_DESC_OWNER) {
-		chan->stats.busy_dequeue++;
-		status = -EBUSY;
-		goto unlock_ret;
-	}
+	while (desc && used < quota) {
+		mode	= desc_read(desc, hw_mode);
+		outlen	= mode & 0x7ff;
+		if (mode & CPDMA_DESC_OWNER) {
+			chan->stats.busy_dequeue++;
+			break;
+		}
 
-	if (status & CPDMA_DESC_PASS_CRC)
-		outlen -= 4;
+		if (mode & CPDMA_DESC_PASS_CRC)
+			outlen -= 4;
 
-	status	= status & (CPDMA_DESC_EOQ | CPDMA_DESC_TD_COMPLETE |
-				CPDMA_DESC_PORT_MASK);
+		*status	= mode & (CPDMA_DESC_EOQ | CPDMA_DESC_TD_COMPLETE |
+				  CPDMA_DESC_PORT_MASK);
 
-	chan->head = desc_from_phys(pool, desc_read(desc, sw_next));
-	chan_write(chan, cp, desc_dma);
-	chan->count--;
-	chan->stats.good_dequeue++;
+		last = desc;
+		desc = desc_from_phys(pool, desc_read(desc, sw_next));
+		__cpdma_chan_free(chan, last, outlen, *status, &done[used++]);
 
-	if ((status & CPDMA_DESC_EOQ) && (chan->head) &&
-			(!(status & CPDMA_DESC_TD_COMPLETE))) {
-		chan->stats.requeue++;
-		chan_write(chan, hdp, desc_phys(pool, chan->head));
+		if ((mode & CPDMA_DESC_EOQ) && desc &&
+				(!(mode & CPDMA_DESC_TD_COMPLETE))) {
+			chan->stats.requeue++;
+			chan_write(chan, hdp, desc_phys(pool, desc));
+		}
 	}
 
-	spin_unlock_irqrestore(&chan->lock, flags);
+	if (!used)
+		return -EBUSY;
 
-	__cpdma_chan_free(chan, desc, outlen, (int)status);
-	return status;
+	chan->head = desc;
+	chan_write(chan, cp, desc_phys(pool, last));
+	chan->count -= used;
+	chan->stats.good_dequeue += used;
 
-unlock_ret:
+	return used;
+}
+
+static int __cpdma_chan_process(struct cpdma_chan *chan)
+{
+	struct cpdma_done		done;
+	unsigned long			flags;
+	int				ret, status;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	ret = __cpdma_chan_reap(chan, &done, 1, &status);
 	spin_unlock_irqrestore(&chan->lock, flags);
+
+	if (ret < 0)
+		return ret;
+
+	cpdma_chan_complete(chan, &done);
 	return status;
 }
 
+/*
+ * Reap up to @quota completed descriptors.  They are taken off the queue
+ * CPDMA_REAP_BATCH at a time with one pass over the channel lock and one
+ * completion pointer write, and then handed to the channel handler
+ * without the lock.
+ */
 int cpdma_chan_process(struct cpdma_chan *chan, int quota)
 {
-	int used = 0, ret = 0;
+	struct cpdma_done		done[CPDMA_REAP_BATCH];
+	unsigned long			flags;
+	int				i, num, status, used = 0;
 
 	if (chan->state != CPDMA_STATE_ACTIVE)
 		return -EINVAL;
 
 	while (used < quota) {
-		ret = __cpdma_chan_process(chan);
-		if (ret < 0)
+		spin_lock_irqsave(&chan->lock, flags);
+		num = __cpdma_chan_reap(chan, done,
+					min(quota - used, CPDMA_REAP_BATCH),
+					&status);
+		spin_unlock_irqrestore(&chan->lock, flags);
+
+		if (num <= 0)
 			break;
-		used++;
+
+		for (i = 0; i < num; i++)
+			cpdma_chan_complete(chan, &done[i]);
+		used += num;
 	}
+
 	return used;
 }
 EXPORT_SYMBOL(cpdma_chan_process);
@@ -904,15 +1169,17 @@ int cpdma_chan_stop(struct cpdma_chan *chan)
 	spin_lock_irqsave(&chan->lock, flags);
 	while (chan->head) {
 		struct cpdma_desc __iomem *desc = chan->head;
+		struct cpdma_done done;
 		dma_addr_t next_dma;
 
 		next_dma = desc_read(desc, hw_next);
 		chan->head = desc_from_phys(pool, next_dma);
 		chan->stats.teardown_dequeue++;
+		__cpdma_chan_free(chan, desc, 0, -ENOSYS, &done);
 
 		/* issue callback without locks held */
 		spin_unlock_irqrestore(&chan->lock, flags);
-		__cpdma_chan_free(chan, desc, 0, -ENOSYS);
+		cpdma_chan_complete(chan, &done);
 		spin_lock_irqsave(&chan->lock, flags);
 	}
 
@@ -63,6 +63,28 @@ struct cpdma_chan_stats {
 	u32			good_dequeue;
 	u32			requeue;
 	u32			teardown_dequeue;
+	u32			batch_enqueue;
+	/*
+	 * Descriptor allocation cost: desc_alloc counts allocations, of
+	 * which only desc_pool_get had to go to the shared pool; frees
+	 * that spilled back to it are counted in desc_pool_put.
+	 */
+	u32			desc_alloc;
+	u32			desc_pool_get;
+	u32			desc_pool_put;
+};
+
+/*
+ * One buffer of a cpdma_chan_submit_batch() request.  With @data NULL the
+ * buffer is one the caller keeps mapped at @dma; it is left mapped on
+ * completion and the caller syncs it as needed.
+ */
+struct cpdma_buf {
+	void			*token;
+	void			*data;
+	dma_addr_t		dma;
+	int			len;
+	int			directed;
 };
 
 struct cpdma_ctlr;
@@ -87,11 +109,14 @@ int cpdma_chan_get_stats(struct cpdma_chan *chan,
 			 struct cpdma_chan_stats *stats);
 int cpdma_chan_submit(struct cpdma_chan *chan, void *token, void *data,
 		      int len, int directed, gfp_t gfp_mask);
+int cpdma_chan_submit_batch(struct cpdma_chan *chan, struct cpdma_buf *bufs,
+			    int num, gfp_t gfp_mask);
 int cpdma_chan_process(struct cpdma_chan *chan, int quota);
 
 int cpdma_ctlr_int_ctrl(struct cpdma_ctlr *ctlr, bool enable);
 void cpdma_ctlr_eoi(struct cpdma_ctlr *ctlr);
 void cpdma_ctlr_eoi_statistics(struct cpdma_ctlr *ctlr);
+u32 cpdma_ctlr_chan_pending(struct cpdma_ctlr *ctlr);
 int cpdma_chan_int_ctrl(struct cpdma_chan *chan, bool enable);
 
 enum cpdma_control {
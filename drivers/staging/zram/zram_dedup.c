@@ -0,0 +1,246 @@
+/*
+ * Compressed RAM block device
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com/
+ */
+
+/*
+ * Same-page deduplication. Every compressed object is described by a
+ * refcounted zram_entry. When deduplication is enabled, entries are
+ * also kept in a per-device rbtree keyed by the checksum of the
+ * uncompressed page, so that a write of a page whose content is
+ * already stored just takes another reference instead of compressing
+ * and allocating again.
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zram_drv.h"
+
+static struct kmem_cache *zram_entry_cache;
+
+struct zram_entry *zram_entry_alloc(struct zram *zram, u32 len, gfp_t flags)
+{
+	struct zram_entry *entry;
+
+	entry = kmem_cache_alloc(zram_entry_cache, flags & ~__GFP_HIGHMEM);
+	if (!entry)
+		return NULL;
+
+	entry->handle = zs_malloc(zram->mem_pool, len, flags);
+	if (!entry->handle) {
+		kmem_cache_free(zram_entry_cache, entry);
+		return NULL;
+	}
+
+	RB_CLEAR_NODE(&entry->rb_node);
+	entry->checksum = 0;
+	entry->len = len;
+	entry->refcount = 1;
+	entry->pins = 0;
+
+	return entry;
+}
+
+static void zram_entry_free(struct zram *zram, struct zram_entry *entry)
+{
+	zs_free(zram->mem_pool, entry->handle);
+	kmem_cache_free(zram_entry_cache, entry);
+}
+
+/*
+ * Drop the reference of a table slot to @entry. Returns the number
+ * of table slots still sharing the object: once this reaches 0 the
+ * object counts as freed, although the memory itself is only released
+ * when the last pin is dropped as well.
+ */
+unsigned int zram_entry_put(struct zram *zram, struct zram_entry *entry)
+{
+	unsigned int users;
+
+	spin_lock(&zram->dedup_lock);
+	users = --entry->refcount;
+	if (!users && !RB_EMPTY_NODE(&entry->rb_node)) {
+		rb_erase(&entry->rb_node, &zram->dedup_tree);
+		RB_CLEAR_NODE(&entry->rb_node);
+	}
+
+	if (users || entry->pins) {
+		spin_unlock(&zram->dedup_lock);
+		return users;
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	zram_entry_free(zram, entry);
+	return 0;
+}
+
+/*
+ * Pin @entry so that its object stays valid while it is accessed
+ * without holding the lock protecting the table slot using it.
+ */
+void zram_entry_pin(struct zram *zram, struct zram_entry *entry)
+{
+	spin_lock(&zram->dedup_lock);
+	entry->pins++;
+	spin_unlock(&zram->dedup_lock);
+}
+
+void zram_entry_unpin(struct zram *zram, struct zram_entry *entry)
+{
+	spin_lock(&zram->dedup_lock);
+	if (--entry->pins || entry->refcount) {
+		spin_unlock(&zram->dedup_lock);
+		return;
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	zram_entry_free(zram, entry);
+}
+
+u32 zram_dedup_checksum(struct page *page)
+{
+	u32 checksum;
+	void *mem;
+
+	mem = kmap_atomic(page, KM_USER0);
+	checksum = jhash2(mem, PAGE_SIZE / sizeof(u32), 0);
+	kunmap_atomic(mem, KM_USER0);
+
+	return checksum;
+}
+
+void zram_dedup_insert(struct zram *zram, struct zram_entry *entry,
+			u32 checksum)
+{
+	struct rb_node **rb_node, *parent = NULL;
+
+	entry->checksum = checksum;
+
+	spin_lock(&zram->dedup_lock);
+	rb_node = &zram->dedup_tree.rb_node;
+	while (*rb_node) {
+		struct zram_entry *cur;
+
+		parent = *rb_node;
+		cur = rb_entry(parent, struct zram_entry, rb_node);
+		if (checksum == cur->checksum) {
+			/* Keep the older entry, it likely has more users */
+			spin_unlock(&zram->dedup_lock);
+			return;
+		}
+
+		if (checksum < cur->checksum)
+			rb_node = &parent->rb_left;
+		else
+			rb_node = &parent->rb_right;
+	}
+
+	rb_link_node(&entry->rb_node, parent, rb_node);
+	rb_insert_color(&entry->rb_node, &zram->dedup_tree);
+	spin_unlock(&zram->dedup_lock);
+}
+
+/*
+ * Check whether @entry holds the same data as @page, decompressing
+ * the stored object into the buffer of @zstrm.
+ */
+static int zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+			struct page *page, struct zram_comp_stream *zstrm)
+{
+	int ret;
+	unsigned int clen = PAGE_SIZE;
+	unsigned char *cmem, *mem;
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	ret = crypto_comp_decompress(zstrm->tfm, cmem, entry->len,
+				zstrm->buffer, &clen);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	if (unlikely(ret || clen != PAGE_SIZE))
+		return 0;
+
+	mem = kmap_atomic(page, KM_USER0);
+	ret = !memcmp(mem, zstrm->buffer, PAGE_SIZE);
+	kunmap_atomic(mem, KM_USER0);
+
+	return ret;
+}
+
+/*
+ * Look up a stored object with the same content as @page. On success
+ * a new reference to it is returned; the caller must drop it with
+ * zram_entry_put() once the table slot using it is freed.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
+				u32 checksum, struct zram_comp_stream *zstrm)
+{
+	struct rb_node *rb_node;
+	struct zram_entry *entry = NULL;
+
+	spin_lock(&zram->dedup_lock);
+	rb_node = zram->dedup_tree.rb_node;
+	while (rb_node) {
+		struct zram_entry *cur;
+
+		cur = rb_entry(rb_node, struct zram_entry, rb_node);
+		if (checksum == cur->checksum) {
+			entry = cur;
+			entry->pins++;
+			break;
+		}
+
+		if (checksum < cur->checksum)
+			rb_node = rb_node->rb_left;
+		else
+			rb_node = rb_node->rb_right;
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	if (!entry)
+		return NULL;
+
+	/* Checksums collide: compare the actual contents */
+	if (zram_dedup_match(zram, entry, page, zstrm)) {
+		spin_lock(&zram->dedup_lock);
+		/* Turn the pin into a reference, unless it was just freed */
+		if (entry->refcount) {
+			entry->refcount++;
+			entry->pins--;
+			spin_unlock(&zram->dedup_lock);
+			return entry;
+		}
+		spin_unlock(&zram->dedup_lock);
+	}
+
+	zram_entry_unpin(zram, entry);
+	return NULL;
+}
+
+int zram_dedup_init(void)
+{
+	zram_entry_cache = kmem_cache_create("zram_entry",
+				sizeof(struct zram_entry), 0, 0, NULL);
+	if (!zram_entry_cache)
+		return -ENOMEM;
+
+	return 0;
+}
+
+void zram_dedup_exit(void)
+{
+	kmem_cache_destroy(zram_entry_cache);
+}
@@ -21,11 +21,12 @@
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
+#include <linux/crypto.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
+#include <linux/percpu.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -34,18 +35,24 @@
 /* Globals */
 static int zram_major;
 struct zram *devices;
+/* Reads from the backing device, issued on behalf of swap-in */
+static struct workqueue_struct *zram_bdev_wq;
 
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
+static void zram_stat_inc(struct zram *zram, u32 *v)
 {
+	spin_lock(&zram->stat64_lock);
 	*v = *v + 1;
+	spin_unlock(&zram->stat64_lock);
 }
 
-static void zram_stat_dec(u32 *v)
+static void zram_stat_dec(struct zram *zram, u32 *v)
 {
+	spin_lock(&zram->stat64_lock);
 	*v = *v - 1;
+	spin_unlock(&zram->stat64_lock);
 }
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
@@ -129,48 +136,111 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
-static void zram_free_page(struct zram *zram, size_t index)
+/*
+ * Without a backing device, the block layer never lets two requests
+ * touch the same table entry concurrently. With one, the writeback
+ * worker updates entries behind readers' and writers' backs, so all
+ * entry updates have to be serialized.
+ */
+static void zram_slot_lock(struct zram *zram)
+{
+	if (zram->bdev)
+		spin_lock(&zram->wb_lock);
+}
+
+static void zram_slot_unlock(struct zram *zram)
+{
+	if (zram->bdev)
+		spin_unlock(&zram->wb_lock);
+}
+
+static unsigned long zram_alloc_bdev_blocks(struct zram *zram,
+					unsigned int nr)
+{
+	unsigned long blk;
+
+	spin_lock(&zram->bitmap_lock);
+	/* Block 0 is never handed out so that 0 means "none" */
+	blk = bitmap_find_next_zero_area(zram->bitmap, zram->nr_bdev_pages,
+					1, nr, 0);
+	if (blk >= zram->nr_bdev_pages) {
+		spin_unlock(&zram->bitmap_lock);
+		return 0;
+	}
+	bitmap_set(zram->bitmap, blk, nr);
+	spin_unlock(&zram->bitmap_lock);
+
+	return blk;
+}
+
+static void zram_free_bdev_blocks(struct zram *zram, unsigned long blk,
+				unsigned int nr)
+{
+	spin_lock(&zram->bitmap_lock);
+	bitmap_clear(zram->bitmap, blk, nr);
+	spin_unlock(&zram->bitmap_lock);
+}
+
+/* Must be called with the slot lock held */
+static void __zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
-	void *obj;
+	struct zram_entry *entry = zram->table[index].entry;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 
-	if (unlikely(!page)) {
+	if (unlikely(!entry)) {
 		/*
 		 * No memory is allocated for zero filled pages.
 		 * Simply clear zero page flag.
 		 */
 		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
 			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
+			zram_stat_dec(zram, &zram->stats.pages_zero);
 		}
 		return;
 	}
 
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_free_bdev_blocks(zram, zram->table[index].blk, 1);
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_stat64_sub(zram, &zram->stats.bd_count, 1);
+		goto out_dup;
+	}
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page(zram->table[index].page);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_dec(&zram->stats.pages_expand);
+		zram_stat_dec(zram, &zram->stats.pages_expand);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(zram->mem_pool, page, offset);
+	clen = zram->table[index].size;
 	if (clen <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
+		zram_stat_dec(zram, &zram->stats.good_compress);
+
+	/* Other table entries may still share this object */
+	if (zram_entry_put(zram, entry)) {
+		zram_stat64_sub(zram, &zram->stats.dup_data_size, clen);
+		goto out_dup;
+	}
 
 out:
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
-	zram_stat_dec(&zram->stats.pages_stored);
+out_dup:
+	zram_stat_dec(zram, &zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].entry = NULL;
+	zram->table[index].size = 0;
+}
+
+static void zram_free_page(struct zram *zram, size_t index)
+{
+	zram_slot_lock(zram);
+	__zram_free_page(zram, index);
+	zram_slot_unlock(zram);
 }
 
 static void handle_zero_page(struct page *page)
@@ -184,14 +254,13 @@ static void handle_zero_page(struct page *page)
 	flush_dcache_page(page);
 }
 
-static void handle_uncompressed_page(struct zram *zram,
-				struct page *page, u32 index)
+static void handle_uncompressed_page(struct page *page,
+				struct page *page_store)
 {
 	unsigned char *user_mem, *cmem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = kmap_atomic(page_store, KM_USER1);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
 	kunmap_atomic(user_mem, KM_USER0);
@@ -200,6 +269,207 @@ static void handle_uncompressed_page(struct zram *zram,
 	flush_dcache_page(page);
 }
 
+static struct zram_comp_stream *zram_comp_stream_get(struct zram *zram)
+{
+	struct zram_comp_stream *zstrm;
+
+	zstrm = per_cpu_ptr(zram->comp_streams, get_cpu());
+	put_cpu();
+
+	mutex_lock(&zstrm->lock);
+	return zstrm;
+}
+
+static void zram_comp_stream_put(struct zram_comp_stream *zstrm)
+{
+	mutex_unlock(&zstrm->lock);
+}
+
+/* Decompress @entry into @page */
+static int zram_decompress_page(struct zram *zram, struct zram_entry *entry,
+				struct page *page)
+{
+	int ret;
+	unsigned int clen = PAGE_SIZE;
+	unsigned char *user_mem, *cmem;
+	struct zram_comp_stream *zstrm;
+
+	zstrm = zram_comp_stream_get(zram);
+	user_mem = kmap_atomic(page, KM_USER0);
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+
+	ret = crypto_comp_decompress(zstrm->tfm, cmem, entry->len,
+				user_mem, &clen);
+
+	zs_unmap_object(zram->mem_pool, entry->handle);
+	kunmap_atomic(user_mem, KM_USER0);
+	zram_comp_stream_put(zstrm);
+
+	if (unlikely(!ret && clen != PAGE_SIZE))
+		ret = -EIO;
+
+	return ret;
+}
+
+static void zram_bio_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/*
+ * Synchronously transfer @nr pages from/to the backing device,
+ * starting at page @blk.
+ */
+static int zram_bdev_rw(struct zram *zram, int rw, struct page **pages,
+			unsigned int nr, unsigned long blk)
+{
+	int ret = 0;
+	unsigned int i;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	bio = bio_alloc(GFP_NOIO, nr);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = zram_bio_end_io;
+	bio->bi_private = &done;
+
+	for (i = 0; i < nr; i++) {
+		if (bio_add_page(bio, pages[i], PAGE_SIZE, 0) != PAGE_SIZE) {
+			bio_put(bio);
+			return -EIO;
+		}
+	}
+
+	submit_bio(rw, bio);
+	wait_for_completion(&done);
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		ret = -EIO;
+	bio_put(bio);
+
+	return ret;
+}
+
+struct zram_bdev_read {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int ret;
+};
+
+static void zram_bdev_read_work(struct work_struct *work)
+{
+	struct zram_bdev_read *req = container_of(work,
+					struct zram_bdev_read, work);
+
+	req->ret = zram_bdev_rw(req->zram, READ, &req->page, 1, req->blk);
+}
+
+/*
+ * Read a written back page. Bios submitted from our make_request
+ * function are only dispatched after it returns, so waiting for one
+ * here would deadlock: hand the read over to a worker instead. The
+ * read may be needed to make progress in reclaim, so it runs on a
+ * WQ_MEM_RECLAIM workqueue rather than the system one.
+ */
+static int zram_bdev_read(struct zram *zram, struct page *page,
+			unsigned long blk)
+{
+	struct zram_bdev_read req = {
+		.zram = zram,
+		.page = page,
+		.blk = blk,
+	};
+
+	INIT_WORK_ONSTACK(&req.work, zram_bdev_read_work);
+	queue_work(zram_bdev_wq, &req.work);
+	flush_work(&req.work);
+	destroy_work_on_stack(&req.work);
+
+	if (!req.ret) {
+		zram_stat64_inc(zram, &zram->stats.bd_reads);
+		flush_dcache_page(page);
+	}
+
+	return req.ret;
+}
+
+static int zram_read_page(struct zram *zram, struct page *page, u32 index)
+{
+	int ret;
+	unsigned long blk;
+	struct zram_entry *entry;
+	struct page *page_store;
+
+	zram_slot_lock(zram);
+	if (zram->bdev)
+		zram_clear_flag(zram, index, ZRAM_IDLE);
+
+	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+		zram_slot_unlock(zram);
+		handle_zero_page(page);
+		return 0;
+	}
+
+	/* Requested page is not present in compressed area */
+	if (unlikely(!zram->table[index].entry)) {
+		zram_slot_unlock(zram);
+		pr_debug("Read before write: page=%u\n", index);
+		/* Do nothing */
+		return 0;
+	}
+
+	/* Page has been moved out to the backing device */
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		blk = zram->table[index].blk;
+		zram_slot_unlock(zram);
+		return zram_bdev_read(zram, page, blk);
+	}
+
+	/*
+	 * The writeback worker may free the in-memory copy as soon as
+	 * the slot lock is dropped: hold a reference while using it.
+	 */
+
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		page_store = zram->table[index].page;
+		if (zram->bdev)
+			get_page(page_store);
+		zram_slot_unlock(zram);
+
+		handle_uncompressed_page(page, page_store);
+
+		if (zram->bdev)
+			put_page(page_store);
+		return 0;
+	}
+
+	entry = zram->table[index].entry;
+	if (zram->bdev)
+		zram_entry_pin(zram, entry);
+	zram_slot_unlock(zram);
+
+	ret = zram_decompress_page(zram, entry, page);
+
+	if (zram->bdev)
+		zram_entry_unpin(zram, entry);
+
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret)) {
+		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
+		return ret;
+	}
+
+	flush_dcache_page(page);
+	return 0;
+}
+
 static int zram_read(struct zram *zram, struct bio *bio)
 {
 
@@ -217,56 +487,11 @@ static int zram_read(struct zram *zram, struct bio *bio)
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
 	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		size_t clen;
-		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
-
-		page = bvec->bv_page;
-
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
-			continue;
-		}
-
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			/* Do nothing */
-			continue;
-		}
-
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
-			continue;
-		}
-
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
-
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
-
-		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
-			pr_err("Decompression failed! err=%d, page=%u\n",
-				ret, index);
+		if (unlikely(zram_read_page(zram, bvec->bv_page, index))) {
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
 			goto out;
 		}
 
-		flush_dcache_page(page);
 		index++;
 	}
 
@@ -281,7 +506,7 @@ out:
 
 static int zram_write(struct zram *zram, struct bio *bio)
 {
-	int i, ret;
+	int i, ret, dedup;
 	u32 index;
 	struct bio_vec *bvec;
 
@@ -294,42 +519,67 @@ static int zram_write(struct zram *zram, struct bio *bio)
 	zram_stat64_inc(zram, &zram->stats.num_writes);
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
+	/*
+	 * dedup_enable may be flipped through sysfs meanwhile: sample it
+	 * once, so that an entry is only inserted with a checksum that was
+	 * computed for it.
+	 */
+	dedup = ACCESS_ONCE(zram->dedup_enable);
+
 	bio_for_each_segment(bvec, bio, i) {
-		u32 offset;
-		size_t clen;
-		struct zobj_header *zheader;
+		u32 checksum = 0;
+		unsigned int clen;
+		struct zram_entry *entry;
+		struct zram_comp_stream *zstrm;
 		struct page *page, *page_store;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
 
 		/*
 		 * System overwrites unused sectors. Free memory associated
 		 * with this sector now.
 		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
+		zram_free_page(zram, index);
 
 		user_mem = kmap_atomic(page, KM_USER0);
 		if (page_zero_filled(user_mem)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
+			zram_stat_inc(zram, &zram->stats.pages_zero);
+			zram_slot_lock(zram);
 			zram_set_flag(zram, index, ZRAM_ZERO);
+			zram_slot_unlock(zram);
+			index++;
 			continue;
 		}
+		kunmap_atomic(user_mem, KM_USER0);
+
+		zstrm = zram_comp_stream_get(zram);
+		src = zstrm->buffer;
+
+		if (dedup) {
+			checksum = zram_dedup_checksum(page);
+			entry = zram_dedup_find(zram, page, checksum, zstrm);
+			if (entry) {
+				zram_comp_stream_put(zstrm);
+				clen = entry->len;
+
+				zram_stat64_inc(zram, &zram->stats.dup_hits);
+				zram_stat64_add(zram,
+					&zram->stats.dup_data_size, clen);
+				goto store;
+			}
+		}
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		clen = 2 * PAGE_SIZE;
+		user_mem = kmap_atomic(page, KM_USER0);
+		ret = crypto_comp_compress(zstrm->tfm, user_mem, PAGE_SIZE,
+					src, &clen);
 
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+		if (unlikely(ret)) {
+			zram_comp_stream_put(zstrm);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
@@ -341,10 +591,11 @@ static int zram_write(struct zram *zram, struct bio *bio)
 		 * errors which has side effect of hanging the system.
 		 */
 		if (unlikely(clen > max_zpage_size)) {
+			zram_comp_stream_put(zstrm);
+
 			clen = PAGE_SIZE;
 			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
 				pr_info("Error allocating memory for "
 					"incompressible page: %u\n", index);
 				zram_stat64_inc(zram,
@@ -352,52 +603,62 @@ static int zram_write(struct zram *zram, struct bio *bio)
 				goto out;
 			}
 
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
 			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
+			cmem = kmap_atomic(page_store, KM_USER1);
+			memcpy(cmem, src, clen);
+			kunmap_atomic(cmem, KM_USER1);
+			kunmap_atomic(src, KM_USER0);
+
+			zram_slot_lock(zram);
+			zram->table[index].page = page_store;
+			zram->table[index].size = clen;
+			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+			zram_slot_unlock(zram);
+
+			zram_stat_inc(zram, &zram->stats.pages_expand);
+			zram_stat64_add(zram, &zram->stats.compr_size, clen);
+			zram_stat_inc(zram, &zram->stats.pages_stored);
+
+			/* Move incompressible pages out in batches */
+			if (zram->bdev && atomic_inc_return(
+				&zram->huge_pending) >= max_wb_batch) {
+				atomic_set(&zram->huge_pending, 0);
+				zram_writeback(zram, ZRAM_WB_HUGE);
+			}
+
+			index++;
+			continue;
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
+		entry = zram_entry_alloc(zram, clen, GFP_NOIO | __GFP_HIGHMEM);
+		if (!entry) {
+			zram_comp_stream_put(zstrm);
 			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
+				"page: %u, size=%u\n", index, clen);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
-		}
-#endif
-
+		cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_WO);
 		memcpy(cmem, src, clen);
+		zs_unmap_object(zram->mem_pool, entry->handle);
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+		zram_comp_stream_put(zstrm);
 
-		/* Update stats */
+		if (dedup)
+			zram_dedup_insert(zram, entry, checksum);
 		zram_stat64_add(zram, &zram->stats.compr_size, clen);
-		zram_stat_inc(&zram->stats.pages_stored);
+
+store:
+		zram_slot_lock(zram);
+		zram->table[index].entry = entry;
+		zram->table[index].size = clen;
+		zram_slot_unlock(zram);
+
+		zram_stat_inc(zram, &zram->stats.pages_stored);
 		if (clen <= PAGE_SIZE / 2)
-			zram_stat_inc(&zram->stats.good_compress);
+			zram_stat_inc(zram, &zram->stats.good_compress);
 
-		mutex_unlock(&zram->lock);
 		index++;
 	}
 
@@ -410,6 +671,272 @@ out:
 	return 0;
 }
 
+/*
+ * Writeback: copy the slot's data into @page and mark it as being
+ * written back. Returns 0 if the slot should not be written back.
+ */
+static int zram_wb_prepare(struct zram *zram, u32 index,
+			unsigned long mode, struct page *page)
+{
+	int ret = 0;
+	struct zram_entry *entry;
+	struct page *page_store = NULL;
+
+	zram_slot_lock(zram);
+	entry = zram->table[index].entry;
+
+	if (!entry || zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		goto out_unlock;
+
+	if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+		if (!test_bit(ZRAM_WB_HUGE, &mode) &&
+		    !(test_bit(ZRAM_WB_IDLE, &mode) &&
+		      zram_test_flag(zram, index, ZRAM_IDLE)))
+			goto out_unlock;
+
+		page_store = zram->table[index].page;
+		get_page(page_store);
+	} else {
+		/* Writing back one user of a shared object frees nothing */
+		if (!test_bit(ZRAM_WB_IDLE, &mode) || entry->refcount > 1 ||
+				!zram_test_flag(zram, index, ZRAM_IDLE))
+			goto out_unlock;
+
+		zram_entry_pin(zram, entry);
+	}
+
+	zram_set_flag(zram, index, ZRAM_UNDER_WB);
+	zram_slot_unlock(zram);
+
+	if (page_store) {
+		handle_uncompressed_page(page, page_store);
+		put_page(page_store);
+		return 1;
+	}
+
+	ret = !zram_decompress_page(zram, entry, page);
+	zram_entry_unpin(zram, entry);
+	if (ret)
+		return 1;
+
+	zram_slot_lock(zram);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+out_unlock:
+	zram_slot_unlock(zram);
+	return ret;
+}
+
+/*
+ * Write @nr prepared slots out with a single bio and release their
+ * in-memory copies, unless they were overwritten or freed meanwhile.
+ */
+static void zram_wb_submit(struct zram *zram, u32 *slots,
+			struct page **pages, unsigned int nr)
+{
+	int err = -ENOSPC;
+	unsigned int i;
+	unsigned long blk;
+
+	blk = zram_alloc_bdev_blocks(zram, nr);
+	if (!blk && nr > 1) {
+		/* No contiguous space left: try with smaller bios */
+		zram_wb_submit(zram, slots, pages, nr / 2);
+		zram_wb_submit(zram, slots + nr / 2, pages + nr / 2,
+				nr - nr / 2);
+		return;
+	}
+
+	if (blk) {
+		err = zram_bdev_rw(zram, WRITE, pages, nr, blk);
+		if (err)
+			zram_free_bdev_blocks(zram, blk, nr);
+		else
+			zram_stat64_add(zram, &zram->stats.bd_writes, nr);
+	}
+
+	for (i = 0; i < nr; i++) {
+		u32 index = slots[i];
+
+		zram_slot_lock(zram);
+		if (!zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			/* Slot was freed or overwritten in the meantime */
+			if (!err)
+				zram_free_bdev_blocks(zram, blk + i, 1);
+			zram_slot_unlock(zram);
+			continue;
+		}
+
+		if (err) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_slot_unlock(zram);
+			continue;
+		}
+
+		__zram_free_page(zram, index);
+		zram->table[index].blk = blk + i;
+		zram->table[index].size = PAGE_SIZE;
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_slot_unlock(zram);
+
+		zram_stat_inc(zram, &zram->stats.pages_stored);
+		zram_stat64_inc(zram, &zram->stats.bd_count);
+	}
+}
+
+static void zram_wb_work(struct work_struct *work)
+{
+	u32 index, nr_pages, *slots;
+	unsigned int i, nr, batch;
+	unsigned long mode;
+	struct page **pages;
+	struct zram *zram = container_of(work, struct zram, wb_work);
+
+	mode = xchg(&zram->wb_mode, 0);
+
+	/* The table and the backing device only exist while initialized */
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done || !zram->bdev) {
+		mutex_unlock(&zram->init_lock);
+		return;
+	}
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+
+	pages = kcalloc(max_wb_batch, sizeof(*pages), GFP_NOIO);
+	slots = kcalloc(max_wb_batch, sizeof(*slots), GFP_NOIO);
+	if (!pages || !slots)
+		goto out;
+
+	batch = min_t(unsigned int, max_wb_batch,
+			bio_get_nr_vecs(zram->bdev));
+	batch = min_t(unsigned int, batch,
+			queue_max_sectors(bdev_get_queue(zram->bdev)) >>
+				SECTORS_PER_PAGE_SHIFT);
+	batch = max(batch, 1U);
+
+	for (i = 0; i < batch; i++) {
+		pages[i] = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+		if (!pages[i])
+			break;
+	}
+	batch = i;
+
+	index = 0;
+	while (batch && index < nr_pages) {
+		for (nr = 0; nr < batch && index < nr_pages; index++) {
+			if (zram_wb_prepare(zram, index, mode, pages[nr]))
+				slots[nr++] = index;
+		}
+
+		if (nr)
+			zram_wb_submit(zram, slots, pages, nr);
+		cond_resched();
+	}
+
+	for (i = 0; i < batch; i++)
+		__free_page(pages[i]);
+out:
+	kfree(slots);
+	kfree(pages);
+	mutex_unlock(&zram->init_lock);
+}
+
+/*
+ * Queue writeback of the pages selected by @mode. The actual work is
+ * done asynchronously, a batch of pages per bio.
+ */
+void zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	if (!zram->bdev)
+		return;
+
+	set_bit(mode, &zram->wb_mode);
+	schedule_work(&zram->wb_work);
+}
+
+/* Mark all stored pages idle; any access clears the mark again */
+void zram_mark_idle(struct zram *zram)
+{
+	u32 index;
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done || !zram->bdev)
+		goto out;
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		zram_slot_lock(zram);
+		if (zram->table[index].entry &&
+				!zram_test_flag(zram, index, ZRAM_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		zram_slot_unlock(zram);
+	}
+out:
+	mutex_unlock(&zram->init_lock);
+}
+
+static void zram_reset_backing_dev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	close_bdev_exclusive(zram->bdev, FMODE_READ | FMODE_WRITE);
+	vfree(zram->bitmap);
+	kfree(zram->backing_dev_path);
+
+	zram->bdev = NULL;
+	zram->bitmap = NULL;
+	zram->nr_bdev_pages = 0;
+	zram->backing_dev_path = NULL;
+}
+
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	int ret = 0;
+	unsigned long nr_pages;
+	struct block_device *bdev;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		pr_info("Cannot change backing device for initialized "
+			"device\n");
+		ret = -EBUSY;
+		goto out;
+	}
+
+	zram_reset_backing_dev(zram);
+
+	/* An empty path just removes the backing device */
+	if (!*path)
+		goto out;
+
+	bdev = open_bdev_exclusive(path, FMODE_READ | FMODE_WRITE, zram);
+	if (IS_ERR(bdev)) {
+		pr_err("Error opening backing device %s\n", path);
+		ret = PTR_ERR(bdev);
+		goto out;
+	}
+
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	zram->bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	zram->backing_dev_path = kstrdup(path, GFP_KERNEL);
+	if (nr_pages < 2 || !zram->bitmap || !zram->backing_dev_path) {
+		close_bdev_exclusive(bdev, FMODE_READ | FMODE_WRITE);
+		vfree(zram->bitmap);
+		kfree(zram->backing_dev_path);
+		zram->bitmap = NULL;
+		zram->backing_dev_path = NULL;
+		ret = nr_pages < 2 ? -EINVAL : -ENOMEM;
+		goto out;
+	}
+
+	zram->bdev = bdev;
+	zram->nr_bdev_pages = nr_pages;
+	pr_info("Using %s as backing device (%lu pages)\n", path, nr_pages);
+out:
+	mutex_unlock(&zram->init_lock);
+	return ret;
+}
+
 /*
  * Check if request is within bounds and page aligned.
  */
@@ -454,43 +981,106 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 	return ret;
 }
 
+static void zram_destroy_comp_streams(struct zram *zram)
+{
+	int cpu;
+
+	if (!zram->comp_streams)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct zram_comp_stream *zstrm;
+
+		zstrm = per_cpu_ptr(zram->comp_streams, cpu);
+		if (!IS_ERR_OR_NULL(zstrm->tfm))
+			crypto_free_comp(zstrm->tfm);
+		free_pages((unsigned long)zstrm->buffer, 1);
+	}
+
+	free_percpu(zram->comp_streams);
+	zram->comp_streams = NULL;
+}
+
+/*
+ * Allocate one compression stream for each possible CPU so that
+ * concurrent writers compress in parallel instead of serializing
+ * on a single set of buffers. Each stream gets its own transform
+ * of the selected algorithm since compressors keep per-transform
+ * working state.
+ */
+static int zram_create_comp_streams(struct zram *zram)
+{
+	int cpu;
+
+	zram->comp_streams = alloc_percpu(struct zram_comp_stream);
+	if (!zram->comp_streams) {
+		pr_err("Error allocating compression streams\n");
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct zram_comp_stream *zstrm;
+
+		zstrm = per_cpu_ptr(zram->comp_streams, cpu);
+		mutex_init(&zstrm->lock);
+
+		zstrm->tfm = crypto_alloc_comp(zram->compressor, 0, 0);
+		if (IS_ERR(zstrm->tfm)) {
+			pr_err("Error allocating %s compressor\n",
+				zram->compressor);
+			return PTR_ERR(zstrm->tfm);
+		}
+
+		zstrm->buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
+		if (!zstrm->buffer) {
+			pr_err("Error allocating compressor buffer space\n");
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
 void zram_reset_device(struct zram *zram)
 {
 	size_t index;
 
+	/*
+	 * Writeback walks the table under init_lock, wait for it before
+	 * taking the lock. If it gets queued again meanwhile, it finds the
+	 * device uninitialized and does nothing.
+	 */
+	cancel_work_sync(&zram->wb_work);
+
 	mutex_lock(&zram->init_lock);
 	zram->init_done = 0;
+	zram->wb_mode = 0;
+	atomic_set(&zram->huge_pending, 0);
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	zram_destroy_comp_streams(zram);
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
-
-		if (!page)
+		if (!zram->table[index].entry ||
+				zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
+			__free_page(zram->table[index].page);
 		else
-			xv_free(zram->mem_pool, page, offset);
+			zram_entry_put(zram, zram->table[index].entry);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
+	zram_reset_backing_dev(zram);
+
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -512,19 +1102,9 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
+	ret = zram_create_comp_streams(zram);
+	if (ret)
 		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
 
 	num_pages = zram->disksize >> PAGE_SHIFT;
 	zram->table = vmalloc(num_pages * sizeof(*zram->table));
@@ -542,7 +1122,7 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool();
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -581,9 +1161,16 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	spin_lock_init(&zram->dedup_lock);
+	zram->dedup_tree = RB_ROOT;
+	spin_lock_init(&zram->bitmap_lock);
+	spin_lock_init(&zram->wb_lock);
+	INIT_WORK(&zram->wb_work, zram_wb_work);
+	atomic_set(&zram->huge_pending, 0);
+	strlcpy(zram->compressor, default_compressor,
+		sizeof(zram->compressor));
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -669,11 +1256,24 @@ static int __init zram_init(void)
 		goto out;
 	}
 
+	ret = zram_dedup_init();
+	if (ret) {
+		pr_warning("Unable to create entry cache\n");
+		goto out;
+	}
+
+	zram_bdev_wq = alloc_workqueue("zram_bdev", WQ_MEM_RECLAIM, 0);
+	if (!zram_bdev_wq) {
+		pr_warning("Unable to create workqueue\n");
+		ret = -ENOMEM;
+		goto dedup_exit;
+	}
+
 	zram_major = register_blkdev(0, "zram");
 	if (zram_major <= 0) {
 		pr_warning("Unable to get major number\n");
 		ret = -EBUSY;
-		goto out;
+		goto destroy_wq;
 	}
 
 	if (!num_devices) {
@@ -703,6 +1303,10 @@ free_devices:
 	kfree(devices);
 unregister:
 	unregister_blkdev(zram_major, "zram");
+destroy_wq:
+	destroy_workqueue(zram_bdev_wq);
+dedup_exit:
+	zram_dedup_exit();
 out:
 	return ret;
 }
@@ -721,6 +1325,8 @@ static void __exit zram_exit(void)
 	}
 
 	unregister_blkdev(zram_major, "zram");
+	destroy_workqueue(zram_bdev_wq);
+	zram_dedup_exit();
 
 	kfree(devices);
 	pr_debug("Cleanup done!\n");
@@ -15,10 +15,13 @@
 #ifndef _ZRAM_DRV_H_
 #define _ZRAM_DRV_H_
 
+#include <linux/crypto.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/rbtree.h>
+#include <linux/workqueue.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,23 +29,14 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 
+/* Default compression algorithm (any crypto API compressor works) */
+static const char default_compressor[] = "lzo";
+
 /*
  * Pages that compress to size greater than this are stored
  * uncompressed in memory.
@@ -51,10 +45,16 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - ZS_OBJ_HDR_SIZE
+ * otherwise, zs_malloc() would always return failure.
  */
 
+/*
+ * Maximum number of pages written back to the backing
+ * device with a single bio.
+ */
+static const unsigned max_wb_batch = 32;
+
 /*-- End of configurable params */
 
 #define SECTOR_SHIFT		9
@@ -70,15 +70,41 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
 
+	/* Page has been written back to the backing device */
+	ZRAM_WB,
+
+	/* Page is being written back to the backing device */
+	ZRAM_UNDER_WB,
+
+	/* Page has not been accessed since it was last marked idle */
+	ZRAM_IDLE,
+
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/*
+ * Compressed object. With deduplication enabled, one entry is shared
+ * (and refcounted) by all table slots holding identical pages.
+ */
+struct zram_entry {
+	struct rb_node rb_node;	/* in zram->dedup_tree, keyed by checksum */
+	u32 checksum;		/* of the uncompressed page */
+	u32 len;		/* compressed size */
+	unsigned int refcount;	/* table slots using this object */
+	unsigned int pins;	/* transient users, see zram_entry_pin() */
+	unsigned long handle;	/* zsmalloc handle */
+};
+
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	union {
+		struct zram_entry *entry;
+		struct page *page;	/* ZRAM_UNCOMPRESSED pages */
+		unsigned long blk;	/* ZRAM_WB: backing device page */
+	};
+	u16 size;	/* object size (excluding header) */
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -95,21 +121,64 @@ struct zram_stats {
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
+	u64 dup_hits;		/* writes satisfied by an existing object */
+	u64 dup_data_size;	/* compressed bytes saved by deduplication */
+	u64 bd_count;		/* no. of pages on the backing device */
+	u64 bd_reads;		/* pages read from the backing device */
+	u64 bd_writes;		/* pages written to the backing device */
+};
+
+/* Writeback modes (zram->wb_mode bits) */
+enum zram_wb_mode {
+	ZRAM_WB_HUGE,		/* incompressible pages */
+	ZRAM_WB_IDLE,		/* pages marked idle and not touched since */
+};
+
+/*
+ * Per-CPU compression stream: compressor transform and output buffer.
+ * The mutex is needed since the compressing task may sleep (allocating
+ * memory for the compressed object) and migrate to another CPU while
+ * still using the stream.
+ */
+struct zram_comp_stream {
+	struct mutex lock;
+	struct crypto_comp *tfm;
+	void *buffer;
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zram_comp_stream *comp_streams;	/* per-CPU */
 	struct table *table;
-	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	spinlock_t stat64_lock;	/* protect stats against concurrent writers */
+	int dedup_enable;
+	struct rb_root dedup_tree;
+	spinlock_t dedup_lock;	/* protect dedup_tree and entry refcounts */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
 	/* Prevent concurrent execution of device init and reset */
 	struct mutex init_lock;
+	char compressor[CRYPTO_MAX_ALG_NAME];
+
+	/*
+	 * Optional backing device that incompressible and idle pages
+	 * are written back to. It can only be set before the device is
+	 * initialized, so it does not change while I/O is going on.
+	 */
+	char *backing_dev_path;
+	struct block_device *bdev;
+	unsigned long *bitmap;		/* allocated backing device pages */
+	unsigned long nr_bdev_pages;
+	spinlock_t bitmap_lock;
+	/*
+	 * With a backing device, table entries can change under a reader
+	 * or writer (writeback worker), so they are updated under wb_lock.
+	 */
+	spinlock_t wb_lock;
+	struct work_struct wb_work;
+	unsigned long wb_mode;
+	atomic_t huge_pending;		/* huge pages not yet written back */
 	/*
 	 * This is the limit on amount of *uncompressed* worth of data
 	 * we can store in a disk.
@@ -128,4 +197,24 @@ extern struct attribute_group zram_disk_attr_group;
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
 
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_mark_idle(struct zram *zram);
+extern void zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+
+extern struct zram_entry *zram_entry_alloc(struct zram *zram, u32 len,
+					gfp_t flags);
+extern unsigned int zram_entry_put(struct zram *zram,
+				struct zram_entry *entry);
+extern void zram_entry_pin(struct zram *zram, struct zram_entry *entry);
+extern void zram_entry_unpin(struct zram *zram, struct zram_entry *entry);
+
+extern u32 zram_dedup_checksum(struct page *page);
+extern void zram_dedup_insert(struct zram *zram, struct zram_entry *entry,
+				u32 checksum);
+extern struct zram_entry *zram_dedup_find(struct zram *zram,
+				struct page *page, u32 checksum,
+				struct zram_comp_stream *zstrm);
+extern int zram_dedup_init(void);
+extern void zram_dedup_exit(void);
+
 #endif
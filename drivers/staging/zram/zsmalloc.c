@@ -0,0 +1,635 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Objects are grouped into size classes ZS_SIZE_CLASS_DELTA bytes
+ * apart. Each class packs its objects back-to-back into zspages: runs
+ * of up to ZS_MAX_PAGES_PER_ZSPAGE 0-order pages, sized so that the
+ * tail waste of the run is minimal. Unlike xvmalloc, objects never
+ * share a page with objects of a different size, so a page can always
+ * be given back once its class has been compacted, regardless of the
+ * order in which objects were freed.
+ */
+
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static u32 get_size_class_index(u32 size)
+{
+	if (unlikely(size < ZS_MIN_ALLOC_SIZE))
+		return 0;
+	return DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE, ZS_SIZE_CLASS_DELTA);
+}
+
+/*
+ * Find the number of pages per zspage which wastes the least
+ * space at the tail for objects of the given size.
+ */
+static u32 get_pages_per_zspage(u32 size)
+{
+	u32 i, best = 1, min_waste = PAGE_SIZE;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		u32 waste = (i * PAGE_SIZE) % size;
+
+		/* compare waste per page */
+		if (waste * best < min_waste * i) {
+			min_waste = waste;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+static unsigned long obj_offset(struct size_class *class, u32 obj_idx)
+{
+	return (unsigned long)obj_idx * class->size;
+}
+
+static unsigned long obj_hdr_read(struct zspage *zspage, u32 obj_idx)
+{
+	unsigned long off, hdr;
+	unsigned char *base;
+
+	off = obj_offset(zspage->class, obj_idx);
+	base = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+	hdr = *(unsigned long *)(base + (off & ~PAGE_MASK));
+	kunmap_atomic(base, KM_USER1);
+
+	return hdr;
+}
+
+static void obj_hdr_write(struct zspage *zspage, u32 obj_idx,
+				unsigned long hdr)
+{
+	unsigned long off;
+	unsigned char *base;
+
+	off = obj_offset(zspage->class, obj_idx);
+	base = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+	*(unsigned long *)(base + (off & ~PAGE_MASK)) = hdr;
+	kunmap_atomic(base, KM_USER1);
+}
+
+/*
+ * Copy @len bytes between @buf and the zspage, starting at byte
+ * @off of the run. Crosses page boundaries as needed.
+ */
+static void zspage_copy(struct zspage *zspage, unsigned long off,
+			char *buf, u32 len, int to_zspage)
+{
+	while (len) {
+		unsigned char *base;
+		u32 poff = off & ~PAGE_MASK;
+		u32 n = min_t(u32, len, PAGE_SIZE - poff);
+
+		base = kmap_atomic(zspage->pages[off >> PAGE_SHIFT],
+					KM_USER1);
+		if (to_zspage)
+			memcpy(base + poff, buf, n);
+		else
+			memcpy(buf, base + poff, n);
+		kunmap_atomic(base, KM_USER1);
+
+		off += n;
+		buf += n;
+		len -= n;
+	}
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+						struct zspage *zspage)
+{
+	if (zspage->inuse == class->objs_per_zspage)
+		return ZS_FULL;
+	if (zspage->inuse * 4 >= class->objs_per_zspage * 3)
+		return ZS_ALMOST_FULL;
+	return ZS_ALMOST_EMPTY;
+}
+
+static void insert_zspage(struct size_class *class, struct zspage *zspage)
+{
+	zspage->fullness = get_fullness_group(class, zspage);
+	list_add(&zspage->list, &class->fullness_list[zspage->fullness]);
+}
+
+static void remove_zspage(struct zspage *zspage)
+{
+	list_del_init(&zspage->list);
+}
+
+static void fix_fullness_group(struct size_class *class,
+				struct zspage *zspage)
+{
+	if (get_fullness_group(class, zspage) == zspage->fullness)
+		return;
+
+	remove_zspage(zspage);
+	insert_zspage(class, zspage);
+}
+
+/*
+ * Zspage to allocate from: prefer the fullest one so that sparsely
+ * used zspages drain and can be released.
+ */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int i;
+
+	for (i = ZS_ALMOST_FULL; i >= ZS_ALMOST_EMPTY; i--) {
+		if (!list_empty(&class->fullness_list[i]))
+			return list_first_entry(&class->fullness_list[i],
+						struct zspage, list);
+	}
+
+	return NULL;
+}
+
+static void free_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	u32 i;
+	struct size_class *class = zspage->class;
+
+	for (i = 0; i < class->pages_per_zspage; i++)
+		__free_page(zspage->pages[i]);
+
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+	kfree(zspage);
+}
+
+static struct zspage *alloc_zspage(struct size_class *class, gfp_t flags)
+{
+	u32 i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	zspage->class = class;
+	INIT_LIST_HEAD(&zspage->list);
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(flags);
+		if (!zspage->pages[i])
+			goto fail;
+	}
+
+	/* Link all objects into the free list */
+	for (i = 0; i < class->objs_per_zspage; i++)
+		obj_hdr_write(zspage, i, (unsigned long)(i + 1) <<
+						ZS_OBJ_TAG_BITS);
+	zspage->freeobj = 0;
+
+	return zspage;
+
+fail:
+	while (i)
+		__free_page(zspage->pages[--i]);
+	kfree(zspage);
+	return NULL;
+}
+
+static void obj_alloc(struct size_class *class, struct zspage *zspage,
+			struct zs_handle *handle)
+{
+	u32 obj_idx = zspage->freeobj;
+
+	zspage->freeobj = obj_hdr_read(zspage, obj_idx) >> ZS_OBJ_TAG_BITS;
+	obj_hdr_write(zspage, obj_idx,
+		(unsigned long)handle | ZS_OBJ_ALLOCATED);
+
+	handle->zspage = zspage;
+	handle->obj_idx = obj_idx;
+
+	zspage->inuse++;
+	class->obj_inuse++;
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			u32 obj_idx)
+{
+	obj_hdr_write(zspage, obj_idx,
+		(unsigned long)zspage->freeobj << ZS_OBJ_TAG_BITS);
+	zspage->freeobj = obj_idx;
+
+	zspage->inuse--;
+	class->obj_inuse--;
+}
+
+/* Number of zspages the class could release by compaction */
+static u32 zs_can_compact(struct size_class *class)
+{
+	u32 obj_wasted;
+
+	obj_wasted = class->num_zspages * class->objs_per_zspage -
+			class->obj_inuse;
+	return obj_wasted / class->objs_per_zspage;
+}
+
+static void zs_compact_work(struct work_struct *work)
+{
+	struct zs_pool *pool = container_of(work, struct zs_pool,
+						compact_work);
+
+	zs_compact(pool);
+}
+
+/**
+ * zs_create_pool - create a memory pool
+ *
+ * Returns NULL on failure.
+ */
+struct zs_pool *zs_create_pool(void)
+{
+	int i, cpu;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_NUM_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock_init(&class->lock);
+		for (fg = 0; fg < __NR_ZS_FULLNESS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage * PAGE_SIZE /
+						class->size;
+	}
+
+	rwlock_init(&pool->migrate_lock);
+	INIT_WORK(&pool->compact_work, zs_compact_work);
+
+	pool->map_areas = alloc_percpu(struct zs_map_area);
+	if (!pool->map_areas)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct zs_map_area *area = per_cpu_ptr(pool->map_areas, cpu);
+
+		area->buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->buf)
+			goto fail;
+	}
+
+	return pool;
+
+fail:
+	zs_destroy_pool(pool);
+	return NULL;
+}
+
+/**
+ * zs_destroy_pool - destroy a memory pool
+ * @pool: pool to destroy
+ *
+ * All objects must have been freed before calling this.
+ */
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i, cpu;
+
+	cancel_work_sync(&pool->compact_work);
+
+	for (i = 0; i < ZS_NUM_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		for (fg = 0; fg < __NR_ZS_FULLNESS; fg++) {
+			if (!list_empty(&class->fullness_list[fg]))
+				pr_info("zsmalloc: freeing pool with objects "
+					"still in use (class size %u)\n",
+					class->size);
+		}
+	}
+
+	if (pool->map_areas) {
+		for_each_possible_cpu(cpu)
+			kfree(per_cpu_ptr(pool->map_areas, cpu)->buf);
+		free_percpu(pool->map_areas);
+	}
+
+	kfree(pool);
+}
+
+/**
+ * zs_malloc - allocate block of given size from pool
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ * @flags: flags for allocating pages backing the pool
+ *
+ * Returns an opaque handle for the allocated object, or 0 on
+ * failure. The object must be mapped with zs_map_object() before
+ * it can be accessed.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags)
+{
+	struct zs_handle *handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	size += ZS_OBJ_HDR_SIZE;
+	if (unlikely(size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	handle = kmalloc(sizeof(*handle), flags & ~__GFP_HIGHMEM);
+	if (unlikely(!handle))
+		return 0;
+
+	class = &pool->size_class[get_size_class_index(size)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(class, flags);
+		if (unlikely(!zspage)) {
+			kfree(handle);
+			return 0;
+		}
+
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+
+		spin_lock(&class->lock);
+		class->num_zspages++;
+		insert_zspage(class, zspage);
+	}
+
+	obj_alloc(class, zspage, handle);
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)handle;
+}
+
+/**
+ * zs_free - free an object allocated by zs_malloc()
+ * @pool: pool the object belongs to
+ * @handle: handle returned by zs_malloc()
+ */
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	int compact;
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct zspage *zspage, *empty = NULL;
+	struct size_class *class;
+
+	if (unlikely(!handle))
+		return;
+
+	read_lock(&pool->migrate_lock);
+	zspage = h->zspage;
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, h->obj_idx);
+
+	if (!zspage->inuse) {
+		remove_zspage(zspage);
+		class->num_zspages--;
+		empty = zspage;
+	} else {
+		fix_fullness_group(class, zspage);
+	}
+
+	compact = zs_can_compact(class) >= ZS_COMPACT_THRESHOLD;
+	spin_unlock(&class->lock);
+	read_unlock(&pool->migrate_lock);
+
+	if (empty)
+		free_zspage(pool, empty);
+	kfree(h);
+
+	if (compact)
+		schedule_work(&pool->compact_work);
+}
+
+/**
+ * zs_map_object - get a pointer to an object's data
+ * @pool: pool the object belongs to
+ * @handle: handle returned by zs_malloc()
+ * @mm: how the caller is going to access the object
+ *
+ * Objects that straddle two pages are bounced through a per-CPU
+ * buffer. The mapping is atomic: the caller must not sleep until
+ * it calls zs_unmap_object(), and only one object can be mapped
+ * at a time on each CPU.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	unsigned long off;
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct zs_map_area *area;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	/* Object cannot move until zs_unmap_object() */
+	read_lock(&pool->migrate_lock);
+
+	zspage = h->zspage;
+	class = zspage->class;
+	off = obj_offset(class, h->obj_idx);
+
+	area = per_cpu_ptr(pool->map_areas, smp_processor_id());
+	area->mm = mm;
+
+	if ((off & ~PAGE_MASK) + class->size <= PAGE_SIZE) {
+		area->vaddr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT],
+						KM_USER1);
+		return area->vaddr + (off & ~PAGE_MASK) + ZS_OBJ_HDR_SIZE;
+	}
+
+	area->vaddr = NULL;
+	if (mm != ZS_MM_WO)
+		zspage_copy(zspage, off + ZS_OBJ_HDR_SIZE, area->buf,
+				class->size - ZS_OBJ_HDR_SIZE, 0);
+
+	return area->buf;
+}
+
+/**
+ * zs_unmap_object - release a mapping made by zs_map_object()
+ * @pool: pool the object belongs to
+ * @handle: handle of the mapped object
+ */
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct zs_map_area *area;
+	struct size_class *class;
+
+	area = per_cpu_ptr(pool->map_areas, smp_processor_id());
+
+	if (area->vaddr) {
+		kunmap_atomic(area->vaddr, KM_USER1);
+	} else if (area->mm != ZS_MM_RO) {
+		class = h->zspage->class;
+		zspage_copy(h->zspage,
+			obj_offset(class, h->obj_idx) + ZS_OBJ_HDR_SIZE,
+			area->buf, class->size - ZS_OBJ_HDR_SIZE, 1);
+	}
+
+	read_unlock(&pool->migrate_lock);
+}
+
+/*
+ * Move every live object of @src into other zspages of the class.
+ * @src must already be off the fullness lists. Returns 0 if it ran
+ * out of destination space before @src was drained.
+ */
+static int migrate_zspage(struct size_class *class, struct zspage *src,
+				char *buf)
+{
+	u32 obj_idx;
+	u32 len = class->size - ZS_OBJ_HDR_SIZE;
+
+	for (obj_idx = 0; obj_idx < class->objs_per_zspage && src->inuse;
+							obj_idx++) {
+		unsigned long hdr;
+		struct zs_handle *h;
+		struct zspage *dst;
+
+		hdr = obj_hdr_read(src, obj_idx);
+		if (!(hdr & ZS_OBJ_ALLOCATED))
+			continue;
+
+		dst = find_get_zspage(class);
+		if (!dst)
+			return 0;
+
+		h = (struct zs_handle *)(hdr & ~ZS_OBJ_ALLOCATED);
+		zspage_copy(src, obj_offset(class, obj_idx) + ZS_OBJ_HDR_SIZE,
+				buf, len, 0);
+
+		obj_alloc(class, dst, h);
+		fix_fullness_group(class, dst);
+		zspage_copy(dst, obj_offset(class, h->obj_idx) +
+				ZS_OBJ_HDR_SIZE, buf, len, 1);
+
+		obj_free(class, src, obj_idx);
+	}
+
+	return 1;
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				struct size_class *class, char *buf)
+{
+	unsigned long pages_freed = 0;
+
+	while (1) {
+		struct zspage *src, *empty = NULL;
+		struct list_head *list;
+
+		write_lock(&pool->migrate_lock);
+		spin_lock(&class->lock);
+
+		list = &class->fullness_list[ZS_ALMOST_EMPTY];
+		if (!zs_can_compact(class) || list_empty(list)) {
+			spin_unlock(&class->lock);
+			write_unlock(&pool->migrate_lock);
+			break;
+		}
+
+		/* Least recently filled zspage is the most likely sparse */
+		src = list_entry(list->prev, struct zspage, list);
+		remove_zspage(src);
+
+		if (migrate_zspage(class, src, buf) && !src->inuse) {
+			class->num_zspages--;
+			empty = src;
+		} else {
+			insert_zspage(class, src);
+		}
+
+		spin_unlock(&class->lock);
+		write_unlock(&pool->migrate_lock);
+
+		if (!empty)
+			break;
+
+		free_zspage(pool, empty);
+		pages_freed += class->pages_per_zspage;
+		cond_resched();
+	}
+
+	return pages_freed;
+}
+
+/**
+ * zs_compact - release pages held by sparsely used zspages
+ * @pool: pool to compact
+ *
+ * Moves objects out of sparsely used zspages into fuller ones of the
+ * same class and frees the zspages left empty. Called from process
+ * context; scheduled automatically from zs_free() once a class has
+ * enough reclaimable space.
+ *
+ * Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	char *buf;
+	unsigned long pages_freed = 0;
+
+	buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_NOIO);
+	if (!buf)
+		return 0;
+
+	for (i = ZS_NUM_SIZE_CLASSES - 1; i >= 0; i--)
+		pages_freed += zs_compact_class(pool, &pool->size_class[i],
+						buf);
+
+	kfree(buf);
+	atomic_long_add(pages_freed, &pool->pages_compacted);
+
+	return pages_freed;
+}
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+
+void zs_get_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	int i;
+
+	stats->pages_allocated = atomic_long_read(&pool->pages_allocated);
+	stats->pages_compacted = atomic_long_read(&pool->pages_compacted);
+	stats->obj_used_bytes = 0;
+
+	for (i = 0; i < ZS_NUM_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		stats->obj_used_bytes += (u64)class->obj_inuse * class->size;
+		spin_unlock(&class->lock);
+	}
+}
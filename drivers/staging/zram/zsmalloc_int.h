@@ -0,0 +1,122 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+/* User configurable params */
+
+/* Maximum number of 0-order pages making up one zspage */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/* Size classes are separated by ZS_SIZE_CLASS_DELTA bytes */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+
+/*
+ * Kick background compaction once a size class could give back
+ * at least this many zspages.
+ */
+#define ZS_COMPACT_THRESHOLD	4
+
+/* End of user params */
+
+/*
+ * Every object starts with a header word. For allocated objects it
+ * holds the handle (tagged with ZS_OBJ_ALLOCATED) so that compaction
+ * can find and update the owner; for free objects it holds the index
+ * of the next free object, shifted left by ZS_OBJ_TAG_BITS.
+ *
+ * All class sizes are multiples of ZS_SIZE_CLASS_DELTA which is itself
+ * a multiple of sizeof(unsigned long), so the header word never
+ * straddles a page boundary even when the object payload does.
+ */
+#define ZS_OBJ_HDR_SIZE		sizeof(unsigned long)
+#define ZS_OBJ_TAG_BITS		1
+#define ZS_OBJ_ALLOCATED	1UL
+
+/* Must be greater than ZS_OBJ_HDR_SIZE */
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+#define ZS_NUM_SIZE_CLASSES	((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) \
+					/ ZS_SIZE_CLASS_DELTA + 1)
+
+/*
+ * A zspage is kept on the fullness list of its class matching its
+ * current usage. Completely empty zspages are freed right away.
+ */
+enum fullness_group {
+	ZS_ALMOST_EMPTY,	/* less than 3/4 used */
+	ZS_ALMOST_FULL,		/* at least 3/4 used */
+	ZS_FULL,
+	__NR_ZS_FULLNESS,
+};
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head fullness_list[__NR_ZS_FULLNESS];
+	u32 size;		/* object size, including header */
+	u32 pages_per_zspage;
+	u32 objs_per_zspage;
+	u32 num_zspages;
+	u32 obj_inuse;
+};
+
+/*
+ * A run of (not necessarily contiguous) 0-order pages that objects
+ * of a single size class are packed into. Objects may straddle the
+ * boundary between two consecutive pages of the run.
+ */
+struct zspage {
+	struct list_head list;
+	struct size_class *class;
+	u16 inuse;
+	u16 freeobj;		/* first free object, objs_per_zspage if none */
+	u8 fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+/*
+ * Handles given out to users point to one of these. The indirection
+ * lets compaction move objects without the user's knowledge.
+ */
+struct zs_handle {
+	struct zspage *zspage;
+	u32 obj_idx;
+};
+
+/* Per-CPU state between zs_map_object() and zs_unmap_object() */
+struct zs_map_area {
+	char *buf;		/* bounce buffer for straddling objects */
+	void *vaddr;		/* kmap_atomic() address, NULL if bounced */
+	enum zs_mapmode mm;
+};
+
+struct zs_pool {
+	struct size_class size_class[ZS_NUM_SIZE_CLASSES];
+
+	/*
+	 * Taken for read while an object is mapped or freed and for
+	 * write while compaction moves objects between zspages.
+	 */
+	rwlock_t migrate_lock;
+	struct zs_map_area *map_areas;	/* per-CPU */
+
+	struct work_struct compact_work;
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+};
+
+#endif
@@ -23,7 +23,11 @@
 #include <linux/kernel.h>
 #include <linux/mm.h>
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/log2.h>
 #include <linux/seq_file.h>
 #include <linux/memblock.h>
 #include <linux/completion.h>
@@ -58,22 +62,49 @@ static struct {
 	size_t size;
 } postponed_regions[MAX_POSTPONED_REGIONS];
 
+/*
+ * Each region is managed as a binary buddy allocator.  Blocks of 2^order
+ * pages sit on per-order free lists, clean (already zeroed) blocks at the
+ * head and dirty ones at the tail.  Freed memory is zeroed by DMA in the
+ * background, so that allocations can usually be served from clean blocks
+ * without waiting for a clear.
+ */
+#define VRAM_MAX_ORDER		14
+
 struct vram_alloc {
-	struct list_head list;
+	struct rb_node node;
 	unsigned long paddr;
 	unsigned pages;
 };
 
+/* per page state, only valid for the first page of a free block */
+struct vram_page {
+	struct list_head list;
+	s8 order;		/* order of the free block, -1 if not free */
+	u8 dirty;		/* block has not been cleared yet */
+};
+
 struct vram_region {
 	struct list_head list;
-	struct list_head alloc_list;
+	struct rb_root allocs;
 	unsigned long paddr;
 	unsigned pages;
+
+	struct vram_page *page;
+	struct list_head free_area[VRAM_MAX_ORDER];
+	unsigned nr_free[VRAM_MAX_ORDER];
+	unsigned free_pages;
+	unsigned dirty_pages;
+	unsigned clearing_pages;
+	unsigned nr_allocs;
 };
 
 static DEFINE_MUTEX(region_mutex);
 static LIST_HEAD(region_list);
 
+static void omap_vram_clear_work(struct work_struct *work);
+static DECLARE_WORK(vram_clear_work, omap_vram_clear_work);
+
 static inline int region_mem_type(unsigned long paddr)
 {
 	if (paddr >= OMAP2_SRAM_START &&
@@ -83,19 +114,228 @@ static inline int region_mem_type(unsigned long paddr)
 		return OMAP_VRAM_MEMTYPE_SDRAM;
 }
 
+static inline unsigned region_pfn(struct vram_region *vr, unsigned long paddr)
+{
+	return (paddr - vr->paddr) >> PAGE_SHIFT;
+}
+
+static void vram_add_block(struct vram_region *vr, unsigned pfn, int order,
+		bool dirty)
+{
+	struct vram_page *pg = &vr->page[pfn];
+
+	pg->order = order;
+	pg->dirty = dirty;
+
+	if (dirty) {
+		list_add_tail(&pg->list, &vr->free_area[order]);
+		vr->dirty_pages += 1 << order;
+	} else {
+		list_add(&pg->list, &vr->free_area[order]);
+	}
+
+	vr->nr_free[order]++;
+	vr->free_pages += 1 << order;
+}
+
+static void vram_del_block(struct vram_region *vr, unsigned pfn)
+{
+	struct vram_page *pg = &vr->page[pfn];
+	int order = pg->order;
+
+	list_del(&pg->list);
+
+	if (pg->dirty)
+		vr->dirty_pages -= 1 << order;
+
+	vr->nr_free[order]--;
+	vr->free_pages -= 1 << order;
+	pg->order = -1;
+}
+
+/* free an aligned block, merging it with free buddies in the same state */
+static void vram_free_block(struct vram_region *vr, unsigned pfn, int order,
+		bool dirty)
+{
+	while (order < VRAM_MAX_ORDER - 1) {
+		unsigned buddy = pfn ^ (1 << order);
+
+		if (buddy >= vr->pages ||
+		    vr->page[buddy].order != order ||
+		    vr->page[buddy].dirty != dirty)
+			break;
+
+		vram_del_block(vr, buddy);
+		pfn &= ~(1 << order);
+		order++;
+	}
+
+	vram_add_block(vr, pfn, order, dirty);
+}
+
+/* return pages [pfn, pfn + pages) to the free lists */
+static void vram_release(struct vram_region *vr, unsigned pfn, unsigned pages,
+		bool dirty)
+{
+	int order;
+
+	while (pages) {
+		order = min_t(int, ilog2(pages), VRAM_MAX_ORDER - 1);
+		if (pfn)
+			order = min_t(int, order, __ffs(pfn));
+
+		vram_free_block(vr, pfn, order, dirty);
+
+		pfn += 1 << order;
+		pages -= 1 << order;
+	}
+}
+
+/* first page of the free block containing pfn, or -1 */
+static int vram_find_block(struct vram_region *vr, unsigned pfn)
+{
+	unsigned head;
+	int order;
+
+	for (order = 0; order < VRAM_MAX_ORDER; order++) {
+		head = pfn & ~((1 << order) - 1);
+		if (vr->page[head].order == order)
+			return head;
+	}
+
+	return -1;
+}
+
+/*
+ * Take pages [pfn, pfn + pages) off the free lists, giving back the parts
+ * of the covering blocks that lie outside the range.  Sets *dirty if any
+ * of the pages still has to be cleared.
+ */
+static int vram_carve(struct vram_region *vr, unsigned pfn, unsigned pages,
+		bool *dirty)
+{
+	unsigned end = pfn + pages;
+	unsigned p, bend;
+	int head;
+	bool d;
+
+	for (p = pfn; p < end; p = head + (1 << vr->page[head].order)) {
+		head = vram_find_block(vr, p);
+		if (head < 0)
+			return -ENOMEM;
+	}
+
+	*dirty = false;
+
+	for (p = pfn; p < end; p = bend) {
+		head = vram_find_block(vr, p);
+		bend = head + (1 << vr->page[head].order);
+		d = vr->page[head].dirty;
+
+		vram_del_block(vr, head);
+
+		if (head < pfn)
+			vram_release(vr, head, pfn - head, d);
+		if (bend > end)
+			vram_release(vr, end, bend - end, d);
+
+		*dirty |= d;
+	}
+
+	return 0;
+}
+
+/* smallest clean block that fits, or the smallest dirty one */
+static int vram_buddy_fit(struct vram_region *vr, unsigned pages,
+		unsigned *pfn)
+{
+	struct vram_page *pg, *fit = NULL;
+	int order;
+
+	for (order = get_count_order(pages); order < VRAM_MAX_ORDER; order++) {
+		if (list_empty(&vr->free_area[order]))
+			continue;
+
+		pg = list_first_entry(&vr->free_area[order],
+				struct vram_page, list);
+		if (!pg->dirty) {
+			fit = pg;
+			break;
+		}
+
+		if (!fit)
+			fit = pg;
+	}
+
+	if (!fit)
+		return -ENOMEM;
+
+	*pfn = fit - vr->page;
+	return 0;
+}
+
+/*
+ * Walk the free runs of the region, ignoring buddy alignment.  Stops at the
+ * first run of at least 'pages' pages if 'pages' is non-zero.  Returns the
+ * largest run seen.
+ */
+static unsigned vram_find_run(struct vram_region *vr, unsigned pages,
+		unsigned *pfn)
+{
+	unsigned p = 0, start = 0, largest = 0;
+	int order;
+
+	while (p < vr->pages) {
+		order = vr->page[p].order;
+		if (order < 0) {
+			start = ++p;
+			continue;
+		}
+
+		p += 1 << order;
+		largest = max(largest, p - start);
+
+		if (pages && p - start >= pages) {
+			*pfn = start;
+			break;
+		}
+	}
+
+	return largest;
+}
+
 static struct vram_region *omap_vram_create_region(unsigned long paddr,
 		unsigned pages)
 {
 	struct vram_region *rm;
+	unsigned i;
 
 	rm = kzalloc(sizeof(*rm), GFP_KERNEL);
+	if (!rm)
+		return NULL;
 
-	if (rm) {
-		INIT_LIST_HEAD(&rm->alloc_list);
-		rm->paddr = paddr;
-		rm->pages = pages;
+	rm->page = vmalloc(pages * sizeof(*rm->page));
+	if (!rm->page) {
+		kfree(rm);
+		return NULL;
 	}
 
+	rm->allocs = RB_ROOT;
+	rm->paddr = paddr;
+	rm->pages = pages;
+
+	for (i = 0; i < VRAM_MAX_ORDER; i++)
+		INIT_LIST_HEAD(&rm->free_area[i]);
+	for (i = 0; i < pages; i++)
+		rm->page[i].order = -1;
+
+	/*
+	 * The initial contents are unknown, but may hold a boot splash that
+	 * is about to be reserved, so nothing is cleared until the first
+	 * allocation or free.
+	 */
+	vram_release(rm, 0, pages, true);
+
 	return rm;
 }
 
@@ -103,6 +343,7 @@ static struct vram_region *omap_vram_create_region(unsigned long paddr,
 static void omap_vram_free_region(struct vram_region *vr)
 {
 	list_del(&vr->list);
+	vfree(vr->page);
 	kfree(vr);
 }
 #endif
@@ -110,6 +351,8 @@ static void omap_vram_free_region(struct vram_region *vr)
 static struct vram_alloc *omap_vram_create_allocation(struct vram_region *vr,
 		unsigned long paddr, unsigned pages)
 {
+	struct rb_node **p = &vr->allocs.rb_node;
+	struct rb_node *parent = NULL;
 	struct vram_alloc *va;
 	struct vram_alloc *new;
 
@@ -121,19 +364,28 @@ static struct vram_alloc *omap_vram_create_allocation(struct vram_region *vr,
 	new->paddr = paddr;
 	new->pages = pages;
 
-	list_for_each_entry(va, &vr->alloc_list, list) {
-		if (va->paddr > new->paddr)
-			break;
+	while (*p) {
+		parent = *p;
+		va = rb_entry(parent, struct vram_alloc, node);
+
+		if (paddr < va->paddr)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
 	}
 
-	list_add_tail(&new->list, &va->list);
+	rb_link_node(&new->node, parent, p);
+	rb_insert_color(&new->node, &vr->allocs);
+	vr->nr_allocs++;
 
 	return new;
 }
 
-static void omap_vram_free_allocation(struct vram_alloc *va)
+static void omap_vram_free_allocation(struct vram_region *vr,
+		struct vram_alloc *va)
 {
-	list_del(&va->list);
+	rb_erase(&va->node, &vr->allocs);
+	vr->nr_allocs--;
 	kfree(va);
 }
 
@@ -169,8 +421,8 @@ int omap_vram_add_region(unsigned long paddr, size_t size)
 int omap_vram_free(unsigned long paddr, size_t size)
 {
 	struct vram_region *rm;
-	struct vram_alloc *alloc;
-	unsigned start, end;
+	struct vram_alloc *alloc, *va;
+	struct rb_node *node;
 
 	DBG("free mem paddr %08lx size %d\n", paddr, size);
 
@@ -179,22 +431,40 @@ int omap_vram_free(unsigned long paddr, size_t size)
 	mutex_lock(&region_mutex);
 
 	list_for_each_entry(rm, &region_list, list) {
-		list_for_each_entry(alloc, &rm->alloc_list, list) {
-			start = alloc->paddr;
-			end = alloc->paddr + (alloc->pages >> PAGE_SHIFT);
+		if (paddr < rm->paddr ||
+		    paddr >= rm->paddr + (rm->pages << PAGE_SHIFT))
+			continue;
 
-			if (start >= paddr && end < paddr + size)
-				goto found;
+		/* lowest allocation starting at or above paddr */
+		alloc = NULL;
+		node = rm->allocs.rb_node;
+		while (node) {
+			va = rb_entry(node, struct vram_alloc, node);
+			if (va->paddr >= paddr) {
+				alloc = va;
+				node = node->rb_left;
+			} else {
+				node = node->rb_right;
+			}
 		}
+
+		if (alloc && alloc->paddr + (alloc->pages << PAGE_SHIFT) <=
+				paddr + size)
+			goto found;
 	}
 
 	mutex_unlock(&region_mutex);
 	return -EINVAL;
 
 found:
-	omap_vram_free_allocation(alloc);
+	vram_release(rm, region_pfn(rm, alloc->paddr), alloc->pages, true);
+	omap_vram_free_allocation(rm, alloc);
 
 	mutex_unlock(&region_mutex);
+
+	/* zero the freed memory before it is handed out again */
+	schedule_work(&vram_clear_work);
+
 	return 0;
 }
 EXPORT_SYMBOL(omap_vram_free);
@@ -202,8 +472,8 @@ EXPORT_SYMBOL(omap_vram_free);
 static int _omap_vram_reserve(unsigned long paddr, unsigned pages)
 {
 	struct vram_region *rm;
-	struct vram_alloc *alloc;
 	size_t size;
+	bool dirty;
 
 	size = pages << PAGE_SHIFT;
 
@@ -222,24 +492,16 @@ static int _omap_vram_reserve(unsigned long paddr, unsigned pages)
 
 		DBG("block ok, checking allocs\n");
 
-		list_for_each_entry(alloc, &rm->alloc_list, list) {
-			end = alloc->paddr - 1;
-
-			if (start <= paddr && end >= paddr + size - 1)
-				goto found;
-
-			start = alloc->paddr + (alloc->pages << PAGE_SHIFT);
-		}
-
-		end = rm->paddr + (rm->pages << PAGE_SHIFT) - 1;
-
-		if (!(start <= paddr && end >= paddr + size - 1))
+		if (vram_carve(rm, region_pfn(rm, paddr), pages, &dirty))
 			continue;
-found:
-		DBG("found area start %lx, end %lx\n", start, end);
 
-		if (omap_vram_create_allocation(rm, paddr, pages) == NULL)
+		DBG("found area start %lx, end %lx\n", paddr,
+				paddr + size - 1);
+
+		if (omap_vram_create_allocation(rm, paddr, pages) == NULL) {
+			vram_release(rm, region_pfn(rm, paddr), pages, dirty);
 			return -ENOMEM;
+		}
 
 		return 0;
 	}
@@ -263,6 +525,15 @@ int omap_vram_reserve(unsigned long paddr, size_t size)
 
 	mutex_unlock(&region_mutex);
 
+	/* part of the area may have been taken off the lists for clearing */
+	if (r == -ENOMEM) {
+		flush_work(&vram_clear_work);
+
+		mutex_lock(&region_mutex);
+		r = _omap_vram_reserve(paddr, pages);
+		mutex_unlock(&region_mutex);
+	}
+
 	return r;
 }
 EXPORT_SYMBOL(omap_vram_reserve);
@@ -320,44 +591,90 @@ err:
 	return r;
 }
 
-static int _omap_vram_alloc(int mtype, unsigned pages, unsigned long *paddr)
+/* zero dirty free blocks, largest first, outside of the region lock */
+static void omap_vram_clear_work(struct work_struct *work)
 {
 	struct vram_region *rm;
-	struct vram_alloc *alloc;
-
-	list_for_each_entry(rm, &region_list, list) {
-		unsigned long start, end;
+	struct vram_page *pg;
+	unsigned pfn, pages;
+	int order;
+	int r;
 
-		DBG("checking region %lx %d\n", rm->paddr, rm->pages);
+again:
+	mutex_lock(&region_mutex);
 
-		if (region_mem_type(rm->paddr) != mtype)
+	list_for_each_entry(rm, &region_list, list) {
+		if (!rm->dirty_pages)
 			continue;
 
-		start = rm->paddr;
-
-		list_for_each_entry(alloc, &rm->alloc_list, list) {
-			end = alloc->paddr;
+		for (order = VRAM_MAX_ORDER - 1; order >= 0; order--) {
+			if (list_empty(&rm->free_area[order]))
+				continue;
 
-			if (end - start >= pages << PAGE_SHIFT)
+			pg = list_entry(rm->free_area[order].prev,
+					struct vram_page, list);
+			if (pg->dirty)
 				goto found;
-
-			start = alloc->paddr + (alloc->pages << PAGE_SHIFT);
 		}
+	}
+
+	mutex_unlock(&region_mutex);
+	return;
 
-		end = rm->paddr + (rm->pages << PAGE_SHIFT);
 found:
-		if (end - start < pages << PAGE_SHIFT)
+	pfn = pg - rm->page;
+	pages = 1 << order;
+
+	vram_del_block(rm, pfn);
+	rm->clearing_pages += pages;
+
+	mutex_unlock(&region_mutex);
+
+	r = _omap_vram_clear(rm->paddr + (pfn << PAGE_SHIFT), pages);
+
+	mutex_lock(&region_mutex);
+	rm->clearing_pages -= pages;
+	vram_release(rm, pfn, pages, r != 0);
+	mutex_unlock(&region_mutex);
+
+	/* leave the rest to the allocation path if the DMA failed */
+	if (r == 0)
+		goto again;
+}
+
+static int _omap_vram_alloc(int mtype, unsigned pages, unsigned long *paddr)
+{
+	struct vram_region *rm;
+	unsigned pfn;
+	bool dirty;
+
+	list_for_each_entry(rm, &region_list, list) {
+		DBG("checking region %lx %d\n", rm->paddr, rm->pages);
+
+		if (region_mem_type(rm->paddr) != mtype)
+			continue;
+
+		/* fall back to an unaligned fit if the buddy lists fail */
+		if (vram_buddy_fit(rm, pages, &pfn) &&
+		    vram_find_run(rm, pages, &pfn) < pages)
 			continue;
 
-		DBG("found %lx, end %lx\n", start, end);
+		if (vram_carve(rm, pfn, pages, &dirty))
+			continue;
 
-		alloc = omap_vram_create_allocation(rm, start, pages);
-		if (alloc == NULL)
-			return -ENOMEM;
+		*paddr = rm->paddr + (pfn << PAGE_SHIFT);
 
-		*paddr = start;
+		DBG("found %lx, end %lx\n", *paddr,
+				*paddr + (pages << PAGE_SHIFT));
+
+		if (omap_vram_create_allocation(rm, *paddr, pages) == NULL) {
+			vram_release(rm, pfn, pages, dirty);
+			return -ENOMEM;
+		}
 
-		_omap_vram_clear(start, pages);
+		/* blocks zeroed in the background need no clearing */
+		if (dirty)
+			_omap_vram_clear(*paddr, pages);
 
 		return 0;
 	}
@@ -383,6 +700,18 @@ int omap_vram_alloc(int mtype, size_t size, unsigned long *paddr)
 
 	mutex_unlock(&region_mutex);
 
+	/* wait for blocks being cleared to come back and try again */
+	if (r == -ENOMEM) {
+		flush_work(&vram_clear_work);
+
+		mutex_lock(&region_mutex);
+		r = _omap_vram_alloc(mtype, pages, paddr);
+		mutex_unlock(&region_mutex);
+	}
+
+	/* keep the free memory pre-zeroed for the next allocation */
+	schedule_work(&vram_clear_work);
+
 	return r;
 }
 EXPORT_SYMBOL(omap_vram_alloc);
@@ -392,7 +721,7 @@ void omap_vram_get_info(unsigned long *vram,
 		unsigned long *largest_free_block)
 {
 	struct vram_region *vr;
-	struct vram_alloc *va;
+	unsigned long largest;
 
 	*vram = 0;
 	*free_vram = 0;
@@ -401,24 +730,13 @@ void omap_vram_get_info(unsigned long *vram,
 	mutex_lock(&region_mutex);
 
 	list_for_each_entry(vr, &region_list, list) {
-		unsigned free;
-		unsigned long pa;
-
-		pa = vr->paddr;
 		*vram += vr->pages << PAGE_SHIFT;
+		*free_vram += (vr->free_pages + vr->clearing_pages) <<
+			PAGE_SHIFT;
 
-		list_for_each_entry(va, &vr->alloc_list, list) {
-			free = va->paddr - pa;
-			*free_vram += free;
-			if (free > *largest_free_block)
-				*largest_free_block = free;
-			pa = va->paddr + (va->pages << PAGE_SHIFT);
-		}
-
-		free = vr->paddr + (vr->pages << PAGE_SHIFT) - pa;
-		*free_vram += free;
-		if (free > *largest_free_block)
-			*largest_free_block = free;
+		largest = vram_find_run(vr, 0, NULL) << PAGE_SHIFT;
+		if (largest > *largest_free_block)
+			*largest_free_block = largest;
 	}
 
 	mutex_unlock(&region_mutex);
@@ -430,7 +748,9 @@ static int vram_debug_show(struct seq_file *s, void *unused)
 {
 	struct vram_region *vr;
 	struct vram_alloc *va;
-	unsigned size;
+	struct rb_node *node;
+	unsigned size, largest;
+	int order;
 
 	mutex_lock(&region_mutex);
 
@@ -440,12 +760,32 @@ static int vram_debug_show(struct seq_file *s, void *unused)
 				vr->paddr, vr->paddr + size - 1,
 				size);
 
-		list_for_each_entry(va, &vr->alloc_list, list) {
+		for (node = rb_first(&vr->allocs); node;
+				node = rb_next(node)) {
+			va = rb_entry(node, struct vram_alloc, node);
 			size = va->pages << PAGE_SHIFT;
 			seq_printf(s, "    %08lx-%08lx (%d bytes)\n",
 					va->paddr, va->paddr + size - 1,
 					size);
 		}
+
+		/*
+		 * Fragmentation is the share of free memory that is not
+		 * part of the largest free run.
+		 */
+		largest = vram_find_run(vr, 0, NULL);
+		seq_printf(s, "  %u allocs, %u free pages (%u dirty, "
+				"%u clearing), largest run %u pages, "
+				"fragmentation %u%%\n",
+				vr->nr_allocs, vr->free_pages,
+				vr->dirty_pages, vr->clearing_pages, largest,
+				vr->free_pages ?
+				100 - largest * 100 / vr->free_pages : 0);
+
+		seq_printf(s, "  free blocks by order:");
+		for (order = 0; order < VRAM_MAX_ORDER; order++)
+			seq_printf(s, " %u", vr->nr_free[order]);
+		seq_printf(s, "\n");
 	}
 
 	mutex_unlock(&region_mutex);
@@ -47,6 +47,13 @@ struct cpsw_platform_data {
 	u32	host_port_num; /* The port number for the host port */
 
 	bool	no_bd_ram; /* no embedded BD ram*/
+	/*
+	 * Optional on-chip (OCMC) RAM area to hold the buffer descriptors
+	 * instead of the embedded BD RAM; it is larger, so it allows for
+	 * more descriptors in flight without going out to DDR.
+	 */
+	u32	ocmc_bd_ram_phys;
+	u32	ocmc_bd_ram_size;
 	u32	default_vlan;
 };
 
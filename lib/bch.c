@@ -0,0 +1,672 @@
+/*
+ * Generic binary BCH encoding/decoding library
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * Elements of GF(2^m) are held as integers whose bits are the coefficients
+ * of the element on the polynomial basis 1, alpha, ..., alpha^(m-1), where
+ * alpha is a root of the primitive polynomial.  Multiplication goes through
+ * the log (a_log_tab) and antilog (a_pow_tab) tables.
+ *
+ * The codeword is the data, most significant bit of each byte first,
+ * followed by the ecc_bits parity bits; the last parity bit is the
+ * coefficient of x^0.
+ *
+ * Encoding runs the parity LFSR a byte at a time, using a table of the 256
+ * possible remainders.
+ *
+ * Decoding takes the syndromes from the set bits of the parity remainder,
+ * gets the error locator polynomial from the binary Berlekamp-Massey
+ * algorithm, and then finds its roots.  One or two errors, the common case
+ * on NAND, are solved in closed form.  More errors need a Chien search,
+ * but it is limited to the bits of the codeword and works on logs, so each
+ * term costs a single table lookup.
+ *
+ * A bch_control and its buffers belong to one user at a time: callers
+ * sharing one must serialize encode_bch() and decode_bch().
+ */
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/bch.h>
+
+#define GF_M_MIN	5
+#define GF_M_MAX	15
+
+struct gf_poly {
+	unsigned int deg;
+	unsigned int c[0];
+};
+
+/* size of a polynomial of degree up to d */
+#define GF_POLY_SZ(_d)	(sizeof(struct gf_poly) + \
+			 ((_d) + 1) * sizeof(unsigned int))
+
+/* default primitive polynomials for m = 5 ... 15 */
+static const unsigned int prim_poly_tab[] = {
+	0x25, 0x43, 0x83, 0x11d, 0x211, 0x409, 0x805, 0x1053, 0x201b,
+	0x402b, 0x8003,
+};
+
+/* v mod n, for v < 4n */
+static inline unsigned int mod_n(struct bch_control *bch, unsigned int v)
+{
+	const unsigned int n = bch->n;
+
+	while (v >= n)
+		v -= n;
+	return v;
+}
+
+static inline unsigned int a_pow(struct bch_control *bch, unsigned int i)
+{
+	return bch->a_pow_tab[mod_n(bch, i)];
+}
+
+static inline unsigned int a_log(struct bch_control *bch, unsigned int x)
+{
+	return bch->a_log_tab[x];
+}
+
+static inline unsigned int gf_mul(struct bch_control *bch, unsigned int a,
+				  unsigned int b)
+{
+	return (a && b) ? a_pow(bch, a_log(bch, a) + a_log(bch, b)) : 0;
+}
+
+static inline unsigned int gf_sqr(struct bch_control *bch, unsigned int a)
+{
+	return a ? a_pow(bch, 2 * a_log(bch, a)) : 0;
+}
+
+/* Load ecc bytes into left aligned words, clearing the bits past ecc_bits */
+static void load_ecc8(struct bch_control *bch, uint32_t *dst,
+		      const uint8_t *src)
+{
+	const unsigned int pad = 32 * bch->ecc_words - bch->ecc_bits;
+	unsigned int i;
+
+	memset(dst, 0, bch->ecc_words * sizeof(*dst));
+	for (i = 0; i < bch->ecc_bytes; i++)
+		dst[i / 4] |= (uint32_t)src[i] << (24 - 8 * (i % 4));
+	dst[bch->ecc_words - 1] &= ~0U << pad;
+}
+
+static void store_ecc8(struct bch_control *bch, uint8_t *dst,
+		       const uint32_t *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < bch->ecc_bytes; i++)
+		dst[i] = src[i / 4] >> (24 - 8 * (i % 4));
+}
+
+/* Run the parity LFSR in r over len bytes of data */
+static void encode_bch_words(struct bch_control *bch, const uint8_t *data,
+			     unsigned int len, uint32_t *r)
+{
+	const unsigned int l = bch->ecc_words;
+	const uint32_t *p;
+	unsigned int i;
+
+	while (len--) {
+		p = bch->mod8_tab + l * ((r[0] >> 24) ^ *data++);
+		for (i = 0; i < l - 1; i++)
+			r[i] = ((r[i] << 8) | (r[i + 1] >> 24)) ^ p[i];
+		r[l - 1] = (r[l - 1] << 8) ^ p[l - 1];
+	}
+}
+
+/**
+ * encode_bch - calculate BCH ecc parity of data
+ * @bch:   BCH control structure
+ * @data:  data to encode
+ * @len:   data length in bytes
+ * @ecc:   ecc parity data, ecc_bytes long
+ *
+ * @ecc must be zeroed before the first call; a buffer can be encoded in
+ * several chunks by passing the same @ecc each time.
+ */
+void encode_bch(struct bch_control *bch, const uint8_t *data,
+		unsigned int len, uint8_t *ecc)
+{
+	load_ecc8(bch, bch->ecc_buf, ecc);
+	encode_bch_words(bch, data, len, bch->ecc_buf);
+	store_ecc8(bch, ecc, bch->ecc_buf);
+}
+EXPORT_SYMBOL_GPL(encode_bch);
+
+/*
+ * Syndromes S(1) ... S(2t) of the parity remainder r(x) in ecc.  Only set
+ * bits cost anything; the even syndromes follow from S(2i) = S(i)^2.
+ */
+static void compute_syndromes(struct bch_control *bch, const uint32_t *ecc,
+			      unsigned int *syn)
+{
+	const unsigned int t = bch->t;
+	unsigned int i, j, s, d, e, step;
+	uint32_t w;
+
+	memset(syn, 0, 2 * t * sizeof(*syn));
+
+	for (i = 0; i < bch->ecc_words; i++) {
+		for (w = ecc[i]; w; w &= ~(1U << j)) {
+			j = __fls(w);
+			d = bch->ecc_bits - 1 - (32 * i + 31 - j);
+
+			/* S(2s+1) += alpha^((2s+1)d) */
+			step = mod_n(bch, 2 * d);
+			for (s = 0, e = d; s < t; s++) {
+				syn[2 * s] ^= bch->a_pow_tab[e];
+				e = mod_n(bch, e + step);
+			}
+		}
+	}
+
+	for (j = 0; j < t; j++)
+		syn[2 * j + 1] = gf_sqr(bch, syn[j]);
+}
+
+static void gf_poly_copy(struct gf_poly *dst, const struct gf_poly *src)
+{
+	memcpy(dst, src, GF_POLY_SZ(src->deg));
+}
+
+/*
+ * Error locator polynomial from the syndromes, by the simplified binary
+ * Berlekamp-Massey algorithm: with binary codes every other discrepancy is
+ * zero, so t iterations are enough.  Returns the number of errors, or -1
+ * if there are more than t.
+ */
+static int compute_error_locator_polynomial(struct bch_control *bch,
+					    const unsigned int *syn)
+{
+	const unsigned int t = bch->t;
+	const unsigned int n = bch->n;
+	struct gf_poly *elp = bch->elp;
+	struct gf_poly *pelp = bch->poly_2t[0];
+	struct gf_poly *elp_copy = bch->poly_2t[1];
+	unsigned int i, j, k, tmp, d = syn[0], pd = 1;
+	int pp = -1;
+
+	memset(elp, 0, GF_POLY_SZ(2 * t));
+	memset(pelp, 0, GF_POLY_SZ(2 * t));
+	elp->c[0] = 1;
+	pelp->c[0] = 1;
+
+	for (i = 0; i < t && elp->deg <= t; i++) {
+		if (d) {
+			/*
+			 * elp(x) += d/pd x^(2i-pp) pelp(x), where pelp is the
+			 * last polynomial that increased the degree and pd
+			 * was its discrepancy.
+			 */
+			k = 2 * i - pp;
+			gf_poly_copy(elp_copy, elp);
+			tmp = a_log(bch, d) + n - a_log(bch, pd);
+			for (j = 0; j <= pelp->deg; j++)
+				if (pelp->c[j])
+					elp->c[j + k] ^= a_pow(bch, tmp +
+						a_log(bch, pelp->c[j]));
+
+			tmp = pelp->deg + k;
+			if (tmp > elp->deg) {
+				elp->deg = tmp;
+				gf_poly_copy(pelp, elp_copy);
+				pd = d;
+				pp = 2 * i;
+			}
+		}
+		/* next discrepancy, against S(2i+3) */
+		if (i < t - 1) {
+			d = syn[2 * i + 2];
+			for (j = 1; j <= elp->deg; j++)
+				d ^= gf_mul(bch, elp->c[j], syn[2 * i + 2 - j]);
+		}
+	}
+	return (elp->deg > t) ? -1 : (int)elp->deg;
+}
+
+/*
+ * The roots of the error locator polynomial are alpha^-j for errors at
+ * degree j of the codeword, which must be below nbits.  The finders below
+ * return these degrees in errdeg, and how many they found.
+ */
+
+/* c1 x + c0 */
+static int find_poly_deg1_roots(struct bch_control *bch,
+				const struct gf_poly *p, unsigned int nbits,
+				unsigned int *errdeg)
+{
+	unsigned int j;
+
+	if (!p->c[0])
+		return 0;
+
+	j = mod_n(bch, a_log(bch, p->c[1]) + bch->n - a_log(bch, p->c[0]));
+	if (j >= nbits)
+		return 0;
+
+	errdeg[0] = j;
+	return 1;
+}
+
+/*
+ * c2 x^2 + c1 x + c0: with x = (c1/c2) y this is y^2 + y = u, for
+ * u = c0 c2 / c1^2, which is linear over GF(2).  xi_tab holds a solution
+ * for each basis element, so y is the sum of those for the bits of u; y + 1
+ * is the other root.
+ */
+static int find_poly_deg2_roots(struct bch_control *bch,
+				const struct gf_poly *p, unsigned int nbits,
+				unsigned int *errdeg)
+{
+	const unsigned int n = bch->n;
+	unsigned int l0, l1, l2, u, v, y, j0, j1;
+
+	if (!p->c[0] || !p->c[1])
+		return 0;
+
+	l0 = a_log(bch, p->c[0]);
+	l1 = a_log(bch, p->c[1]);
+	l2 = a_log(bch, p->c[2]);
+
+	u = a_pow(bch, l0 + l2 + 2 * (n - l1));
+	for (y = 0, v = u; v; v &= v - 1)
+		y ^= bch->xi_tab[__ffs(v)];
+
+	/* no solution if Tr(u) != 0 */
+	if ((gf_sqr(bch, y) ^ y) != u)
+		return 0;
+
+	/* errors at degree log(c2 / (c1 y)) */
+	j0 = mod_n(bch, l2 + 2 * n - l1 - a_log(bch, y));
+	j1 = mod_n(bch, l2 + 2 * n - l1 - a_log(bch, y ^ 1));
+	if (j0 >= nbits || j1 >= nbits)
+		return 0;
+
+	errdeg[0] = j0;
+	errdeg[1] = j1;
+	return 2;
+}
+
+/*
+ * Chien search: evaluate p(alpha^-j) for j = 0 ... nbits-1.  Term k of
+ * p(alpha^-j) is alpha^(log(c_k) - kj), so only the logs of the non-zero
+ * terms are kept and stepped down by k at each j.
+ */
+static int chien_search(struct bch_control *bch, const struct gf_poly *p,
+			unsigned int nbits, unsigned int *errdeg)
+{
+	const unsigned int n = bch->n;
+	/* poly_2t[] are free once the locator polynomial is known */
+	unsigned int *e = bch->poly_2t[0]->c;
+	unsigned int *step = bch->poly_2t[1]->c;
+	unsigned int j, k, terms = 0, cnt = 0;
+	unsigned int c0, sum;
+
+	c0 = p->c[0];
+	for (k = 1; k <= p->deg; k++) {
+		if (p->c[k]) {
+			e[terms] = a_log(bch, p->c[k]);
+			step[terms++] = n - k;
+		}
+	}
+
+	for (j = 0; j < nbits; j++) {
+		sum = c0;
+		for (k = 0; k < terms; k++) {
+			sum ^= bch->a_pow_tab[e[k]];
+			e[k] = mod_n(bch, e[k] + step[k]);
+		}
+		if (!sum) {
+			errdeg[cnt++] = j;
+			if (cnt == p->deg)
+				break;
+		}
+	}
+	return cnt;
+}
+
+/**
+ * decode_bch_syndromes - locate errors from the syndromes
+ * @bch:    BCH control structure
+ * @syn:    syndromes S(1) ... S(2t)
+ * @nbits:  codeword size in bits
+ * @errdeg: output array of at least t error locations
+ *
+ * For users whose hardware computes the syndromes, or whose codeword layout
+ * differs from the one of encode_bch().  The error locations are returned
+ * as degrees in the received polynomial, all below @nbits.
+ *
+ * Returns the number of errors found, or -EBADMSG if they could not be
+ * corrected.
+ */
+int decode_bch_syndromes(struct bch_control *bch, const unsigned int *syn,
+			 unsigned int nbits, unsigned int *errdeg)
+{
+	struct gf_poly *elp = bch->elp;
+	int err, nroots;
+
+	err = compute_error_locator_polynomial(bch, syn);
+	if (err <= 0)
+		return err ? -EBADMSG : 0;
+
+	switch (elp->deg) {
+	case 1:
+		nroots = find_poly_deg1_roots(bch, elp, nbits, errdeg);
+		break;
+	case 2:
+		nroots = find_poly_deg2_roots(bch, elp, nbits, errdeg);
+		break;
+	default:
+		nroots = chien_search(bch, elp, nbits, errdeg);
+		break;
+	}
+
+	return (nroots == err) ? err : -EBADMSG;
+}
+EXPORT_SYMBOL_GPL(decode_bch_syndromes);
+
+/**
+ * decode_bch - decode received codeword and find bit error locations
+ * @bch:      BCH control structure
+ * @data:     received data, ignored if @calc_ecc is provided
+ * @len:      data length in bytes
+ * @recv_ecc: received ecc, if NULL then @calc_ecc is assumed to contain
+ *            the xor of the received and calculated ecc
+ * @calc_ecc: calculated ecc, if NULL then it is computed from @data
+ * @syn:      syndromes, if not NULL then all other parity arguments are
+ *            ignored
+ * @errloc:   output array of at least t error locations
+ *
+ * Returns the number of errors found, -EBADMSG if the codeword could not
+ * be corrected, or -EINVAL for invalid arguments.  Each error is fixed
+ * with:
+ *
+ *	if (errloc[i] < 8 * len)
+ *		data[errloc[i] / 8] ^= 1 << (errloc[i] & 7);
+ *
+ * errloc[i] >= 8 * len is an error in the ecc bytes, at the same bit
+ * numbering counting from 8 * len.
+ */
+int decode_bch(struct bch_control *bch, const uint8_t *data, unsigned int len,
+	       const uint8_t *recv_ecc, const uint8_t *calc_ecc,
+	       const unsigned int *syn, unsigned int *errloc)
+{
+	const unsigned int nbits = 8 * len + bch->ecc_bits;
+	uint32_t *ecc = bch->ecc_buf;
+	unsigned int p, sum;
+	int i, err;
+
+	if (nbits > bch->n)
+		return -EINVAL;
+
+	if (!syn) {
+		if (calc_ecc) {
+			load_ecc8(bch, ecc, calc_ecc);
+		} else if (data && recv_ecc) {
+			memset(ecc, 0, bch->ecc_words * sizeof(*ecc));
+			encode_bch_words(bch, data, len, ecc);
+		} else {
+			return -EINVAL;
+		}
+
+		if (recv_ecc) {
+			load_ecc8(bch, bch->ecc_buf2, recv_ecc);
+			for (i = 0; i < bch->ecc_words; i++)
+				ecc[i] ^= bch->ecc_buf2[i];
+		}
+
+		for (i = 0, sum = 0; i < bch->ecc_words; i++)
+			sum |= ecc[i];
+		if (!sum)
+			return 0;
+
+		compute_syndromes(bch, ecc, bch->syn);
+		syn = bch->syn;
+	}
+
+	err = decode_bch_syndromes(bch, syn, nbits, errloc);
+	for (i = 0; i < err; i++) {
+		p = nbits - 1 - errloc[i];
+		errloc[i] = (p & ~7) | (7 - (p & 7));
+	}
+	return err;
+}
+EXPORT_SYMBOL_GPL(decode_bch);
+
+static int build_gf_tables(struct bch_control *bch, unsigned int poly)
+{
+	unsigned int i, x = 1;
+
+	if (fls(poly) != bch->m + 1)
+		return -EINVAL;
+
+	for (i = 0; i < bch->n; i++) {
+		/* alpha^i = 1 before i = n means poly is not primitive */
+		if (i && x == 1)
+			return -EINVAL;
+		bch->a_pow_tab[i] = x;
+		bch->a_log_tab[x] = i;
+		x <<= 1;
+		if (x & (1 << bch->m))
+			x ^= poly;
+	}
+	bch->a_pow_tab[bch->n] = 1;
+	bch->a_log_tab[0] = 0;
+	return 0;
+}
+
+/*
+ * Generator polynomial: the product of (x + alpha^i) over the conjugates
+ * of alpha, alpha^3, ..., alpha^(2t-1).  Its coefficients are binary; they
+ * are returned in g, g[i] for x^i, and the degree is returned.
+ */
+static int compute_generator_polynomial(struct bch_control *bch,
+					unsigned int *g)
+{
+	const unsigned int n = bch->n;
+	unsigned int i, j, r, deg = 0;
+	unsigned long *roots;
+
+	roots = kzalloc(BITS_TO_LONGS(n) * sizeof(long), GFP_KERNEL);
+	if (!roots)
+		return -ENOMEM;
+
+	for (i = 0; i < bch->t; i++)
+		for (j = 0, r = 2 * i + 1; j < bch->m; j++) {
+			__set_bit(r, roots);
+			r = mod_n(bch, 2 * r);
+		}
+
+	g[0] = 1;
+	for (i = 0; i < n; i++) {
+		if (!test_bit(i, roots))
+			continue;
+		r = bch->a_pow_tab[i];
+		g[deg + 1] = 1;
+		for (j = deg; j > 0; j--)
+			g[j] = gf_mul(bch, g[j], r) ^ g[j - 1];
+		g[0] = gf_mul(bch, g[0], r);
+		deg++;
+	}
+
+	kfree(roots);
+	return deg;
+}
+
+/*
+ * mod8_tab[b] is b(x) x^(32 ecc_words) mod g(x) x^pad, left aligned like
+ * the parity register: the remainder to add when byte b is shifted out.
+ */
+static int build_mod8_tables(struct bch_control *bch, const unsigned int *g)
+{
+	const unsigned int l = bch->ecc_words;
+	uint32_t *gen = bch->ecc_buf, *r;
+	unsigned int b, i, k, fb;
+
+	/* g(x) without its leading term, left aligned */
+	memset(gen, 0, l * sizeof(*gen));
+	for (i = 0; i < bch->ecc_bits; i++)
+		if (g[bch->ecc_bits - 1 - i])
+			gen[i / 32] |= 1U << (31 - i % 32);
+
+	for (b = 0; b < 256; b++) {
+		r = bch->mod8_tab + l * b;
+		for (k = 0; k < 8; k++) {
+			fb = (r[0] >> 31) ^ ((b >> (7 - k)) & 1);
+			for (i = 0; i < l - 1; i++)
+				r[i] = (r[i] << 1) | (r[i + 1] >> 31);
+			r[l - 1] <<= 1;
+			if (fb)
+				for (i = 0; i < l; i++)
+					r[i] ^= gen[i];
+		}
+	}
+	return 0;
+}
+
+/*
+ * xi_tab[i] solves y^2 + y = alpha^i + Tr(alpha^i) alpha^k, where Tr(alpha^k)
+ * is 1.  Summing them over the bits of a trace zero u solves y^2 + y = u.
+ */
+static int build_deg2_base(struct bch_control *bch)
+{
+	const unsigned int m = bch->m;
+	unsigned int i, j, r, e, sum, x, y, remaining, ak = 0;
+	unsigned int found = 0;
+
+	for (i = 0; i < m && !ak; i++) {
+		for (j = 0, e = i, sum = 0; j < m; j++) {
+			sum ^= bch->a_pow_tab[e];
+			e = mod_n(bch, 2 * e);
+		}
+		if (sum)
+			ak = bch->a_pow_tab[i];
+	}
+	if (!ak)
+		return -EINVAL;
+
+	remaining = m;
+	for (x = 0; x <= bch->n && remaining; x++) {
+		y = gf_sqr(bch, x) ^ x;
+		for (i = 0; i < 2; i++, y ^= ak) {
+			r = a_log(bch, y);
+			if (y && r < m && !(found & (1 << r))) {
+				bch->xi_tab[r] = x;
+				found |= 1 << r;
+				remaining--;
+				break;
+			}
+		}
+	}
+	return remaining ? -EINVAL : 0;
+}
+
+/**
+ * init_bch - initialize a BCH encoder/decoder
+ * @m:          Galois field order, between 5 and 15
+ * @t:          maximum error correction capability, in bits
+ * @prim_poly:  primitive polynomial of degree @m, or 0 for a default one
+ *
+ * The codeword, data and parity, can be up to 2^@m - 1 bits long and the
+ * parity takes up to @m * @t bits.
+ *
+ * Returns the BCH control structure, or NULL on failure.
+ */
+struct bch_control *init_bch(int m, int t, unsigned int prim_poly)
+{
+	struct bch_control *bch;
+	unsigned int *g = NULL;
+	int deg;
+
+	if (m < GF_M_MIN || m > GF_M_MAX)
+		return NULL;
+	if (t < 1 || m * t >= ((1 << m) - 1))
+		return NULL;
+
+	if (!prim_poly)
+		prim_poly = prim_poly_tab[m - GF_M_MIN];
+
+	bch = kzalloc(sizeof(*bch), GFP_KERNEL);
+	if (!bch)
+		return NULL;
+
+	bch->m = m;
+	bch->t = t;
+	bch->n = (1 << m) - 1;
+
+	bch->a_pow_tab = kmalloc((bch->n + 1) * sizeof(uint16_t), GFP_KERNEL);
+	bch->a_log_tab = kmalloc((bch->n + 1) * sizeof(uint16_t), GFP_KERNEL);
+	bch->xi_tab = kmalloc(m * sizeof(unsigned int), GFP_KERNEL);
+	bch->syn = kmalloc(2 * t * sizeof(unsigned int), GFP_KERNEL);
+	bch->elp = kmalloc(GF_POLY_SZ(2 * t), GFP_KERNEL);
+	bch->poly_2t[0] = kmalloc(GF_POLY_SZ(2 * t), GFP_KERNEL);
+	bch->poly_2t[1] = kmalloc(GF_POLY_SZ(2 * t), GFP_KERNEL);
+	g = kmalloc((m * t + 1) * sizeof(unsigned int), GFP_KERNEL);
+	if (!bch->a_pow_tab || !bch->a_log_tab || !bch->xi_tab || !bch->syn ||
+	    !bch->elp || !bch->poly_2t[0] || !bch->poly_2t[1] || !g)
+		goto fail;
+
+	if (build_gf_tables(bch, prim_poly))
+		goto fail;
+
+	deg = compute_generator_polynomial(bch, g);
+	if (deg < 0)
+		goto fail;
+
+	bch->ecc_bits = deg;
+	bch->ecc_bytes = DIV_ROUND_UP(deg, 8);
+	bch->ecc_words = DIV_ROUND_UP(deg, 32);
+
+	bch->mod8_tab = kzalloc(256 * bch->ecc_words * sizeof(uint32_t),
+				GFP_KERNEL);
+	bch->ecc_buf = kmalloc(bch->ecc_words * sizeof(uint32_t), GFP_KERNEL);
+	bch->ecc_buf2 = kmalloc(bch->ecc_words * sizeof(uint32_t), GFP_KERNEL);
+	if (!bch->mod8_tab || !bch->ecc_buf || !bch->ecc_buf2)
+		goto fail;
+
+	if (build_mod8_tables(bch, g) || build_deg2_base(bch))
+		goto fail;
+
+	kfree(g);
+	return bch;
+
+fail:
+	kfree(g);
+	free_bch(bch);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(init_bch);
+
+/**
+ * free_bch - free a BCH control structure
+ * @bch:    BCH control structure to release
+ */
+void free_bch(struct bch_control *bch)
+{
+	if (!bch)
+		return;
+
+	kfree(bch->a_pow_tab);
+	kfree(bch->a_log_tab);
+	kfree(bch->mod8_tab);
+	kfree(bch->ecc_buf);
+	kfree(bch->ecc_buf2);
+	kfree(bch->xi_tab);
+	kfree(bch->syn);
+	kfree(bch->elp);
+	kfree(bch->poly_2t[0]);
+	kfree(bch->poly_2t[1]);
+	kfree(bch);
+}
+EXPORT_SYMBOL_GPL(free_bch);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Binary BCH encoder/decoder");